@@ -0,0 +1,92 @@
+#pragma once
+
+#include "../vkallocator.h"
+#include "../vkbuffer.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace vsvr
+{
+namespace bench
+{
+
+/// @brief Something a trace can be replayed against.
+/// Ids are dense and in [0, idCount) as passed to prepare(). Backends are only thread-safe if threadSafe() returns true.
+class Backend
+{
+public:
+    struct Stats
+    {
+        uint64_t allocatedSize = 0;     // Bytes of device memory allocated.
+        uint64_t usedSize = 0;          // Bytes used by buffers.
+        uint32_t pageCount = 0;         // Number of device memory allocations.
+        uint32_t freeBlockCount = 0;    // Number of free blocks in pages.
+        uint64_t largestFreeBlock = 0;  // Byte size of largest free block.
+    };
+
+    virtual ~Backend() = default;
+
+    /// @brief Get description of backend for the report.
+    virtual std::string name() const = 0;
+    /// @brief Returns true if operations can be called from multiple threads with different ids.
+    virtual bool threadSafe() const = 0;
+    /// @brief Called before replaying with the number of ids used.
+    virtual void prepare(uint32_t idCount) = 0;
+    /// @brief Allocate buffer. Returns false if the allocation failed.
+    virtual bool allocate(uint32_t id, uint64_t size, uint64_t alignment) = 0;
+    /// @brief Update buffer with size bytes. Grows the buffer if needed.
+    virtual void update(uint32_t id, uint64_t size) = 0;
+    /// @brief Free buffer.
+    virtual void free(uint32_t id) = 0;
+    /// @brief Get memory statistics.
+    virtual Stats stats() = 0;
+};
+
+/// @brief Replays operations against a MemoryPool. Buffers are host-visible or device-local with ReallocStrategy::eGrow.
+/// Derived classes create the device and call createPool().
+class PoolBackend: public Backend
+{
+public:
+    ~PoolBackend();
+
+    bool threadSafe() const override;
+    void prepare(uint32_t idCount) override;
+    bool allocate(uint32_t id, uint64_t size, uint64_t alignment) override;
+    void update(uint32_t id, uint64_t size) override;
+    void free(uint32_t id) override;
+    Stats stats() override;
+
+    MemoryPool::Ptr pool() const;
+    vk::PhysicalDevice physicalDevice() const;
+    vk::Device logicalDevice() const;
+    /// @brief Get settings of buffers created by allocate().
+    const Buffer::Settings &settings() const;
+
+protected:
+    /// @brief Create pool on device, set queue as transfer queue and pageSize as page size of all memory types.
+    void createPool(vk::PhysicalDevice physicalDevice, vk::Device logicalDevice, vk::Queue queue, uint32_t queueFamily, AllocationStrategy strategy, uint64_t pageSize, bool hostVisible);
+    /// @brief Destroy buffers and pool. Call this before destroying the device.
+    void destroyPool();
+
+private:
+    vk::PhysicalDevice m_physicalDevice = nullptr;
+    vk::Device m_logicalDevice = nullptr;
+    MemoryPool::Ptr m_pool;
+    Buffer::Settings m_settings;
+    std::vector<Buffer::Ptr> m_buffers; // Buffers by id. Threads use disjoint ids, so no locking is needed.
+};
+
+/// @brief Replays against a MemoryPool on a StubDevice, so the CPU cost of the pool is measured without a driver.
+/// Only available in vsvr_bench_stub, because the stub device replaces the Vulkan entry points.
+/// @param hostVisible If true buffers are host-visible and updates are a memcpy, else updates go through the staging ring.
+std::unique_ptr<PoolBackend> createStubBackend(AllocationStrategy strategy, uint64_t pageSize, bool hostVisible);
+
+/// @brief Replays against a MemoryPool on a Vulkan device, e.g. lavapipe. Picks the first device whose name contains deviceName.
+/// @param hostVisible If true buffers are host-visible and updates are a memcpy, else updates go through the staging ring.
+/// @throw Throws if there is no Vulkan device or none matches.
+std::unique_ptr<PoolBackend> createDeviceBackend(const std::string &deviceName, AllocationStrategy strategy, uint64_t pageSize, bool hostVisible);
+
+}
+}
@@ -0,0 +1,368 @@
+#include "backend.h"
+#include "modes.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace vsvr;
+using namespace vsvr::bench;
+
+namespace
+{
+
+struct Options
+{
+    std::string deviceName;
+    AllocationStrategy strategy = AllocationStrategy::eTlsf;
+    uint64_t pageSize = 64 * 1024 * 1024;
+    bool hostVisible = true;
+    std::string traceFile;
+    std::string synthetic = "random";
+    uint32_t opCount = 100000;
+    uint32_t threadCount = 1;
+    std::string recordFile;
+};
+
+/// @brief Operation latencies of one replay in nanoseconds, per operation type.
+struct Latencies
+{
+    std::vector<uint32_t> allocate;
+    std::vector<uint32_t> update;
+    std::vector<uint32_t> free;
+    uint32_t failedAllocations = 0; // Number of allocations the backend could not satisfy.
+    std::string error;              // Error that stopped the replay or empty.
+};
+
+void printUsage()
+{
+    std::cout << "Usage: vsvr_bench|vsvr_bench_stub [OPTIONS]" << std::endl;
+    std::cout << "Replays an allocation trace against a MemoryPool and reports latencies and memory usage." << std::endl;
+    std::cout << "vsvr_bench runs the pool on a Vulkan device, vsvr_bench_stub on a stub device that only exists on the CPU." << std::endl;
+    std::cout << "  --device NAME           Use first Vulkan device whose name contains NAME, e.g. \"llvmpipe\" for lavapipe (vsvr_bench)" << std::endl;
+    std::cout << "  --device-local          Allocate device-local instead of host-visible buffers" << std::endl;
+    std::cout << "  --strategy tlsf|buddy|linear  Allocation strategy for pages (default: tlsf)" << std::endl;
+    std::cout << "  --page-size MIB         Page size in MiB (default: 64)" << std::endl;
+    std::cout << "  --trace FILE            Replay trace from FILE" << std::endl;
+    std::cout << "  --synthetic random|frames|updates  Replay a generated trace (default: random)" << std::endl;
+    std::cout << "  --synthetic MODE        Run a benchmark mode instead of a trace:" << std::endl;
+    std::istringstream modes(modeDescriptions());
+    for (std::string line; std::getline(modes, line);)
+    {
+        std::cout << "                            " << line << std::endl;
+    }
+    std::cout << "  --ops N                 Approximate number of operations of generated traces and modes (default: 100000)" << std::endl;
+    std::cout << "  --threads N             Replay trace on N threads with disjoint ids (default: 1), or use up to N threads in modes (default: 16)" << std::endl;
+    std::cout << "  --record FILE           Save the operations the pool saw during the replay to FILE" << std::endl;
+    std::cout << "                          Use TraceRecorder from bench/trace.h to record the trace of an application" << std::endl;
+}
+
+Options parseOptions(int argc, char *argv[])
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc)
+            {
+                throw std::runtime_error("Missing value for " + arg + "!");
+            }
+            return argv[++i];
+        };
+        if (arg == "--device")
+        {
+            options.deviceName = value();
+        }
+        else if (arg == "--device-local")
+        {
+            options.hostVisible = false;
+        }
+        else if (arg == "--strategy")
+        {
+            const auto name = value();
+            if (name == "tlsf")
+            {
+                options.strategy = AllocationStrategy::eTlsf;
+            }
+            else if (name == "buddy")
+            {
+                options.strategy = AllocationStrategy::eBuddy;
+            }
+            else if (name == "linear")
+            {
+                options.strategy = AllocationStrategy::eLinear;
+            }
+            else
+            {
+                throw std::runtime_error("Unknown strategy \"" + name + "\"!");
+            }
+        }
+        else if (arg == "--page-size")
+        {
+            options.pageSize = std::strtoull(value().c_str(), nullptr, 10) * 1024 * 1024;
+        }
+        else if (arg == "--trace")
+        {
+            options.traceFile = value();
+        }
+        else if (arg == "--synthetic")
+        {
+            options.synthetic = value();
+        }
+        else if (arg == "--ops")
+        {
+            options.opCount = static_cast<uint32_t>(std::strtoul(value().c_str(), nullptr, 10));
+        }
+        else if (arg == "--threads")
+        {
+            options.threadCount = std::max(1u, static_cast<uint32_t>(std::strtoul(value().c_str(), nullptr, 10)));
+        }
+        else if (arg == "--record")
+        {
+            options.recordFile = value();
+        }
+        else if (arg == "--help" || arg == "-h")
+        {
+            printUsage();
+            std::exit(0);
+        }
+        else
+        {
+            throw std::runtime_error("Unknown argument \"" + arg + "\"!");
+        }
+    }
+    if (options.pageSize == 0)
+    {
+        throw std::runtime_error("Page size must be > 0!");
+    }
+    return options;
+}
+
+Trace makeTrace(const Options &options)
+{
+    if (!options.traceFile.empty())
+    {
+        return loadTrace(options.traceFile);
+    }
+    if (options.synthetic == "random")
+    {
+        return makeRandomTrace(options.opCount, 256, 4 * 1024 * 1024, 2000, 1);
+    }
+    else if (options.synthetic == "frames")
+    {
+        // 100 transient buffers per frame, 3 frames in flight
+        return makeFrameTrace(std::max(1u, options.opCount / 200), 100, 3, 256, 256 * 1024, 1);
+    }
+    else if (options.synthetic == "updates")
+    {
+        return makeUpdateTrace(1000, options.opCount, 64 * 1024, 1);
+    }
+    throw std::runtime_error("Unknown synthetic trace \"" + options.synthetic + "\"!");
+}
+
+/// @brief Replay trace against backend with ids offset by idOffset. Samples the peak allocated size if peakAllocated is not nullptr.
+void replay(Backend &backend, const Trace &trace, uint32_t idOffset, Latencies &latencies, uint64_t *peakAllocated)
+{
+    latencies.allocate.reserve(trace.size());
+    latencies.update.reserve(trace.size());
+    latencies.free.reserve(trace.size());
+    // ids whose allocation failed are skipped until they are allocated again
+    std::vector<bool> live(traceIdCount(trace), false);
+    uint32_t opIndex = 0;
+    // replays can run on threads of their own, so errors are passed to the caller instead of terminating
+    try
+    {
+        for (const auto & op : trace)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            std::vector<uint32_t> *opLatencies = nullptr;
+            switch (op.type)
+            {
+                case TraceOp::Type::eAllocate:
+                    live[op.id] = backend.allocate(idOffset + op.id, op.size, op.alignment);
+                    latencies.failedAllocations += live[op.id] ? 0 : 1;
+                    opLatencies = &latencies.allocate;
+                    break;
+                case TraceOp::Type::eUpdate:
+                    if (live[op.id])
+                    {
+                        backend.update(idOffset + op.id, op.size);
+                        opLatencies = &latencies.update;
+                    }
+                    break;
+                case TraceOp::Type::eFree:
+                    if (live[op.id])
+                    {
+                        backend.free(idOffset + op.id);
+                        live[op.id] = false;
+                        opLatencies = &latencies.free;
+                    }
+                    break;
+            }
+            const auto duration = std::chrono::steady_clock::now() - start;
+            if (opLatencies)
+            {
+                opLatencies->push_back(static_cast<uint32_t>(std::min<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), UINT32_MAX)));
+            }
+            // sampling is not timed. sample often enough to catch peaks of frame traces
+            if (peakAllocated && (++opIndex % 256) == 0)
+            {
+                *peakAllocated = std::max(*peakAllocated, backend.stats().allocatedSize);
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        latencies.error = e.what();
+    }
+}
+
+void printLatencies(const char *name, std::vector<uint32_t> &latencies)
+{
+    if (latencies.empty())
+    {
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) { return latencies[static_cast<size_t>(p * (latencies.size() - 1))]; };
+    uint64_t sum = 0;
+    for (auto l : latencies)
+    {
+        sum += l;
+    }
+    std::cout << std::left << std::setw(10) << name << std::right
+              << std::setw(10) << latencies.size()
+              << std::setw(10) << sum / latencies.size()
+              << std::setw(10) << percentile(0.5)
+              << std::setw(10) << percentile(0.9)
+              << std::setw(10) << percentile(0.99)
+              << std::setw(12) << latencies.back() << std::endl;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    Trace trace;
+    std::unique_ptr<PoolBackend> backend;
+    std::unique_ptr<TraceRecorder> recorder;
+    try
+    {
+        options = parseOptions(argc, argv);
+        if (!isMode(options.synthetic))
+        {
+            trace = makeTrace(options);
+        }
+#ifdef VSVR_BENCH_STUB
+        // the stub device replaces the Vulkan entry points, so this executable can not use a real device
+        backend = createStubBackend(options.strategy, options.pageSize, options.hostVisible);
+#else
+        backend = createDeviceBackend(options.deviceName, options.strategy, options.pageSize, options.hostVisible);
+#endif
+        if (isMode(options.synthetic))
+        {
+            return runMode(options.synthetic, *backend, options.opCount, options.threadCount) ? 0 : 1;
+        }
+        if (!options.recordFile.empty())
+        {
+            recorder.reset(new TraceRecorder(backend->pool()));
+        }
+        if (options.threadCount > 1 && !backend->threadSafe())
+        {
+            throw std::runtime_error("Backend " + backend->name() + " does not support multiple threads!");
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    // every thread replays the full trace on its own range of ids
+    const uint32_t idCount = traceIdCount(trace);
+    backend->prepare(idCount * options.threadCount);
+    std::vector<Latencies> latencies(options.threadCount);
+    uint64_t peakAllocated = 0;
+    const auto start = std::chrono::steady_clock::now();
+    if (options.threadCount == 1)
+    {
+        replay(*backend, trace, 0, latencies[0], &peakAllocated);
+    }
+    else
+    {
+        std::vector<std::thread> threads;
+        for (uint32_t i = 0; i < options.threadCount; i++)
+        {
+            // only the first thread samples the peak, stats() takes the pool locks
+            threads.emplace_back(replay, std::ref(*backend), std::cref(trace), i * idCount, std::ref(latencies[i]), i == 0 ? &peakAllocated : nullptr);
+        }
+        for (auto & thread : threads)
+        {
+            thread.join();
+        }
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (const auto & l : latencies)
+    {
+        if (!l.error.empty())
+        {
+            std::cerr << "Error: " << l.error << std::endl;
+            return 1;
+        }
+    }
+    if (recorder)
+    {
+        try
+        {
+            recorder->save(options.recordFile);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        recorder.reset();
+    }
+    const auto stats = backend->stats();
+    peakAllocated = std::max(peakAllocated, stats.allocatedSize);
+    // merge latencies of all threads
+    Latencies all;
+    for (auto & l : latencies)
+    {
+        all.allocate.insert(all.allocate.end(), l.allocate.begin(), l.allocate.end());
+        all.update.insert(all.update.end(), l.update.begin(), l.update.end());
+        all.free.insert(all.free.end(), l.free.begin(), l.free.end());
+        all.failedAllocations += l.failedAllocations;
+    }
+    const auto opCount = all.allocate.size() + all.update.size() + all.free.size();
+    std::cout << "Backend: " << backend->name() << std::endl;
+    std::cout << "Trace: " << (options.traceFile.empty() ? options.synthetic : options.traceFile) << ", " << trace.size() << " ops, " << idCount << " ids, " << options.threadCount << " thread(s)" << std::endl;
+    std::cout << std::left << std::setw(10) << "op [ns]" << std::right << std::setw(10) << "count" << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(12) << "max" << std::endl;
+    printLatencies("allocate", all.allocate);
+    printLatencies("update", all.update);
+    printLatencies("free", all.free);
+    if (all.failedAllocations > 0)
+    {
+        std::cout << "Failed allocations: " << all.failedAllocations << " (ids skipped until allocated again)" << std::endl;
+    }
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Total: " << seconds << " s, " << std::setprecision(0) << opCount / seconds << " ops/s" << std::endl;
+    std::cout << std::setprecision(2);
+    std::cout << "Peak allocated: " << peakAllocated / (1024.0 * 1024.0) << " MiB" << std::endl;
+    std::cout << "Final allocated: " << stats.allocatedSize / (1024.0 * 1024.0) << " MiB, used " << stats.usedSize / (1024.0 * 1024.0) << " MiB in " << stats.pageCount << " page(s)" << std::endl;
+    // fragmentation is how much of the free memory is not in the largest free block
+    const uint64_t freeSize = stats.allocatedSize - stats.usedSize;
+    const double fragmentation = freeSize > 0 ? 1.0 - static_cast<double>(stats.largestFreeBlock) / freeSize : 0.0;
+    std::cout << "Fragmentation: " << fragmentation * 100.0 << " % (" << stats.freeBlockCount << " free blocks)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "backend.h"
+
+#include "../vkdevice.h"
+#include "../vkutils.h"
+#include <sstream>
+#include <stdexcept>
+
+namespace vsvr
+{
+namespace bench
+{
+
+class DeviceBackend: public PoolBackend
+{
+public:
+    DeviceBackend(const std::string &deviceName, AllocationStrategy strategy, uint64_t pageSize, bool hostVisible)
+        : m_hostVisible(hostVisible)
+    {
+        // no window and surface needed. this works with headless drivers like lavapipe too
+        vk::ApplicationInfo appInfo = {};
+        appInfo.pApplicationName = "vsvr_bench";
+        appInfo.applicationVersion = VK_MAKE_VERSION(0, 1, 0);
+        appInfo.pEngineName = "None";
+        appInfo.engineVersion = VK_MAKE_VERSION(0, 3, 0);
+        appInfo.apiVersion = VK_API_VERSION_1_1;
+        vk::InstanceCreateInfo instanceInfo;
+        instanceInfo.pApplicationInfo = &appInfo;
+        m_instance = vk::createInstance(instanceInfo);
+        for (auto physicalDevice : m_instance.enumeratePhysicalDevices())
+        {
+            const std::string name = DeviceInfoCache::getProperties(physicalDevice).deviceName;
+            if (name.find(deviceName) != std::string::npos)
+            {
+                m_physicalDevice = physicalDevice;
+                m_deviceName = name;
+                break;
+            }
+        }
+        if (!m_physicalDevice)
+        {
+            m_instance.destroy();
+            throw std::runtime_error("No Vulkan device matching \"" + deviceName + "\" found!");
+        }
+        // any queue can transfer. we only need one for staging uploads
+        auto queueFamilies = m_physicalDevice.getQueueFamilyProperties();
+        uint32_t queueFamily = 0;
+        while (queueFamily < queueFamilies.size() && !(queueFamilies[queueFamily].queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eTransfer)))
+        {
+            queueFamily++;
+        }
+        const float queuePriority = 1.0f;
+        vk::DeviceQueueCreateInfo queueInfo;
+        queueInfo.queueFamilyIndex = queueFamily;
+        queueInfo.queueCount = 1;
+        queueInfo.pQueuePriorities = &queuePriority;
+        std::vector<const char *> extensions;
+        if (isDeviceExtensionSupported(m_physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+        {
+            extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+        vk::DeviceCreateInfo deviceInfo;
+        deviceInfo.queueCreateInfoCount = 1;
+        deviceInfo.pQueueCreateInfos = &queueInfo;
+        deviceInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        deviceInfo.ppEnabledExtensionNames = extensions.data();
+        m_logicalDevice = m_physicalDevice.createDevice(deviceInfo);
+        createPool(m_physicalDevice, m_logicalDevice, m_logicalDevice.getQueue(queueFamily, 0), queueFamily, strategy, pageSize, hostVisible);
+    }
+
+    ~DeviceBackend()
+    {
+        destroyPool();
+        m_logicalDevice.destroy();
+        m_instance.destroy();
+    }
+
+    std::string name() const override
+    {
+        std::ostringstream name;
+        name << "device (" << m_deviceName << ", " << (m_hostVisible ? "host-visible" : "device-local") << ")";
+        return name.str();
+    }
+
+private:
+    bool m_hostVisible = true;
+    vk::Instance m_instance = nullptr;
+    vk::PhysicalDevice m_physicalDevice = nullptr;
+    vk::Device m_logicalDevice = nullptr;
+    std::string m_deviceName;
+};
+
+std::unique_ptr<PoolBackend> createDeviceBackend(const std::string &deviceName, AllocationStrategy strategy, uint64_t pageSize, bool hostVisible)
+{
+    return std::unique_ptr<PoolBackend>(new DeviceBackend(deviceName, strategy, pageSize, hostVisible));
+}
+
+}
+}
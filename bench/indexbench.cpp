@@ -0,0 +1,109 @@
+#include "../vkindexopt.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace vsvr;
+
+namespace
+{
+
+/// @brief Get average distance between indices of consecutively fetched new vertices. Lower means better vertex fetch locality.
+double averageFetchDistance(const std::vector<uint32_t> &indices, uint32_t vertexCount)
+{
+    std::vector<bool> fetched(vertexCount, false);
+    uint64_t distance = 0;
+    uint32_t fetchCount = 0;
+    int64_t last = 0;
+    for (auto index : indices)
+    {
+        if (!fetched[index])
+        {
+            fetched[index] = true;
+            distance += std::abs(static_cast<int64_t>(index) - last);
+            last = index;
+            fetchCount++;
+        }
+    }
+    return fetchCount > 0 ? static_cast<double>(distance) / fetchCount : 0.0;
+}
+
+void printStats(const char *name, const std::vector<uint32_t> &indices, uint32_t vertexCount)
+{
+    std::cout << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(3);
+    for (uint32_t cacheSize : {16, 32})
+    {
+        const auto stats = analyzeVertexCache(indices, vertexCount, cacheSize);
+        std::cout << std::setw(10) << stats.acmr << std::setw(10) << stats.atvr;
+    }
+    std::cout << std::setw(14) << std::setprecision(1) << averageFetchDistance(indices, vertexCount) << std::endl;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const uint32_t gridSize = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 256;
+    if (gridSize < 2)
+    {
+        std::cout << "Usage: vsvr_index_bench [GRIDSIZE]" << std::endl;
+        std::cout << "Measures vertex cache and fetch efficiency of a GRIDSIZE x GRIDSIZE vertex grid mesh before and after index optimization." << std::endl;
+        return 1;
+    }
+    // grid mesh in scanline order, which is what simple generators produce
+    const uint32_t vertexCount = gridSize * gridSize;
+    std::vector<uint32_t> scanline;
+    for (uint32_t y = 0; y < gridSize - 1; y++)
+    {
+        for (uint32_t x = 0; x < gridSize - 1; x++)
+        {
+            const uint32_t i = y * gridSize + x;
+            scanline.insert(scanline.end(), {i, i + gridSize, i + 1, i + 1, i + gridSize, i + gridSize + 1});
+        }
+    }
+    // shuffled triangles and vertices, like meshes from exporters that do not care about order
+    std::mt19937 rng(1);
+    std::vector<uint32_t> vertexShuffle(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+        vertexShuffle[v] = v;
+    }
+    std::shuffle(vertexShuffle.begin(), vertexShuffle.end(), rng);
+    std::vector<uint32_t> triangleOrder(scanline.size() / 3);
+    for (uint32_t t = 0; t < triangleOrder.size(); t++)
+    {
+        triangleOrder[t] = t;
+    }
+    std::shuffle(triangleOrder.begin(), triangleOrder.end(), rng);
+    std::vector<uint32_t> shuffled;
+    for (auto t : triangleOrder)
+    {
+        shuffled.insert(shuffled.end(), {vertexShuffle[scanline[t * 3]], vertexShuffle[scanline[t * 3 + 1]], vertexShuffle[scanline[t * 3 + 2]]});
+    }
+    std::vector<uint32_t> optimized = shuffled;
+    const auto start = std::chrono::steady_clock::now();
+    optimizeVertexCache(optimized, vertexCount);
+    const auto cacheTime = std::chrono::steady_clock::now();
+    optimizeVertexFetch(optimized, vertexCount);
+    const auto fetchTime = std::chrono::steady_clock::now();
+    std::cout << "Grid " << gridSize << " x " << gridSize << ": " << vertexCount << " vertices, " << scanline.size() / 3 << " triangles" << std::endl;
+    std::cout << std::left << std::setw(24) << "order" << std::right << std::setw(10) << "ACMR 16" << std::setw(10) << "ATVR 16" << std::setw(10) << "ACMR 32" << std::setw(10) << "ATVR 32" << std::setw(14) << "fetch dist" << std::endl;
+    printStats("scanline", scanline, vertexCount);
+    printStats("shuffled", shuffled, vertexCount);
+    printStats("optimized", optimized, vertexCount);
+    std::cout << std::setprecision(2);
+    std::cout << "Vertex cache optimization: " << std::chrono::duration<double, std::milli>(cacheTime - start).count() << " ms, vertex fetch optimization: " << std::chrono::duration<double, std::milli>(fetchTime - cacheTime).count() << " ms" << std::endl;
+    const bool narrow = canNarrowIndices(vertexCount);
+    std::cout << "Index data: " << shuffled.size() * 4 / 1024 << " KiB 32-bit" << (narrow ? ", " + std::to_string(shuffled.size() * 2 / 1024) + " KiB narrowed to 16-bit" : ", can not be narrowed to 16-bit") << std::endl;
+    // vertex shading work is proportional to ACMR. the ratio is the expected speedup of vertex-bound draws
+    const auto before = analyzeVertexCache(shuffled, vertexCount, 32);
+    const auto after = analyzeVertexCache(optimized, vertexCount, 32);
+    std::cout << "Vertex shader invocations: " << before.transformedCount << " -> " << after.transformedCount << " (" << static_cast<double>(before.transformedCount) / after.transformedCount << "x fewer)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include "listallocator.h"
+
+#include <algorithm>
+
+namespace vsvr
+{
+namespace bench
+{
+
+ListWalkAllocator::ListWalkAllocator(vk::DeviceSize size)
+    : m_size(size)
+{
+    if (size > 0)
+    {
+        // add free block that spans the whole range
+        m_blocks.push_back({0, size, true});
+    }
+}
+
+ListWalkAllocator::Allocation ListWalkAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+{
+    Allocation allocation;
+    for (auto block = m_blocks.begin(); block != m_blocks.end(); ++block)
+    {
+        if (!block->isFree)
+        {
+            continue;
+        }
+        // the usable size of the block shrinks if we need to shift the offset for the alignment
+        const auto alignmentDiff = alignment > 1 ? block->offset % alignment : 0;
+        const auto offsetShift = alignmentDiff > 0 ? alignment - alignmentDiff : 0;
+        if (block->size < offsetShift || block->size - offsetShift < size)
+        {
+            continue;
+        }
+        if (offsetShift > 0)
+        {
+            // keep the padding as a free block, so the previous block can use it when it is freed
+            m_blocks.insert(block, {block->offset, offsetShift, true});
+            block->offset += offsetShift;
+            block->size -= offsetShift;
+        }
+        auto newBlock = m_blocks.insert(block, {block->offset, size, false});
+        block->offset += size;
+        block->size -= size;
+        if (block->size == 0)
+        {
+            m_blocks.erase(block);
+        }
+        if (m_unusedIndices.empty())
+        {
+            allocation.block = static_cast<uint32_t>(m_used.size());
+            m_used.push_back(newBlock);
+        }
+        else
+        {
+            allocation.block = m_unusedIndices.back();
+            m_unusedIndices.pop_back();
+            m_used[allocation.block] = newBlock;
+        }
+        allocation.offset = newBlock->offset;
+        allocation.size = size;
+        m_usedSize += size;
+        return allocation;
+    }
+    return allocation;
+}
+
+void ListWalkAllocator::free(uint32_t block)
+{
+    if (block >= m_used.size() || m_used[block] == m_blocks.end())
+    {
+        return;
+    }
+    auto it = m_used[block];
+    m_used[block] = m_blocks.end();
+    m_unusedIndices.push_back(block);
+    m_usedSize -= it->size;
+    it->isFree = true;
+    // coalesce with free neighbours
+    auto next = std::next(it);
+    if (next != m_blocks.end() && next->isFree)
+    {
+        it->size += next->size;
+        m_blocks.erase(next);
+    }
+    if (it != m_blocks.begin())
+    {
+        auto prev = std::prev(it);
+        if (prev->isFree)
+        {
+            prev->size += it->size;
+            m_blocks.erase(it);
+        }
+    }
+}
+
+vk::DeviceSize ListWalkAllocator::size() const
+{
+    return m_size;
+}
+
+vk::DeviceSize ListWalkAllocator::usedSize() const
+{
+    return m_usedSize;
+}
+
+bool ListWalkAllocator::empty() const
+{
+    return m_usedSize == 0;
+}
+
+uint32_t ListWalkAllocator::freeBlockCount() const
+{
+    return static_cast<uint32_t>(std::count_if(m_blocks.cbegin(), m_blocks.cend(), [](const BlockInfo & b){ return b.isFree; }));
+}
+
+vk::DeviceSize ListWalkAllocator::largestFreeBlock() const
+{
+    vk::DeviceSize largest = 0;
+    for (const auto & block : m_blocks)
+    {
+        if (block.isFree)
+        {
+            largest = std::max(largest, block.size);
+        }
+    }
+    return largest;
+}
+
+}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "../vkallocator.h"
+#include <list>
+#include <vector>
+
+namespace vsvr
+{
+namespace bench
+{
+
+/// @brief First-fit allocator walking a list of all blocks, like MemoryPool did before it used TlsfAllocator.
+/// Blocks are kept in a std::list in memory order. Allocating walks the list from the front until it finds a free block
+/// big enough including the alignment, so it is O(n) in the number of blocks. Freeing merges with free neighbours.
+/// Only used as a baseline for the "listwalk" benchmark.
+class ListWalkAllocator: public PageAllocator
+{
+public:
+    /// @brief Create allocator managing the range [0, size).
+    ListWalkAllocator(vk::DeviceSize size = 0);
+
+    Allocation allocate(vk::DeviceSize size, vk::DeviceSize alignment) override;
+    void free(uint32_t block) override;
+    vk::DeviceSize size() const override;
+    vk::DeviceSize usedSize() const override;
+    bool empty() const override;
+    uint32_t freeBlockCount() const override;
+    vk::DeviceSize largestFreeBlock() const override;
+
+private:
+    struct BlockInfo
+    {
+        vk::DeviceSize offset = 0;
+        vk::DeviceSize size = 0;
+        bool isFree = true;
+    };
+
+    vk::DeviceSize m_size = 0;
+    vk::DeviceSize m_usedSize = 0;
+    std::list<BlockInfo> m_blocks;                          // All blocks in memory order.
+    std::vector<std::list<BlockInfo>::iterator> m_used;      // Allocated blocks by block index.
+    std::vector<uint32_t> m_unusedIndices;                  // Block indices for reuse.
+};
+
+}
+}
@@ -0,0 +1,635 @@
+#include "modes.h"
+
+#include "listallocator.h"
+#include "trace.h"
+#include "../vkutils.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace vsvr
+{
+namespace bench
+{
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+double nanosecondsPer(Clock::time_point start, uint64_t count)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / std::max<uint64_t>(count, 1);
+}
+
+/// @brief Fill allocator with liveCount blocks, then time pairCount pairs of freeing a random block and allocating a new one.
+/// The same seed gives the same sizes and order for every allocator.
+double measureAllocator(PageAllocator &allocator, uint32_t liveCount, uint32_t pairCount, uint32_t seed)
+{
+    std::mt19937 generator(seed);
+    // no holes, like pages that have filled up over time
+    std::vector<uint32_t> live(liveCount);
+    for (auto & block : live)
+    {
+        block = allocator.allocate(randomSize(generator, 256, 16 * 1024), 256).block;
+    }
+    // draw before timing, so only the allocator is measured
+    std::vector<uint32_t> indices(pairCount);
+    std::vector<uint64_t> sizes(pairCount);
+    for (uint32_t i = 0; i < pairCount; i++)
+    {
+        indices[i] = std::uniform_int_distribution<uint32_t>(0, liveCount - 1)(generator);
+        sizes[i] = randomSize(generator, 256, 16 * 1024);
+    }
+    const auto start = Clock::now();
+    for (uint32_t i = 0; i < pairCount; i++)
+    {
+        auto &block = live[indices[i]];
+        allocator.free(block);
+        block = allocator.allocate(sizes[i], 256).block;
+    }
+    return nanosecondsPer(start, pairCount);
+}
+
+bool runListWalk(PoolBackend & /*backend*/, uint32_t opCount, uint32_t /*threadCount*/)
+{
+    // big enough for 100k blocks of the maximum size, so no allocation fails
+    const vk::DeviceSize rangeSize = 4ull * 1024 * 1024 * 1024;
+    const uint32_t pairCount = std::max(1u, std::min(opCount / 10, 10000u));
+    std::cout << "Free + allocate pairs with N live blocks of 256 B - 16 KiB, " << pairCount << " pairs per run" << std::endl;
+    std::cout << std::setw(12) << "live blocks" << std::setw(18) << "list walk [ns]" << std::setw(12) << "tlsf [ns]" << std::setw(10) << "speedup" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    for (uint32_t liveCount : {1000u, 10000u, 100000u})
+    {
+        ListWalkAllocator listWalk(rangeSize);
+        TlsfAllocator tlsf(rangeSize);
+        const double listWalkTime = measureAllocator(listWalk, liveCount, pairCount, 1);
+        const double tlsfTime = measureAllocator(tlsf, liveCount, pairCount, 1);
+        std::cout << std::setw(12) << liveCount << std::setw(18) << listWalkTime << std::setw(12) << tlsfTime << std::setw(9) << listWalkTime / tlsfTime << "x" << std::endl;
+    }
+    return true;
+}
+
+/// @brief Get settings of backend with host-visible, coherent memory.
+Buffer::Settings hostVisibleSettings(const PoolBackend &backend)
+{
+    auto settings = backend.settings();
+    settings.properties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    return settings;
+}
+
+/// @brief Find index of first memory type with properties.
+/// @throw Throws if the device has no such memory type.
+uint32_t findMemoryType(vk::PhysicalDevice physicalDevice, vk::MemoryPropertyFlags properties)
+{
+    const auto &memProperties = DeviceInfoCache::getMemoryProperties(physicalDevice);
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+    {
+        if ((memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return i;
+        }
+    }
+    throw std::runtime_error("No memory type with the requested properties!");
+}
+
+bool runMapping(PoolBackend &backend, uint32_t opCount, uint32_t /*threadCount*/)
+{
+    // small buffers updated round-robin, like per-object uniform data
+    const uint32_t bufferCount = 1000;
+    const uint32_t updateCount = std::max(bufferCount, opCount);
+    std::mt19937 generator(1);
+    std::vector<vk::DeviceSize> sizes(bufferCount);
+    std::vector<vk::DeviceSize> offsets(bufferCount);
+    vk::DeviceSize totalSize = 0;
+    for (uint32_t i = 0; i < bufferCount; i++)
+    {
+        sizes[i] = randomSize(generator, 256, 4096);
+        offsets[i] = totalSize;
+        totalSize += (sizes[i] + 255) & ~vk::DeviceSize(255);
+    }
+    const std::vector<uint8_t> data(4096, 0x5a);
+    // before: map and unmap the whole page memory for every update, like MemoryPool did before pages were kept mapped
+    auto logicalDevice = backend.logicalDevice();
+    const auto settings = hostVisibleSettings(backend);
+    auto memory = logicalDevice.allocateMemory(vk::MemoryAllocateInfo(totalSize, findMemoryType(backend.physicalDevice(), settings.properties)));
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < updateCount; i++)
+    {
+        const auto index = i % bufferCount;
+        auto mapped = static_cast<uint8_t *>(logicalDevice.mapMemory(memory, 0, VK_WHOLE_SIZE));
+        std::memcpy(mapped + offsets[index], data.data(), sizes[index]);
+        logicalDevice.unmapMemory(memory);
+    }
+    const double mapTime = nanosecondsPer(start, updateCount);
+    logicalDevice.freeMemory(memory);
+    // after: pages stay mapped, so updateBuffer() is a lookup and a memcpy
+    auto pool = backend.pool();
+    std::vector<Buffer::Ptr> buffers(bufferCount);
+    for (uint32_t i = 0; i < bufferCount; i++)
+    {
+        buffers[i] = pool->createBuffer(sizes[i], settings);
+        if (!buffers[i]->data())
+        {
+            throw std::runtime_error("Host-visible buffer has no data pointer!");
+        }
+    }
+    start = Clock::now();
+    for (uint32_t i = 0; i < updateCount; i++)
+    {
+        const auto index = i % bufferCount;
+        pool->updateBuffer(buffers[index]->handle(), RawData(data.data(), sizes[index]));
+    }
+    const double updateTime = nanosecondsPer(start, updateCount);
+    // writing through Buffer::data() skips the pool completely
+    start = Clock::now();
+    for (uint32_t i = 0; i < updateCount; i++)
+    {
+        const auto index = i % bufferCount;
+        std::memcpy(buffers[index]->data(), data.data(), sizes[index]);
+    }
+    const double dataTime = nanosecondsPer(start, updateCount);
+    pool->destroyBuffers(buffers);
+    std::cout << updateCount << " updates of " << bufferCount << " host-visible buffers of 256 B - 4 KiB" << std::endl;
+    std::cout << std::fixed << std::setprecision(0);
+    std::cout << "Map / unmap per update:   " << std::setw(12) << 1e9 / mapTime << " updates/s" << std::endl;
+    std::cout << "Persistent, updateBuffer: " << std::setw(12) << 1e9 / updateTime << " updates/s" << std::endl;
+    std::cout << "Persistent, Buffer::data: " << std::setw(12) << 1e9 / dataTime << " updates/s" << std::endl;
+    std::cout << std::setprecision(1) << "Speedup of updateBuffer: " << mapTime / updateTime << "x" << std::endl;
+    return true;
+}
+
+bool runStaged(PoolBackend &backend, uint32_t opCount, uint32_t /*threadCount*/)
+{
+    // a scene of vertex attribute streams in device-local memory, so every update goes through the staging ring
+    const uint32_t bufferCount = 2000;
+    const uint32_t roundCount = std::max(1u, std::min(opCount / bufferCount, 10u));
+    auto settings = backend.settings();
+    settings.properties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+    std::mt19937 generator(1);
+    auto pool = backend.pool();
+    std::vector<Buffer::Ptr> buffers(bufferCount);
+    std::vector<std::vector<uint8_t>> contents(bufferCount);
+    std::vector<RawData> data;
+    uint64_t roundSize = 0;
+    for (uint32_t i = 0; i < bufferCount; i++)
+    {
+        contents[i].resize(randomSize(generator, 1024, 64 * 1024), static_cast<uint8_t>(i));
+        buffers[i] = pool->createBuffer(contents[i].size(), settings);
+        data.push_back(RawData(contents[i]));
+        roundSize += contents[i].size();
+    }
+    // before: one submission per buffer
+    auto start = Clock::now();
+    for (uint32_t round = 0; round < roundCount; round++)
+    {
+        for (uint32_t i = 0; i < bufferCount; i++)
+        {
+            pool->updateBuffer(buffers[i]->handle(), data[i]);
+        }
+        pool->waitForUpload(pool->lastUploadId());
+    }
+    const double singleTime = nanosecondsPer(start, roundCount);
+    // after: one staging allocation and submission per batch
+    start = Clock::now();
+    for (uint32_t round = 0; round < roundCount; round++)
+    {
+        pool->updateBuffers(buffers, data);
+        pool->waitForUpload(pool->lastUploadId());
+    }
+    const double batchTime = nanosecondsPer(start, roundCount);
+    pool->destroyBuffers(buffers);
+    const double roundMiB = static_cast<double>(roundSize) / (1024 * 1024);
+    std::cout << roundCount << " uploads of " << bufferCount << " device-local buffers of 1 - 64 KiB, " << std::fixed << std::setprecision(1) << roundMiB << " MiB each" << std::endl;
+    std::cout << "updateBuffer per buffer: " << std::setw(10) << roundMiB * 1e9 / singleTime << " MB/s" << std::endl;
+    std::cout << "updateBuffers batched:   " << std::setw(10) << roundMiB * 1e9 / batchTime << " MB/s" << std::endl;
+    std::cout << "Speedup: " << singleTime / batchTime << "x" << std::endl;
+    return true;
+}
+
+/// @brief Get the maximum number of threads for modes. Defaults to 16 if --threads is not passed.
+uint32_t maxThreadCount(uint32_t threadCount)
+{
+    return threadCount > 1 ? threadCount : 16;
+}
+
+/// @brief Get sum of used bytes over all memory types of pool.
+uint64_t poolUsedSize(const MemoryPool::Ptr &pool)
+{
+    uint64_t usedSize = 0;
+    for (const auto & type : pool->statistics().memoryTypes)
+    {
+        usedSize += type.usedSize;
+    }
+    return usedSize;
+}
+
+/// @brief Errors found by threads. Prints the first few, so the output stays readable.
+class ErrorLog
+{
+public:
+    void add(const std::string &message)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_count < 10)
+        {
+            std::cerr << "Error: " << message << std::endl;
+        }
+        m_count++;
+    }
+
+    uint32_t count()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_count;
+    }
+
+private:
+    std::mutex m_mutex;
+    uint32_t m_count = 0;
+};
+
+/// @brief Allocate, update and free random buffers with ids in [firstId, firstId + idCount).
+void runWorkload(Backend &backend, uint32_t firstId, uint32_t idCount, uint32_t opCount, uint32_t seed, ErrorLog &errors)
+{
+    std::mt19937 generator(seed);
+    std::vector<bool> live(idCount, false);
+    try
+    {
+        for (uint32_t i = 0; i < opCount; i++)
+        {
+            const auto index = std::uniform_int_distribution<uint32_t>(0, idCount - 1)(generator);
+            if (!live[index])
+            {
+                live[index] = backend.allocate(firstId + index, randomSize(generator, 256, 64 * 1024), 256);
+            }
+            else if (generator() % 4 != 0)
+            {
+                backend.update(firstId + index, randomSize(generator, 256, 64 * 1024));
+            }
+            else
+            {
+                backend.free(firstId + index);
+                live[index] = false;
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        errors.add(e.what());
+    }
+    for (uint32_t index = 0; index < idCount; index++)
+    {
+        if (live[index])
+        {
+            backend.free(firstId + index);
+        }
+    }
+}
+
+bool runScaling(PoolBackend &backend, uint32_t opCount, uint32_t threadCount)
+{
+    const uint32_t maxThreads = maxThreadCount(threadCount);
+    const uint32_t idsPerThread = 64;
+    // the same work per thread, so ops/s grows with the thread count as long as threads do not serialize on locks
+    const uint32_t opsPerThread = std::max(1000u, opCount / 16);
+    backend.prepare(maxThreads * idsPerThread);
+    ErrorLog errors;
+    std::cout << opsPerThread << " allocate / update / free ops per thread of 256 B - 64 KiB on disjoint buffers" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "ops/s" << std::setw(10) << "scaling" << std::endl;
+    std::cout << std::fixed;
+    double singleRate = 0;
+    for (uint32_t threads = 1; threads <= maxThreads; threads = threads < maxThreads ? std::min(threads * 2, maxThreads) : maxThreads + 1)
+    {
+        std::vector<std::thread> workers;
+        const auto start = Clock::now();
+        for (uint32_t i = 0; i < threads; i++)
+        {
+            workers.emplace_back(runWorkload, std::ref(backend), i * idsPerThread, idsPerThread, opsPerThread, i + 1, std::ref(errors));
+        }
+        for (auto & worker : workers)
+        {
+            worker.join();
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        const double rate = threads * opsPerThread / seconds;
+        singleRate = threads == 1 ? rate : singleRate;
+        std::cout << std::setw(8) << threads << std::setw(14) << std::setprecision(0) << rate << std::setw(9) << std::setprecision(2) << rate / singleRate << "x" << std::endl;
+    }
+    return errors.count() == 0;
+}
+
+/// @brief Create, update, grow and destroy host-visible buffers and check their contents after every operation.
+/// Also updates a device-local buffer now and then, so uploads are staged while other threads allocate.
+void runStressThread(const MemoryPool::Ptr &pool, const Buffer::Settings &hostSettings, const Buffer::Settings &deviceSettings, uint32_t opCount, uint32_t seed, ErrorLog &errors)
+{
+    const uint32_t slotCount = 16;
+    std::mt19937 generator(seed);
+    std::vector<Buffer::Ptr> buffers(slotCount);
+    std::vector<uint8_t> patterns(slotCount);
+    std::vector<vk::DeviceSize> sizes(slotCount); // Number of bytes written with the pattern.
+    std::vector<uint8_t> scratch(64 * 1024);
+    Buffer::Ptr deviceBuffer;
+    auto write = [&](uint32_t slot, vk::DeviceSize size, uint8_t pattern)
+    {
+        std::fill_n(scratch.begin(), size, pattern);
+        pool->updateBuffer(buffers[slot]->handle(), RawData(scratch.data(), size));
+        sizes[slot] = size;
+        patterns[slot] = pattern;
+    };
+    try
+    {
+        deviceBuffer = pool->createBuffer(16 * 1024, deviceSettings);
+        for (uint32_t i = 0; i < opCount; i++)
+        {
+            const auto slot = generator() % slotCount;
+            const auto pattern = static_cast<uint8_t>(generator());
+            const auto action = generator() % 10;
+            auto &buffer = buffers[slot];
+            if (!buffer)
+            {
+                const auto size = randomSize(generator, 256, 16 * 1024);
+                buffer = pool->createBuffer(size, hostSettings);
+                write(slot, size, pattern);
+            }
+            else if (action < 5)
+            {
+                write(slot, sizes[slot], pattern);
+            }
+            else if (action < 7)
+            {
+                // bigger than the buffer, so it is reallocated
+                write(slot, std::min<vk::DeviceSize>(scratch.size(), buffer->size() + randomSize(generator, 256, 16 * 1024)), pattern);
+            }
+            else if (action < 8)
+            {
+                // write the pattern in two ranges
+                const auto half = sizes[slot] / 2;
+                std::fill_n(scratch.begin(), sizes[slot], pattern);
+                pool->updateRange(buffer->handle(), 0, RawData(scratch.data(), half));
+                pool->updateRange(buffer->handle(), half, RawData(scratch.data() + half, sizes[slot] - half));
+                patterns[slot] = pattern;
+            }
+            else
+            {
+                // the slot of the buffer might be reused by another thread right away, but its handle must stay stale
+                const auto handle = buffer->handle();
+                pool->destroyBuffer(handle);
+                buffer = nullptr;
+                bool threw = false;
+                try
+                {
+                    pool->updateBuffer(handle, RawData(scratch.data(), 1));
+                }
+                catch (const std::runtime_error &)
+                {
+                    threw = true;
+                }
+                if (!threw)
+                {
+                    errors.add("Updating a destroyed buffer did not throw!");
+                }
+                continue;
+            }
+            auto data = static_cast<const uint8_t *>(buffer->data());
+            if (std::find_if(data, data + sizes[slot], [&](uint8_t b){ return b != patterns[slot]; }) != data + sizes[slot])
+            {
+                errors.add("Buffer content does not match what was written!");
+            }
+            if (i % 8 == 0)
+            {
+                pool->updateBuffer(deviceBuffer->handle(), RawData(scratch.data(), randomSize(generator, 256, 32 * 1024)));
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        errors.add(e.what());
+    }
+    for (const auto & buffer : buffers)
+    {
+        pool->destroyBuffer(buffer);
+    }
+    pool->destroyBuffer(deviceBuffer);
+}
+
+bool runStress(PoolBackend &backend, uint32_t opCount, uint32_t threadCount)
+{
+    const uint32_t threads = maxThreadCount(threadCount);
+    const uint32_t opsPerThread = std::max(1000u, opCount / threads);
+    auto pool = backend.pool();
+    auto hostSettings = hostVisibleSettings(backend);
+    auto deviceSettings = backend.settings();
+    deviceSettings.properties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+    const auto usedSizeBefore = poolUsedSize(pool);
+    ErrorLog errors;
+    std::vector<std::thread> workers;
+    for (uint32_t i = 0; i < threads; i++)
+    {
+        workers.emplace_back(runStressThread, std::cref(pool), std::cref(hostSettings), std::cref(deviceSettings), opsPerThread, i + 1, std::ref(errors));
+    }
+    for (auto & worker : workers)
+    {
+        worker.join();
+    }
+    // blocks of destroyed buffers are released when their uploads have finished
+    pool->waitForUpload(pool->lastUploadId());
+    pool->nextFrame();
+    const auto usedSizeAfter = poolUsedSize(pool);
+    if (usedSizeAfter != usedSizeBefore)
+    {
+        errors.add("Used size is " + std::to_string(usedSizeAfter) + " bytes after destroying all buffers, but was " + std::to_string(usedSizeBefore) + " bytes before!");
+    }
+    const auto errorCount = errors.count();
+    std::cout << threads << " threads with " << opsPerThread << " create / update / grow / destroy ops each: " << errorCount << " error(s)" << std::endl;
+    return errorCount == 0;
+}
+
+bool runHandles(PoolBackend &backend, uint32_t opCount, uint32_t /*threadCount*/)
+{
+    // small host-visible buffers, so the lookup and not the copy dominates
+    const uint32_t bufferCount = 100000;
+    const uint32_t updateCount = std::max(bufferCount, opCount);
+    const vk::DeviceSize bufferSize = 256;
+    auto pool = backend.pool();
+    const auto settings = hostVisibleSettings(backend);
+    std::vector<Buffer::Ptr> buffers(bufferCount);
+    // before: buffers were looked up in a std::map keyed by shared_ptr, like MemoryPool::m_buffers was
+    std::map<Buffer::Ptr, Buffer::Handle> bufferMap;
+    for (auto & buffer : buffers)
+    {
+        buffer = pool->createBuffer(bufferSize, settings);
+        bufferMap[buffer] = buffer->handle();
+    }
+    // random order, like updating the visible objects of a scene
+    std::mt19937 generator(1);
+    std::vector<uint32_t> order(updateCount);
+    for (auto & index : order)
+    {
+        index = std::uniform_int_distribution<uint32_t>(0, bufferCount - 1)(generator);
+    }
+    const std::vector<uint8_t> data(bufferSize, 0x5a);
+    auto start = Clock::now();
+    for (auto index : order)
+    {
+        // the copy is the refcount traffic of passing the buffer by value
+        const Buffer::Ptr buffer = buffers[index];
+        pool->updateBuffer(bufferMap.find(buffer)->second, RawData(data.data(), bufferSize));
+    }
+    const double mapTime = nanosecondsPer(start, updateCount);
+    start = Clock::now();
+    for (auto index : order)
+    {
+        pool->updateBuffer(buffers[index], RawData(data.data(), bufferSize));
+    }
+    const double pointerTime = nanosecondsPer(start, updateCount);
+    std::vector<Buffer::Handle> handles(bufferCount);
+    std::transform(buffers.cbegin(), buffers.cend(), handles.begin(), [](const Buffer::Ptr & b){ return b->handle(); });
+    start = Clock::now();
+    for (auto index : order)
+    {
+        pool->updateBuffer(handles[index], RawData(data.data(), bufferSize));
+    }
+    const double handleTime = nanosecondsPer(start, updateCount);
+    bufferMap.clear();
+    pool->destroyBuffers(buffers);
+    std::cout << updateCount << " updates of " << bufferSize << " bytes in random order to " << bufferCount << " host-visible buffers" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "std::map lookup + update:     " << std::setw(8) << mapTime << " ns/update" << std::endl;
+    std::cout << "updateBuffer(Buffer::Ptr):    " << std::setw(8) << pointerTime << " ns/update" << std::endl;
+    std::cout << "updateBuffer(Buffer::Handle): " << std::setw(8) << handleTime << " ns/update, " << mapTime / handleTime << "x faster than the map" << std::endl;
+    return true;
+}
+
+/// @brief Returns true if the first size bytes of buffer are all pattern.
+bool hasPattern(const Buffer::Ptr &buffer, vk::DeviceSize size, uint8_t pattern)
+{
+    auto data = static_cast<const uint8_t *>(buffer->data());
+    return std::find_if(data, data + size, [pattern](uint8_t b){ return b != pattern; }) == data + size;
+}
+
+bool runBudget(PoolBackend &backend, uint32_t /*opCount*/, uint32_t /*threadCount*/)
+{
+    auto pool = backend.pool();
+    const auto settings = hostVisibleSettings(backend);
+    const auto memoryTypeIndex = findMemoryType(backend.physicalDevice(), settings.properties);
+    const auto heapIndex = DeviceInfoCache::getMemoryProperties(backend.physicalDevice()).memoryTypes[memoryTypeIndex].heapIndex;
+    const auto pageSize = pool->pageSize(memoryTypeIndex);
+    const auto usedSizeBefore = poolUsedSize(pool);
+    ErrorLog errors;
+    const vk::DeviceSize size = 4096;
+    std::vector<uint8_t> data(2 * pageSize, 0x5a);
+    auto buffer = pool->createBuffer(size, settings);
+    pool->updateBuffer(buffer->handle(), RawData(data.data(), size));
+    // leave less than a page of budget, so growing the buffer beyond a page has to fail
+    const auto heap = pool->statistics().heaps[heapIndex];
+    pool->setBudgetLimit(static_cast<float>(static_cast<double>(heap.usage + pageSize / 2) / heap.budget));
+    bool threw = false;
+    try
+    {
+        pool->updateBuffer(buffer->handle(), RawData(data.data(), 2 * pageSize));
+    }
+    catch (const std::runtime_error &)
+    {
+        threw = true;
+    }
+    pool->setBudgetLimit(1.0f);
+    if (!threw)
+    {
+        errors.add("Growing a buffer beyond the budget did not throw!");
+    }
+    // the buffer must still be usable with its old memory
+    else if (buffer->size() != size || !hasPattern(buffer, size, 0x5a))
+    {
+        errors.add("Buffer changed when growing it failed!");
+    }
+    else
+    {
+        std::fill_n(data.begin(), size, 0xa5);
+        pool->updateBuffer(buffer->handle(), RawData(data.data(), size));
+        if (!hasPattern(buffer, size, 0xa5))
+        {
+            errors.add("Buffer content does not match what was written after growing it failed!");
+        }
+    }
+    pool->destroyBuffer(buffer);
+    pool->nextFrame();
+    const auto usedSizeAfter = poolUsedSize(pool);
+    if (usedSizeAfter != usedSizeBefore)
+    {
+        errors.add("Used size is " + std::to_string(usedSizeAfter) + " bytes after destroying the buffer, but was " + std::to_string(usedSizeBefore) + " bytes before!");
+    }
+    const auto errorCount = errors.count();
+    std::cout << "Growing a " << size << " byte buffer to " << 2 * pageSize << " bytes beyond the budget: " << errorCount << " error(s)" << std::endl;
+    return errorCount == 0;
+}
+
+struct Mode
+{
+    const char *name;
+    const char *description;
+    bool (*run)(PoolBackend &backend, uint32_t opCount, uint32_t threadCount);
+};
+
+const Mode Modes[] = {
+    {"listwalk", "Free + allocate cost of the old list walk vs TLSF at 1k, 10k and 100k live blocks", runListWalk},
+    {"mapping", "Updates/s of mapping memory per update vs persistently mapped pages", runMapping},
+    {"staged", "Upload MB/s of staging buffers one by one vs batched with updateBuffers()", runStaged},
+    {"scaling", "Allocate / update / free ops/s on 1 to 16 threads", runScaling},
+    {"stress", "Concurrent create / update / grow / destroy on 16 threads, verifying contents and stale handles", runStress},
+    {"handles", "Update loop over 100k buffers with std::map lookups vs generational handles", runHandles},
+    {"budget", "Grow a buffer beyond the memory budget and check the pool is still consistent", runBudget},
+};
+
+const Mode *findMode(const std::string &name)
+{
+    for (const auto & mode : Modes)
+    {
+        if (name == mode.name)
+        {
+            return &mode;
+        }
+    }
+    return nullptr;
+}
+
+}
+
+bool isMode(const std::string &name)
+{
+    return findMode(name) != nullptr;
+}
+
+std::string modeDescriptions()
+{
+    std::ostringstream descriptions;
+    for (const auto & mode : Modes)
+    {
+        descriptions << std::left << std::setw(12) << mode.name << mode.description << std::endl;
+    }
+    return descriptions.str();
+}
+
+bool runMode(const std::string &name, PoolBackend &backend, uint32_t opCount, uint32_t threadCount)
+{
+    auto mode = findMode(name);
+    if (!mode)
+    {
+        throw std::runtime_error("Unknown benchmark mode \"" + name + "\"!");
+    }
+    std::cout << "Backend: " << backend.name() << std::endl;
+    std::cout << "Mode: " << mode->name << std::endl;
+    return mode->run(backend, opCount, threadCount);
+}
+
+}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "backend.h"
+#include <cstdint>
+#include <string>
+
+namespace vsvr
+{
+namespace bench
+{
+
+/// @brief Benchmarks measuring one aspect of MemoryPool instead of replaying a trace. Selected with --synthetic NAME.
+/// Every mode prints a report of its own.
+
+/// @brief Returns true if name is a benchmark mode and not a synthetic trace.
+bool isMode(const std::string &name);
+
+/// @brief Get "name  description" lines of all modes for the usage.
+std::string modeDescriptions();
+
+/// @brief Run mode name against backend and print the results.
+/// @param opCount Approximate number of operations per measurement.
+/// @param threadCount Maximum number of threads for modes running on multiple threads.
+/// @return False if the mode validates the pool and found errors.
+/// @throw Throws if name is not a mode.
+bool runMode(const std::string &name, PoolBackend &backend, uint32_t opCount, uint32_t threadCount);
+
+}
+}
@@ -0,0 +1,122 @@
+#include "backend.h"
+
+#include "../vkutils.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace vsvr
+{
+namespace bench
+{
+
+PoolBackend::~PoolBackend()
+{
+    destroyPool();
+}
+
+void PoolBackend::createPool(vk::PhysicalDevice physicalDevice, vk::Device logicalDevice, vk::Queue queue, uint32_t queueFamily, AllocationStrategy strategy, uint64_t pageSize, bool hostVisible)
+{
+    m_physicalDevice = physicalDevice;
+    m_logicalDevice = logicalDevice;
+    m_pool = MemoryPool::create(physicalDevice, logicalDevice);
+    m_pool->setTransferQueue(queue, queueFamily);
+    m_settings.usage = vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer;
+    m_settings.properties = hostVisible ? (vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent) : vk::MemoryPropertyFlags(vk::MemoryPropertyFlagBits::eDeviceLocal);
+    m_settings.reallocStrategy = Buffer::ReallocStrategy::eGrow;
+    m_settings.allocationStrategy = strategy;
+    // set the page size for all memory types buffers can end up in
+    const auto &memProperties = DeviceInfoCache::getMemoryProperties(physicalDevice);
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+    {
+        m_pool->setPageSize(i, pageSize);
+    }
+}
+
+void PoolBackend::destroyPool()
+{
+    if (m_pool)
+    {
+        m_buffers.clear();
+        m_pool->destroy();
+        m_pool = nullptr;
+    }
+}
+
+bool PoolBackend::threadSafe() const
+{
+    return true;
+}
+
+void PoolBackend::prepare(uint32_t idCount)
+{
+    m_buffers.resize(idCount);
+}
+
+bool PoolBackend::allocate(uint32_t id, uint64_t size, uint64_t /*alignment*/)
+{
+    // alignment comes from the memory requirements of the device
+    try
+    {
+        m_buffers[id] = m_pool->createBuffer(size, m_settings);
+    }
+    catch (const std::runtime_error &)
+    {
+        // out of memory or budget, or too big. the replay skips the id until it is allocated again
+        m_buffers[id] = nullptr;
+    }
+    return m_buffers[id] != nullptr;
+}
+
+void PoolBackend::update(uint32_t id, uint64_t size)
+{
+    // only the size matters for the pool. keep scratch data per thread, so updates need no locking
+    thread_local std::vector<uint8_t> data;
+    if (data.size() < size)
+    {
+        data.resize(size);
+    }
+    m_pool->updateBuffer(m_buffers[id], RawData(data.data(), size));
+}
+
+void PoolBackend::free(uint32_t id)
+{
+    m_pool->destroyBuffer(m_buffers[id]);
+    m_buffers[id] = nullptr;
+}
+
+Backend::Stats PoolBackend::stats()
+{
+    Stats stats;
+    for (const auto & type : m_pool->statistics().memoryTypes)
+    {
+        stats.pageCount += type.pageCount;
+        stats.allocatedSize += type.allocatedSize;
+        stats.usedSize += type.usedSize;
+        stats.freeBlockCount += type.freeBlockCount;
+        stats.largestFreeBlock = std::max(stats.largestFreeBlock, static_cast<uint64_t>(type.largestFreeBlock));
+    }
+    return stats;
+}
+
+MemoryPool::Ptr PoolBackend::pool() const
+{
+    return m_pool;
+}
+
+vk::PhysicalDevice PoolBackend::physicalDevice() const
+{
+    return m_physicalDevice;
+}
+
+vk::Device PoolBackend::logicalDevice() const
+{
+    return m_logicalDevice;
+}
+
+const Buffer::Settings &PoolBackend::settings() const
+{
+    return m_settings;
+}
+
+}
+}
@@ -0,0 +1,100 @@
+#include "../vkquantize.h"
+#include "../vkutils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace vsvr;
+
+namespace
+{
+
+/// @brief Run function repeatCount times and return the fastest run in seconds.
+double bestOf(uint32_t repeatCount, const std::function<void()> &function)
+{
+    double best = 1e30;
+    for (uint32_t i = 0; i < repeatCount; i++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        function();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t vertexCount = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    if (vertexCount == 0)
+    {
+        std::cout << "Usage: vsvr_quantize_bench [VERTEXCOUNT]" << std::endl;
+        std::cout << "Measures vertex attribute quantization throughput and memory savings." << std::endl;
+        return 1;
+    }
+    // random positions and uvs, normalized normals and tangents with a bitangent sign
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    std::vector<float> positions(vertexCount * 3);
+    std::vector<float> uvs(vertexCount * 2);
+    std::vector<float> normals(vertexCount * 3);
+    std::vector<float> tangents(vertexCount * 4);
+    std::generate(positions.begin(), positions.end(), [&]() { return distribution(rng) * 100.0f; });
+    std::generate(uvs.begin(), uvs.end(), [&]() { return distribution(rng) * 0.5f + 0.5f; });
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        float n[3] = {distribution(rng), distribution(rng), distribution(rng) + 0.001f};
+        const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            normals[i * 3 + c] = n[c] / length;
+            tangents[i * 4 + c] = n[(c + 1) % 3] / length;
+        }
+        tangents[i * 4 + 3] = distribution(rng) < 0.0f ? -1.0f : 1.0f;
+    }
+    struct Case
+    {
+        const char *name;
+        const std::vector<float> &data;
+        vk::Format format;
+        Quantization quantization;
+    };
+    const std::vector<Case> cases = {
+        {"position", positions, vk::Format::eR32G32B32Sfloat, Quantization::eHalf},
+        {"uv", uvs, vk::Format::eR32G32Sfloat, Quantization::eHalf},
+        {"normal", normals, vk::Format::eR32G32B32Sfloat, Quantization::eOctahedral},
+        {"tangent", tangents, vk::Format::eR32G32B32A32Sfloat, Quantization::ePacked},
+    };
+    std::cout << "Quantizing " << vertexCount << " vertices (best of 5 runs)" << std::endl;
+    std::cout << std::left << std::setw(10) << "attribute" << std::right << std::setw(12) << "MB/s in" << std::setw(14) << "Mvertices/s" << std::setw(12) << "bytes in" << std::setw(12) << "bytes out" << std::endl;
+    uint32_t vertexSize = 0;
+    uint32_t quantizedVertexSize = 0;
+    for (const auto & c : cases)
+    {
+        const RawData data(c.data);
+        std::vector<uint8_t> result;
+        const double seconds = bestOf(5, [&]() { result = quantize(data, c.format, c.quantization); });
+        const uint32_t size = formatSize(c.format);
+        const uint32_t quantizedSize = formatSize(quantizedFormat(c.format, c.quantization));
+        vertexSize += size;
+        quantizedVertexSize += quantizedSize;
+        std::cout << std::left << std::setw(10) << c.name << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(12) << data.size / seconds / 1e6
+                  << std::setw(14) << std::setprecision(1) << vertexCount / seconds / 1e6
+                  << std::setw(12) << size
+                  << std::setw(12) << quantizedSize << std::endl;
+    }
+    std::cout << std::setprecision(1);
+    std::cout << "Vertex size: " << vertexSize << " -> " << quantizedVertexSize << " bytes, saving " << 100.0 * (vertexSize - quantizedVertexSize) / vertexSize << " %" << std::endl;
+    std::cout << "Mesh size: " << vertexCount * vertexSize / (1024.0 * 1024.0) << " -> " << vertexCount * quantizedVertexSize / (1024.0 * 1024.0) << " MiB" << std::endl;
+    return 0;
+}
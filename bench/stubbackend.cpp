@@ -0,0 +1,48 @@
+#include "backend.h"
+
+#include "stubdevice.h"
+#include <sstream>
+
+namespace vsvr
+{
+namespace bench
+{
+
+class StubBackend: public PoolBackend
+{
+public:
+    StubBackend(AllocationStrategy strategy, uint64_t pageSize, bool hostVisible)
+        : m_strategy(strategy)
+        , m_pageSize(pageSize)
+        , m_hostVisible(hostVisible)
+    {
+        createPool(m_device.physicalDevice(), m_device.logicalDevice(), m_device.queue(), m_device.queueFamily(), strategy, pageSize, hostVisible);
+    }
+
+    ~StubBackend()
+    {
+        destroyPool();
+    }
+
+    std::string name() const override
+    {
+        static const char *strategyNames[] = {"default", "tlsf", "buddy", "linear"};
+        std::ostringstream name;
+        name << "stub (" << strategyNames[static_cast<uint32_t>(m_strategy)] << ", " << (m_pageSize >> 20) << " MiB pages, " << (m_hostVisible ? "host-visible" : "device-local") << ")";
+        return name.str();
+    }
+
+private:
+    StubDevice m_device;
+    AllocationStrategy m_strategy;
+    uint64_t m_pageSize = 0;
+    bool m_hostVisible = true;
+};
+
+std::unique_ptr<PoolBackend> createStubBackend(AllocationStrategy strategy, uint64_t pageSize, bool hostVisible)
+{
+    return std::unique_ptr<PoolBackend>(new StubBackend(strategy, pageSize, hostVisible));
+}
+
+}
+}
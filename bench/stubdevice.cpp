@@ -0,0 +1,377 @@
+#include "stubdevice.h"
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace vsvr
+{
+namespace bench
+{
+
+namespace
+{
+
+constexpr VkDeviceSize HeapSize = 64ull * 1024 * 1024 * 1024; // Big enough for benchmarks to never hit the budget.
+constexpr VkDeviceSize BufferAlignment = 256;
+constexpr uint32_t DeviceLocalType = 0;
+constexpr uint32_t HostVisibleType = 1;
+
+struct StubMemory
+{
+    std::unique_ptr<uint8_t[]> data; // Not initialized, so the OS only commits pages that are written to.
+    VkDeviceSize size = 0;
+};
+
+struct StubBuffer
+{
+    VkDeviceSize size = 0;
+    StubMemory *memory = nullptr;
+    VkDeviceSize offset = 0; // Offset of buffer in memory.
+};
+
+struct StubCommandBuffer
+{
+    struct Copy
+    {
+        const StubBuffer *src = nullptr;
+        const StubBuffer *dst = nullptr;
+        VkBufferCopy region = {};
+    };
+
+    std::vector<Copy> copies; // Recorded copies. Executed on submission.
+};
+
+struct StubCommandPool
+{
+    std::mutex mutex;
+    std::set<StubCommandBuffer *> commandBuffers; // Command buffers allocated from pool, so destroying the pool frees them.
+};
+
+struct StubFence
+{
+    std::atomic<bool> signaled{false};
+};
+
+// handles of the physical device and queue. they are never dereferenced
+char PhysicalDeviceObject = 0;
+char QueueObject = 0;
+std::atomic<uintptr_t> LastDeviceId{0};
+
+// non-dispatchable handles are pointers or 64-bit integers depending on the platform. reinterpret_cast converts both
+template <typename T, typename H>
+T *fromHandle(H handle)
+{
+    return reinterpret_cast<T *>(handle);
+}
+
+template <typename H, typename T>
+H toHandle(T *object)
+{
+    return reinterpret_cast<H>(object);
+}
+
+VkPhysicalDeviceProperties makeProperties()
+{
+    VkPhysicalDeviceProperties properties = {};
+    properties.apiVersion = VK_API_VERSION_1_1;
+    properties.deviceType = VK_PHYSICAL_DEVICE_TYPE_CPU;
+    std::strncpy(properties.deviceName, "vsvr stub device", VK_MAX_PHYSICAL_DEVICE_NAME_SIZE - 1);
+    // limits of a typical discrete GPU
+    properties.limits.maxMemoryAllocationCount = 4096;
+    properties.limits.bufferImageGranularity = 1024;
+    properties.limits.nonCoherentAtomSize = 64;
+    properties.limits.minTexelBufferOffsetAlignment = 16;
+    properties.limits.minUniformBufferOffsetAlignment = 256;
+    properties.limits.minStorageBufferOffsetAlignment = 16;
+    return properties;
+}
+
+VkPhysicalDeviceMemoryProperties makeMemoryProperties()
+{
+    VkPhysicalDeviceMemoryProperties properties = {};
+    properties.memoryHeapCount = 2;
+    properties.memoryHeaps[0].size = HeapSize;
+    properties.memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+    properties.memoryHeaps[1].size = HeapSize;
+    properties.memoryTypeCount = 2;
+    properties.memoryTypes[DeviceLocalType].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    properties.memoryTypes[DeviceLocalType].heapIndex = 0;
+    properties.memoryTypes[HostVisibleType].propertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    properties.memoryTypes[HostVisibleType].heapIndex = 1;
+    return properties;
+}
+
+VkMemoryRequirements bufferRequirements(VkBuffer buffer)
+{
+    VkMemoryRequirements requirements = {};
+    requirements.size = (fromHandle<StubBuffer>(buffer)->size + BufferAlignment - 1) & ~(BufferAlignment - 1);
+    requirements.alignment = BufferAlignment;
+    requirements.memoryTypeBits = (1 << DeviceLocalType) | (1 << HostVisibleType);
+    return requirements;
+}
+
+}
+
+StubDevice::StubDevice()
+    : m_id(++LastDeviceId)
+{
+}
+
+vk::PhysicalDevice StubDevice::physicalDevice() const
+{
+    return vk::PhysicalDevice(reinterpret_cast<VkPhysicalDevice>(&PhysicalDeviceObject));
+}
+
+vk::Device StubDevice::logicalDevice() const
+{
+    // ids are never reused, so a new device never gets the pool of an old one
+    return vk::Device(reinterpret_cast<VkDevice>(m_id * 16));
+}
+
+vk::Queue StubDevice::queue() const
+{
+    return vk::Queue(reinterpret_cast<VkQueue>(&QueueObject));
+}
+
+uint32_t StubDevice::queueFamily() const
+{
+    return 0;
+}
+
+}
+}
+
+using namespace vsvr::bench;
+
+extern "C"
+{
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties(VkPhysicalDevice /*physicalDevice*/, VkPhysicalDeviceProperties *pProperties)
+{
+    static const VkPhysicalDeviceProperties properties = makeProperties();
+    *pProperties = properties;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice /*physicalDevice*/, VkPhysicalDeviceMemoryProperties *pMemoryProperties)
+{
+    static const VkPhysicalDeviceMemoryProperties properties = makeMemoryProperties();
+    *pMemoryProperties = properties;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkEnumerateDeviceExtensionProperties(VkPhysicalDevice /*physicalDevice*/, const char * /*pLayerName*/, uint32_t *pPropertyCount, VkExtensionProperties * /*pProperties*/)
+{
+    // no extensions, so MemoryPool estimates the budget from the heap sizes
+    *pPropertyCount = 0;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice /*device*/, const VkMemoryAllocateInfo *pAllocateInfo, const VkAllocationCallbacks * /*pAllocator*/, VkDeviceMemory *pMemory)
+{
+    auto memory = new StubMemory();
+    memory->data.reset(new uint8_t[pAllocateInfo->allocationSize]);
+    memory->size = pAllocateInfo->allocationSize;
+    *pMemory = toHandle<VkDeviceMemory>(memory);
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice /*device*/, VkDeviceMemory memory, const VkAllocationCallbacks * /*pAllocator*/)
+{
+    delete fromHandle<StubMemory>(memory);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice /*device*/, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize /*size*/, VkMemoryMapFlags /*flags*/, void **ppData)
+{
+    *ppData = fromHandle<StubMemory>(memory)->data.get() + offset;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkUnmapMemory(VkDevice /*device*/, VkDeviceMemory /*memory*/)
+{
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkFlushMappedMemoryRanges(VkDevice /*device*/, uint32_t /*memoryRangeCount*/, const VkMappedMemoryRange * /*pMemoryRanges*/)
+{
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateBuffer(VkDevice /*device*/, const VkBufferCreateInfo *pCreateInfo, const VkAllocationCallbacks * /*pAllocator*/, VkBuffer *pBuffer)
+{
+    auto buffer = new StubBuffer();
+    buffer->size = pCreateInfo->size;
+    *pBuffer = toHandle<VkBuffer>(buffer);
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyBuffer(VkDevice /*device*/, VkBuffer buffer, const VkAllocationCallbacks * /*pAllocator*/)
+{
+    delete fromHandle<StubBuffer>(buffer);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements(VkDevice /*device*/, VkBuffer buffer, VkMemoryRequirements *pMemoryRequirements)
+{
+    *pMemoryRequirements = bufferRequirements(buffer);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements2(VkDevice /*device*/, const VkBufferMemoryRequirementsInfo2 *pInfo, VkMemoryRequirements2 *pMemoryRequirements)
+{
+    pMemoryRequirements->memoryRequirements = bufferRequirements(pInfo->buffer);
+    // buffers never want a dedicated allocation
+    for (auto next = static_cast<VkBaseOutStructure *>(pMemoryRequirements->pNext); next; next = next->pNext)
+    {
+        if (next->sType == VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS)
+        {
+            auto dedicated = reinterpret_cast<VkMemoryDedicatedRequirements *>(next);
+            dedicated->prefersDedicatedAllocation = VK_FALSE;
+            dedicated->requiresDedicatedAllocation = VK_FALSE;
+        }
+    }
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindBufferMemory(VkDevice /*device*/, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize memoryOffset)
+{
+    auto stubBuffer = fromHandle<StubBuffer>(buffer);
+    stubBuffer->memory = fromHandle<StubMemory>(memory);
+    stubBuffer->offset = memoryOffset;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateCommandPool(VkDevice /*device*/, const VkCommandPoolCreateInfo * /*pCreateInfo*/, const VkAllocationCallbacks * /*pAllocator*/, VkCommandPool *pCommandPool)
+{
+    *pCommandPool = toHandle<VkCommandPool>(new StubCommandPool());
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyCommandPool(VkDevice /*device*/, VkCommandPool commandPool, const VkAllocationCallbacks * /*pAllocator*/)
+{
+    auto pool = fromHandle<StubCommandPool>(commandPool);
+    if (pool)
+    {
+        for (auto commandBuffer : pool->commandBuffers)
+        {
+            delete commandBuffer;
+        }
+        delete pool;
+    }
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateCommandBuffers(VkDevice /*device*/, const VkCommandBufferAllocateInfo *pAllocateInfo, VkCommandBuffer *pCommandBuffers)
+{
+    auto pool = fromHandle<StubCommandPool>(pAllocateInfo->commandPool);
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    for (uint32_t i = 0; i < pAllocateInfo->commandBufferCount; i++)
+    {
+        auto commandBuffer = new StubCommandBuffer();
+        pool->commandBuffers.insert(commandBuffer);
+        pCommandBuffers[i] = reinterpret_cast<VkCommandBuffer>(commandBuffer);
+    }
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeCommandBuffers(VkDevice /*device*/, VkCommandPool commandPool, uint32_t commandBufferCount, const VkCommandBuffer *pCommandBuffers)
+{
+    auto pool = fromHandle<StubCommandPool>(commandPool);
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    for (uint32_t i = 0; i < commandBufferCount; i++)
+    {
+        auto commandBuffer = reinterpret_cast<StubCommandBuffer *>(pCommandBuffers[i]);
+        if (commandBuffer)
+        {
+            pool->commandBuffers.erase(commandBuffer);
+            delete commandBuffer;
+        }
+    }
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBeginCommandBuffer(VkCommandBuffer commandBuffer, const VkCommandBufferBeginInfo * /*pBeginInfo*/)
+{
+    reinterpret_cast<StubCommandBuffer *>(commandBuffer)->copies.clear();
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkEndCommandBuffer(VkCommandBuffer /*commandBuffer*/)
+{
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdCopyBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer, uint32_t regionCount, const VkBufferCopy *pRegions)
+{
+    auto &copies = reinterpret_cast<StubCommandBuffer *>(commandBuffer)->copies;
+    for (uint32_t i = 0; i < regionCount; i++)
+    {
+        StubCommandBuffer::Copy copy;
+        copy.src = fromHandle<StubBuffer>(srcBuffer);
+        copy.dst = fromHandle<StubBuffer>(dstBuffer);
+        copy.region = pRegions[i];
+        copies.push_back(copy);
+    }
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdPipelineBarrier(VkCommandBuffer /*commandBuffer*/, VkPipelineStageFlags /*srcStageMask*/, VkPipelineStageFlags /*dstStageMask*/, VkDependencyFlags /*dependencyFlags*/,
+                                                uint32_t /*memoryBarrierCount*/, const VkMemoryBarrier * /*pMemoryBarriers*/, uint32_t /*bufferMemoryBarrierCount*/, const VkBufferMemoryBarrier * /*pBufferMemoryBarriers*/,
+                                                uint32_t /*imageMemoryBarrierCount*/, const VkImageMemoryBarrier * /*pImageMemoryBarriers*/)
+{
+    // commands are executed in order on submission, so there is nothing to wait for
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkQueueSubmit(VkQueue /*queue*/, uint32_t submitCount, const VkSubmitInfo *pSubmits, VkFence fence)
+{
+    for (uint32_t i = 0; i < submitCount; i++)
+    {
+        for (uint32_t j = 0; j < pSubmits[i].commandBufferCount; j++)
+        {
+            for (const auto & copy : reinterpret_cast<StubCommandBuffer *>(pSubmits[i].pCommandBuffers[j])->copies)
+            {
+                std::memcpy(copy.dst->memory->data.get() + copy.dst->offset + copy.region.dstOffset, copy.src->memory->data.get() + copy.src->offset + copy.region.srcOffset, copy.region.size);
+            }
+        }
+    }
+    if (fence)
+    {
+        fromHandle<StubFence>(fence)->signaled = true;
+    }
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateFence(VkDevice /*device*/, const VkFenceCreateInfo *pCreateInfo, const VkAllocationCallbacks * /*pAllocator*/, VkFence *pFence)
+{
+    auto fence = new StubFence();
+    fence->signaled = (pCreateInfo->flags & VK_FENCE_CREATE_SIGNALED_BIT) != 0;
+    *pFence = toHandle<VkFence>(fence);
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyFence(VkDevice /*device*/, VkFence fence, const VkAllocationCallbacks * /*pAllocator*/)
+{
+    delete fromHandle<StubFence>(fence);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkGetFenceStatus(VkDevice /*device*/, VkFence fence)
+{
+    return fromHandle<StubFence>(fence)->signaled ? VK_SUCCESS : VK_NOT_READY;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkWaitForFences(VkDevice /*device*/, uint32_t fenceCount, const VkFence *pFences, VkBool32 waitAll, uint64_t /*timeout*/)
+{
+    // submissions finish right away, so a fence that is not signaled now never will be
+    uint32_t signaledCount = 0;
+    for (uint32_t i = 0; i < fenceCount; i++)
+    {
+        signaledCount += fromHandle<StubFence>(pFences[i])->signaled ? 1 : 0;
+    }
+    return (waitAll ? signaledCount == fenceCount : signaledCount > 0) ? VK_SUCCESS : VK_TIMEOUT;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkResetFences(VkDevice /*device*/, uint32_t fenceCount, const VkFence *pFences)
+{
+    for (uint32_t i = 0; i < fenceCount; i++)
+    {
+        fromHandle<StubFence>(pFences[i])->signaled = false;
+    }
+    return VK_SUCCESS;
+}
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "../vkincludes.h"
+#include <cstdint>
+
+namespace vsvr
+{
+namespace bench
+{
+
+/// @brief A Vulkan device that only exists on the CPU, so MemoryPool can be run without a driver.
+/// stubdevice.cpp defines the Vulkan entry points MemoryPool uses. They take precedence over the ones of the Vulkan loader,
+/// so only link it into executables that do not use a real device.
+/// Device memory is backed by host memory and transfer commands are executed when they are submitted,
+/// so staged uploads really copy their data and fences signal right away.
+/// The device has a device-local and a host-visible, coherent memory type like a discrete GPU. Images are not supported.
+class StubDevice
+{
+public:
+    /// @brief Create device. Every device gets a handle of its own, because MemoryPool::create() keeps one pool per handle.
+    StubDevice();
+
+    StubDevice(const StubDevice &other) = delete;
+    StubDevice &operator=(const StubDevice &other) = delete;
+
+    vk::PhysicalDevice physicalDevice() const;
+    vk::Device logicalDevice() const;
+    /// @brief Get queue. It can do transfers and is in queueFamily().
+    vk::Queue queue() const;
+    uint32_t queueFamily() const;
+
+private:
+    uintptr_t m_id = 0;
+};
+
+}
+}
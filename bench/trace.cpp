@@ -0,0 +1,279 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace vsvr
+{
+namespace bench
+{
+
+Trace loadTrace(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Failed to open trace file " + path + "!");
+    }
+    Trace trace;
+    std::string line;
+    uint32_t lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream stream(line);
+        char type = 0;
+        TraceOp op;
+        stream >> type >> op.id;
+        op.type = static_cast<TraceOp::Type>(type);
+        if (op.type == TraceOp::Type::eAllocate)
+        {
+            stream >> op.size >> op.alignment;
+        }
+        else if (op.type == TraceOp::Type::eUpdate)
+        {
+            stream >> op.size;
+        }
+        else if (op.type != TraceOp::Type::eFree)
+        {
+            stream.setstate(std::ios::failbit);
+        }
+        if (stream.fail())
+        {
+            throw std::runtime_error("Invalid trace line " + std::to_string(lineNumber) + " in " + path + "!");
+        }
+        trace.push_back(op);
+    }
+    return trace;
+}
+
+void saveTrace(const Trace &trace, const std::string &path)
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Failed to open trace file " + path + "!");
+    }
+    file << "# vsvr allocation trace: a <id> <size> <alignment> / u <id> <size> / f <id>" << std::endl;
+    for (const auto & op : trace)
+    {
+        file << static_cast<char>(op.type) << " " << op.id;
+        if (op.type == TraceOp::Type::eAllocate)
+        {
+            file << " " << op.size << " " << op.alignment;
+        }
+        else if (op.type == TraceOp::Type::eUpdate)
+        {
+            file << " " << op.size;
+        }
+        file << "\n";
+    }
+}
+
+TraceRecorder::TraceRecorder(MemoryPool::Ptr pool)
+    : m_pool(pool)
+{
+    m_pool->setTraceCallback([this](const MemoryPool::TraceEvent &event) { record(event); });
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    m_pool->setTraceCallback(nullptr);
+}
+
+Trace TraceRecorder::trace() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_trace;
+}
+
+void TraceRecorder::save(const std::string &path) const
+{
+    saveTrace(trace(), path);
+}
+
+void TraceRecorder::record(const MemoryPool::TraceEvent &event)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const uint32_t id = event.handle.index;
+    if (id >= m_live.size())
+    {
+        m_live.resize(id + 1, false);
+    }
+    TraceOp op;
+    op.id = id;
+    op.size = event.size;
+    switch (event.type)
+    {
+        case MemoryPool::TraceEvent::Type::eCreate:
+            op.type = TraceOp::Type::eAllocate;
+            op.alignment = event.alignment;
+            m_live[id] = true;
+            break;
+        case MemoryPool::TraceEvent::Type::eUpdate:
+            if (!m_live[id])
+            {
+                return;
+            }
+            op.type = TraceOp::Type::eUpdate;
+            break;
+        case MemoryPool::TraceEvent::Type::eDestroy:
+            if (!m_live[id])
+            {
+                return;
+            }
+            op.type = TraceOp::Type::eFree;
+            op.size = 0;
+            m_live[id] = false;
+            break;
+    }
+    m_trace.push_back(op);
+}
+
+uint32_t traceIdCount(const Trace &trace)
+{
+    uint32_t count = 0;
+    for (const auto & op : trace)
+    {
+        count = std::max(count, op.id + 1);
+    }
+    return count;
+}
+
+uint64_t randomSize(std::mt19937 &generator, uint64_t minSize, uint64_t maxSize)
+{
+    std::uniform_real_distribution<double> distribution(std::log(static_cast<double>(minSize)), std::log(static_cast<double>(maxSize)));
+    return std::max(minSize, static_cast<uint64_t>(std::exp(distribution(generator))));
+}
+
+static uint64_t randomAlignment(std::mt19937 &generator)
+{
+    static const uint64_t alignments[] = {16, 64, 256};
+    return alignments[std::uniform_int_distribution<uint32_t>(0, 2)(generator)];
+}
+
+Trace makeRandomTrace(uint32_t opCount, uint64_t minSize, uint64_t maxSize, uint32_t liveCount, uint32_t seed)
+{
+    std::mt19937 generator(seed);
+    Trace trace;
+    std::vector<uint32_t> live;
+    std::vector<uint32_t> freeIds;
+    uint32_t nextId = 0;
+    for (uint32_t i = 0; i < opCount; i++)
+    {
+        const bool allocate = live.size() < liveCount && (live.empty() || std::uniform_int_distribution<uint32_t>(0, 1)(generator) == 0 || live.size() < liveCount / 2);
+        TraceOp op;
+        if (allocate)
+        {
+            op.type = TraceOp::Type::eAllocate;
+            if (freeIds.empty())
+            {
+                op.id = nextId++;
+            }
+            else
+            {
+                op.id = freeIds.back();
+                freeIds.pop_back();
+            }
+            op.size = randomSize(generator, minSize, maxSize);
+            op.alignment = randomAlignment(generator);
+            live.push_back(op.id);
+        }
+        else
+        {
+            op.type = TraceOp::Type::eFree;
+            const auto index = std::uniform_int_distribution<size_t>(0, live.size() - 1)(generator);
+            op.id = live[index];
+            live[index] = live.back();
+            live.pop_back();
+            freeIds.push_back(op.id);
+        }
+        trace.push_back(op);
+    }
+    for (auto id : live)
+    {
+        TraceOp op;
+        op.type = TraceOp::Type::eFree;
+        op.id = id;
+        trace.push_back(op);
+    }
+    return trace;
+}
+
+Trace makeFrameTrace(uint32_t frameCount, uint32_t perFrame, uint32_t framesInFlight, uint64_t minSize, uint64_t maxSize, uint32_t seed)
+{
+    std::mt19937 generator(seed);
+    Trace trace;
+    // ids are reused in a ring of framesInFlight + 1 frames
+    const uint32_t ringFrames = framesInFlight + 1;
+    for (uint32_t frame = 0; frame < frameCount + framesInFlight; frame++)
+    {
+        const uint32_t slot = frame % ringFrames;
+        if (frame >= ringFrames - 1)
+        {
+            // free the buffers of the frame that is done on the device now
+            const uint32_t oldSlot = (frame + 1) % ringFrames;
+            for (uint32_t i = 0; i < perFrame && frame - framesInFlight < frameCount; i++)
+            {
+                TraceOp op;
+                op.type = TraceOp::Type::eFree;
+                op.id = oldSlot * perFrame + i;
+                trace.push_back(op);
+            }
+        }
+        for (uint32_t i = 0; i < perFrame && frame < frameCount; i++)
+        {
+            TraceOp op;
+            op.type = TraceOp::Type::eAllocate;
+            op.id = slot * perFrame + i;
+            op.size = randomSize(generator, minSize, maxSize);
+            op.alignment = randomAlignment(generator);
+            trace.push_back(op);
+        }
+    }
+    return trace;
+}
+
+Trace makeUpdateTrace(uint32_t bufferCount, uint32_t updateCount, uint64_t size, uint32_t seed)
+{
+    std::mt19937 generator(seed);
+    Trace trace;
+    for (uint32_t id = 0; id < bufferCount; id++)
+    {
+        TraceOp op;
+        op.type = TraceOp::Type::eAllocate;
+        op.id = id;
+        op.size = size;
+        op.alignment = 256;
+        trace.push_back(op);
+    }
+    std::uniform_int_distribution<uint32_t> idDistribution(0, bufferCount - 1);
+    std::uniform_int_distribution<uint64_t> sizeDistribution((size * 3) / 4, (size * 5) / 4);
+    for (uint32_t i = 0; i < updateCount; i++)
+    {
+        TraceOp op;
+        op.type = TraceOp::Type::eUpdate;
+        op.id = idDistribution(generator);
+        op.size = std::max<uint64_t>(1, sizeDistribution(generator));
+        trace.push_back(op);
+    }
+    for (uint32_t id = 0; id < bufferCount; id++)
+    {
+        TraceOp op;
+        op.type = TraceOp::Type::eFree;
+        op.id = id;
+        trace.push_back(op);
+    }
+    return trace;
+}
+
+}
+}
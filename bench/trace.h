@@ -0,0 +1,88 @@
+#pragma once
+
+#include "../vkbuffer.h"
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace vsvr
+{
+namespace bench
+{
+
+/// @brief A single operation of an allocation trace.
+struct TraceOp
+{
+    enum class Type : char
+    {
+        eAllocate = 'a', // Allocate buffer id with size and alignment.
+        eUpdate = 'u',   // Update buffer id with size bytes of data. Grows the buffer if needed.
+        eFree = 'f',     // Free buffer id.
+    };
+
+    Type type = Type::eAllocate;
+    uint32_t id = 0;        // Id of buffer. Ids can be reused after the buffer has been freed.
+    uint64_t size = 0;      // Size for eAllocate and eUpdate.
+    uint64_t alignment = 0; // Alignment for eAllocate.
+};
+
+using Trace = std::vector<TraceOp>;
+
+/// @brief Load trace from a text file. One operation per line: "a <id> <size> <alignment>", "u <id> <size>" or "f <id>".
+/// Empty lines and lines starting with '#' are ignored.
+/// @throw Throws if the file can not be read or contains invalid lines.
+Trace loadTrace(const std::string &path);
+
+/// @brief Save trace to a text file in the format loadTrace() reads.
+void saveTrace(const Trace &trace, const std::string &path);
+
+/// @brief Records the buffer operations of a MemoryPool as a trace, so the allocation pattern of a real application
+/// can be replayed with vsvr_bench. Add bench/trace.cpp to the application, create a recorder for its pool and save() the trace when done.
+/// Slot indices of buffers are used as ids. Operations on buffers that existed before recording started are skipped.
+/// @note Only one recorder per pool at a time. Create it before using the pool from multiple threads.
+class TraceRecorder
+{
+public:
+    /// @brief Start recording operations of pool.
+    TraceRecorder(MemoryPool::Ptr pool);
+    /// @brief Stop recording.
+    ~TraceRecorder();
+
+    TraceRecorder(const TraceRecorder &other) = delete;
+    TraceRecorder &operator=(const TraceRecorder &other) = delete;
+
+    /// @brief Get trace recorded so far. Thread-safe.
+    Trace trace() const;
+    /// @brief Save trace recorded so far to a text file. Thread-safe.
+    void save(const std::string &path) const;
+
+private:
+    void record(const MemoryPool::TraceEvent &event);
+
+    MemoryPool::Ptr m_pool;
+    mutable std::mutex m_mutex; // Protects m_trace and m_live. Events of different buffers arrive from multiple threads.
+    Trace m_trace;
+    std::vector<bool> m_live; // True if buffer with id was created while recording.
+};
+
+/// @brief Get number of ids used by trace, which is the maximum id + 1.
+uint32_t traceIdCount(const Trace &trace);
+
+/// @brief Draw a size log-uniformly from [minSize, maxSize]. Sizes in real scenes are spread over orders of magnitude.
+uint64_t randomSize(std::mt19937 &generator, uint64_t minSize, uint64_t maxSize);
+
+/// @brief Random allocations and frees with sizes log-uniformly distributed in [minSize, maxSize].
+/// Allocates until liveCount buffers are live, then frees and allocates randomly. Frees all buffers at the end.
+Trace makeRandomTrace(uint32_t opCount, uint64_t minSize, uint64_t maxSize, uint32_t liveCount, uint32_t seed);
+
+/// @brief Transient per-frame data. Every frame allocates perFrame buffers and frees the ones allocated framesInFlight frames ago.
+Trace makeFrameTrace(uint32_t frameCount, uint32_t perFrame, uint32_t framesInFlight, uint64_t minSize, uint64_t maxSize, uint32_t seed);
+
+/// @brief A fixed set of buffers updated over and over, e.g. dynamic uniform or vertex data.
+/// Update sizes vary by up to +-25% around size, so growing buffers reallocate now and then.
+Trace makeUpdateTrace(uint32_t bufferCount, uint32_t updateCount, uint64_t size, uint32_t seed);
+
+}
+}
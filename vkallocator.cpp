@@ -0,0 +1,515 @@
+#include "vkallocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace vsvr
+{
+
+// index of most significant bit set. value must not be 0
+static inline uint32_t bitScanReverse(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index = 0;
+    _BitScanReverse64(&index, value);
+    return static_cast<uint32_t>(index);
+#else
+    return 63 - static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+}
+
+// index of least significant bit set. value must not be 0
+static inline uint32_t bitScanForward(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index = 0;
+    _BitScanForward64(&index, value);
+    return static_cast<uint32_t>(index);
+#else
+    return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+}
+
+std::unique_ptr<PageAllocator> PageAllocator::create(AllocationStrategy strategy, vk::DeviceSize size)
+{
+    switch (strategy)
+    {
+        case AllocationStrategy::eBuddy:
+            return std::unique_ptr<PageAllocator>(new BuddyAllocator(size));
+        case AllocationStrategy::eLinear:
+            return std::unique_ptr<PageAllocator>(new LinearAllocator(size));
+        default:
+            return std::unique_ptr<PageAllocator>(new TlsfAllocator(size));
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+
+TlsfAllocator::TlsfAllocator(vk::DeviceSize size)
+    : m_size(size)
+{
+    for (auto & bins : m_bins)
+    {
+        std::fill(std::begin(bins), std::end(bins), InvalidBlock);
+    }
+    if (size > 0)
+    {
+        // add free block that spans the whole range
+        insertFreeBlock(newBlock(0, size));
+    }
+}
+
+void TlsfAllocator::mapping(vk::DeviceSize size, uint32_t &firstLevel, uint32_t &secondLevel)
+{
+    if (size < SecondLevelCount)
+    {
+        // small sizes map linearly to the second level bins of the first level
+        firstLevel = 0;
+        secondLevel = static_cast<uint32_t>(size);
+    }
+    else
+    {
+        // first level is the power of two, second level the following bits linearly subdivide that
+        const auto msb = bitScanReverse(size);
+        firstLevel = msb - SecondLevelLog2 + 1;
+        secondLevel = static_cast<uint32_t>(size >> (msb - SecondLevelLog2)) & (SecondLevelCount - 1);
+    }
+}
+
+uint32_t TlsfAllocator::findSuitableBlock(vk::DeviceSize size) const
+{
+    // round the size up to the next bin, so any block in the bin we find is big enough
+    auto searchSize = size;
+    if (size >= SecondLevelCount)
+    {
+        searchSize += (vk::DeviceSize(1) << (bitScanReverse(size) - SecondLevelLog2)) - 1;
+    }
+    uint32_t firstLevel = 0;
+    uint32_t secondLevel = 0;
+    mapping(searchSize, firstLevel, secondLevel);
+    if (firstLevel >= FirstLevelCount)
+    {
+        return InvalidBlock;
+    }
+    // check for a non-empty bin in this first level
+    uint32_t secondLevelMap = m_secondLevelMap[firstLevel] & (~0u << secondLevel);
+    if (secondLevelMap == 0)
+    {
+        // none. check for a non-empty bin in the following first levels
+        const uint64_t firstLevelMap = (firstLevel + 1) < 64 ? (m_firstLevelMap & (~uint64_t(0) << (firstLevel + 1))) : 0;
+        if (firstLevelMap == 0)
+        {
+            return InvalidBlock;
+        }
+        firstLevel = bitScanForward(firstLevelMap);
+        secondLevelMap = m_secondLevelMap[firstLevel];
+    }
+    secondLevel = bitScanForward(secondLevelMap);
+    return m_bins[firstLevel][secondLevel];
+}
+
+TlsfAllocator::Allocation TlsfAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+{
+    size = std::max(size, vk::DeviceSize(1));
+    alignment = std::max(alignment, vk::DeviceSize(1));
+    // reserve enough space so we can always shift the offset to the alignment
+    const auto searchSize = size + alignment - 1;
+    auto block = findSuitableBlock(searchSize);
+    if (block == InvalidBlock)
+    {
+        // rounding up to the next bin skips blocks in the bin of size that might fit.
+        // like standard TLSF only check that single bin, so this stays bounded when we are nearly out of memory
+        uint32_t firstLevel = 0;
+        uint32_t secondLevel = 0;
+        mapping(size, firstLevel, secondLevel);
+        if (firstLevel < FirstLevelCount)
+        {
+            for (auto b = m_bins[firstLevel][secondLevel]; b != InvalidBlock; b = m_blocks[b].nextFree)
+            {
+                const auto padding = (alignment - (m_blocks[b].offset % alignment)) % alignment;
+                if (m_blocks[b].size >= size + padding)
+                {
+                    block = b;
+                    break;
+                }
+            }
+        }
+        if (block == InvalidBlock)
+        {
+            return Allocation();
+        }
+    }
+    removeFreeBlock(block);
+    // if the offset is not aligned we split off a free block before, so the previous block might use the memory if it expands
+    const auto padding = (alignment - (m_blocks[block].offset % alignment)) % alignment;
+    if (padding > 0)
+    {
+        auto alignedBlock = splitBlock(block, padding);
+        insertFreeBlock(block);
+        block = alignedBlock;
+    }
+    // split off the remaining free memory behind the block
+    if (m_blocks[block].size > size)
+    {
+        insertFreeBlock(splitBlock(block, size));
+    }
+    m_usedSize += size;
+    return Allocation({block, m_blocks[block].offset, size});
+}
+
+void TlsfAllocator::free(uint32_t block)
+{
+    if (block >= m_blocks.size() || m_blocks[block].isFree)
+    {
+        throw std::runtime_error("Invalid or already free block!");
+    }
+    m_usedSize -= m_blocks[block].size;
+    // coalesce free memory with next
+    auto next = m_blocks[block].nextPhysical;
+    if (next != InvalidBlock && m_blocks[next].isFree)
+    {
+        removeFreeBlock(next);
+        mergeWithNext(block);
+    }
+    // coalesce free memory with previous
+    auto prev = m_blocks[block].prevPhysical;
+    if (prev != InvalidBlock && m_blocks[prev].isFree)
+    {
+        removeFreeBlock(prev);
+        mergeWithNext(prev);
+        block = prev;
+    }
+    insertFreeBlock(block);
+}
+
+vk::DeviceSize TlsfAllocator::size() const
+{
+    return m_size;
+}
+
+vk::DeviceSize TlsfAllocator::usedSize() const
+{
+    return m_usedSize;
+}
+
+bool TlsfAllocator::empty() const
+{
+    return m_usedSize == 0;
+}
+
+uint32_t TlsfAllocator::freeBlockCount() const
+{
+    return m_freeBlockCount;
+}
+
+vk::DeviceSize TlsfAllocator::largestFreeBlock() const
+{
+    if (m_firstLevelMap == 0)
+    {
+        return 0;
+    }
+    // the largest block is in the highest non-empty bin
+    const auto firstLevel = bitScanReverse(m_firstLevelMap);
+    const auto secondLevel = bitScanReverse(m_secondLevelMap[firstLevel]);
+    vk::DeviceSize largest = 0;
+    for (auto b = m_bins[firstLevel][secondLevel]; b != InvalidBlock; b = m_blocks[b].nextFree)
+    {
+        largest = std::max(largest, m_blocks[b].size);
+    }
+    return largest;
+}
+
+void TlsfAllocator::insertFreeBlock(uint32_t block)
+{
+    uint32_t firstLevel = 0;
+    uint32_t secondLevel = 0;
+    mapping(m_blocks[block].size, firstLevel, secondLevel);
+    auto &head = m_bins[firstLevel][secondLevel];
+    m_blocks[block].isFree = true;
+    m_blocks[block].prevFree = InvalidBlock;
+    m_blocks[block].nextFree = head;
+    if (head != InvalidBlock)
+    {
+        m_blocks[head].prevFree = block;
+    }
+    head = block;
+    m_firstLevelMap |= uint64_t(1) << firstLevel;
+    m_secondLevelMap[firstLevel] |= 1u << secondLevel;
+    m_freeBlockCount++;
+}
+
+void TlsfAllocator::removeFreeBlock(uint32_t block)
+{
+    uint32_t firstLevel = 0;
+    uint32_t secondLevel = 0;
+    mapping(m_blocks[block].size, firstLevel, secondLevel);
+    auto &info = m_blocks[block];
+    if (info.prevFree != InvalidBlock)
+    {
+        m_blocks[info.prevFree].nextFree = info.nextFree;
+    }
+    else
+    {
+        // block is head of bin
+        m_bins[firstLevel][secondLevel] = info.nextFree;
+        if (info.nextFree == InvalidBlock)
+        {
+            // bin is now empty
+            m_secondLevelMap[firstLevel] &= ~(1u << secondLevel);
+            if (m_secondLevelMap[firstLevel] == 0)
+            {
+                m_firstLevelMap &= ~(uint64_t(1) << firstLevel);
+            }
+        }
+    }
+    if (info.nextFree != InvalidBlock)
+    {
+        m_blocks[info.nextFree].prevFree = info.prevFree;
+    }
+    info.isFree = false;
+    info.prevFree = InvalidBlock;
+    info.nextFree = InvalidBlock;
+    m_freeBlockCount--;
+}
+
+uint32_t TlsfAllocator::newBlock(vk::DeviceSize offset, vk::DeviceSize size)
+{
+    uint32_t block = m_unusedBlocks;
+    if (block != InvalidBlock)
+    {
+        // reuse a block record
+        m_unusedBlocks = m_blocks[block].prevFree;
+        m_blocks[block] = BlockInfo();
+    }
+    else
+    {
+        block = static_cast<uint32_t>(m_blocks.size());
+        m_blocks.emplace_back();
+    }
+    m_blocks[block].offset = offset;
+    m_blocks[block].size = size;
+    return block;
+}
+
+void TlsfAllocator::releaseBlock(uint32_t block)
+{
+    m_blocks[block].isFree = false;
+    m_blocks[block].size = 0;
+    m_blocks[block].prevFree = m_unusedBlocks;
+    m_unusedBlocks = block;
+}
+
+uint32_t TlsfAllocator::splitBlock(uint32_t block, vk::DeviceSize size)
+{
+    // create block for the memory behind size. note that newBlock() might invalidate references
+    const auto remainderOffset = m_blocks[block].offset + size;
+    const auto remainderSize = m_blocks[block].size - size;
+    auto remainder = newBlock(remainderOffset, remainderSize);
+    auto next = m_blocks[block].nextPhysical;
+    m_blocks[remainder].prevPhysical = block;
+    m_blocks[remainder].nextPhysical = next;
+    if (next != InvalidBlock)
+    {
+        m_blocks[next].prevPhysical = remainder;
+    }
+    m_blocks[block].nextPhysical = remainder;
+    m_blocks[block].size = size;
+    return remainder;
+}
+
+void TlsfAllocator::mergeWithNext(uint32_t block)
+{
+    auto next = m_blocks[block].nextPhysical;
+    m_blocks[block].size += m_blocks[next].size;
+    m_blocks[block].nextPhysical = m_blocks[next].nextPhysical;
+    if (m_blocks[next].nextPhysical != InvalidBlock)
+    {
+        m_blocks[m_blocks[next].nextPhysical].prevPhysical = block;
+    }
+    releaseBlock(next);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+BuddyAllocator::BuddyAllocator(vk::DeviceSize size)
+    : m_size(size)
+{
+    if (size >= MinBlockSize)
+    {
+        // manage the largest power of two that fits. it starts as one free block
+        m_orderCount = bitScanReverse(size) - MinBlockLog2 + 1;
+        m_freeBlocks.resize(m_orderCount);
+        m_freeBlocks[m_orderCount - 1].insert(0);
+    }
+}
+
+BuddyAllocator::Allocation BuddyAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+{
+    size = std::max(size, vk::DeviceSize(1));
+    // blocks are aligned to their size, so a block at least as big as the alignment is always aligned
+    const auto needed = std::max(std::max(size, alignment), MinBlockSize);
+    auto log2 = bitScanReverse(needed);
+    if ((vk::DeviceSize(1) << log2) < needed)
+    {
+        log2++;
+    }
+    const uint32_t order = log2 - MinBlockLog2;
+    // find the smallest free block that is big enough
+    uint32_t current = order;
+    while (current < m_orderCount && m_freeBlocks[current].empty())
+    {
+        current++;
+    }
+    if (current >= m_orderCount)
+    {
+        return Allocation();
+    }
+    const auto offset = *m_freeBlocks[current].begin();
+    m_freeBlocks[current].erase(m_freeBlocks[current].begin());
+    // split it until it has the right size. the upper halves become free blocks
+    while (current > order)
+    {
+        current--;
+        m_freeBlocks[current].insert(offset + (MinBlockSize << current));
+    }
+    const auto block = static_cast<uint32_t>(offset >> MinBlockLog2);
+    m_usedOrders[block] = order;
+    m_usedSize += MinBlockSize << order;
+    return Allocation({block, offset, size});
+}
+
+void BuddyAllocator::free(uint32_t block)
+{
+    auto uIt = m_usedOrders.find(block);
+    if (uIt == m_usedOrders.end())
+    {
+        throw std::runtime_error("Invalid or already free block!");
+    }
+    auto order = uIt->second;
+    m_usedOrders.erase(uIt);
+    m_usedSize -= MinBlockSize << order;
+    // merge with the buddy as long as it is free
+    auto offset = vk::DeviceSize(block) << MinBlockLog2;
+    while ((order + 1) < m_orderCount)
+    {
+        const auto buddy = offset ^ (MinBlockSize << order);
+        auto bIt = m_freeBlocks[order].find(buddy);
+        if (bIt == m_freeBlocks[order].end())
+        {
+            break;
+        }
+        m_freeBlocks[order].erase(bIt);
+        offset = std::min(offset, buddy);
+        order++;
+    }
+    m_freeBlocks[order].insert(offset);
+}
+
+vk::DeviceSize BuddyAllocator::size() const
+{
+    return m_size;
+}
+
+vk::DeviceSize BuddyAllocator::usedSize() const
+{
+    return m_usedSize;
+}
+
+bool BuddyAllocator::empty() const
+{
+    return m_usedOrders.empty();
+}
+
+uint32_t BuddyAllocator::freeBlockCount() const
+{
+    uint32_t count = 0;
+    for (const auto & blocks : m_freeBlocks)
+    {
+        count += static_cast<uint32_t>(blocks.size());
+    }
+    return count;
+}
+
+vk::DeviceSize BuddyAllocator::largestFreeBlock() const
+{
+    for (auto order = m_orderCount; order > 0; order--)
+    {
+        if (!m_freeBlocks[order - 1].empty())
+        {
+            return MinBlockSize << (order - 1);
+        }
+    }
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+LinearAllocator::LinearAllocator(vk::DeviceSize size)
+    : m_size(size)
+{
+}
+
+LinearAllocator::Allocation LinearAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+{
+    size = std::max(size, vk::DeviceSize(1));
+    alignment = std::max(alignment, vk::DeviceSize(1));
+    const auto aligned = ((m_top + alignment - 1) / alignment) * alignment;
+    if (aligned + size > m_size)
+    {
+        return Allocation();
+    }
+    // the block starts at the old top, so freeing it releases the padding too
+    const auto block = static_cast<uint32_t>(m_blocks.size());
+    m_blocks.push_back({m_top, size, false});
+    m_top = aligned + size;
+    m_usedSize += size;
+    return Allocation({block, aligned, size});
+}
+
+void LinearAllocator::free(uint32_t block)
+{
+    if (block >= m_blocks.size() || m_blocks[block].isFree)
+    {
+        throw std::runtime_error("Invalid or already free block!");
+    }
+    m_blocks[block].isFree = true;
+    m_usedSize -= m_blocks[block].size;
+    m_freedCount++;
+    // pop all free blocks from the top of the stack
+    while (!m_blocks.empty() && m_blocks.back().isFree)
+    {
+        m_top = m_blocks.back().offset;
+        m_blocks.pop_back();
+        m_freedCount--;
+    }
+}
+
+vk::DeviceSize LinearAllocator::size() const
+{
+    return m_size;
+}
+
+vk::DeviceSize LinearAllocator::usedSize() const
+{
+    return m_usedSize;
+}
+
+bool LinearAllocator::empty() const
+{
+    return m_blocks.empty();
+}
+
+uint32_t LinearAllocator::freeBlockCount() const
+{
+    return m_freedCount + (m_top < m_size ? 1 : 0);
+}
+
+vk::DeviceSize LinearAllocator::largestFreeBlock() const
+{
+    return m_size - m_top;
+}
+
+}
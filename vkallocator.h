@@ -0,0 +1,176 @@
+#pragma once
+
+#include "vkincludes.h"
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace vsvr
+{
+
+/// @brief Strategy used to manage free memory in MemoryPool pages.
+enum class AllocationStrategy
+{
+    eDefault = 0, // Use the strategy set for the memory type with MemoryPool::setAllocationStrategy(). TLSF if not set.
+    eTlsf = 1,    // Good-fit with O(1) allocation and coalescing. Works well for mixed sizes.
+    eBuddy = 2,   // Power-of-two blocks. Fast and fragments little for power-of-two sizes, but wastes memory for other sizes.
+    eLinear = 3,  // Stack. Memory is only reused once all blocks allocated after a block are freed too. For load-once data.
+};
+
+/// @brief Interface for allocators managing offsets in a linear range of memory.
+/// They do not touch any memory themselves, they only do the bookkeeping for MemoryPool pages.
+class PageAllocator
+{
+public:
+    static constexpr uint32_t InvalidBlock = UINT32_MAX;
+
+    /// @brief Result of an allocation. block is InvalidBlock if the allocation failed.
+    struct Allocation
+    {
+        uint32_t block = InvalidBlock; // Block index. Pass this to free().
+        vk::DeviceSize offset = 0;     // Aligned offset of allocation in range.
+        vk::DeviceSize size = 0;       // Size of allocation.
+    };
+
+    /// @brief Create allocator for strategy managing the range [0, size).
+    static std::unique_ptr<PageAllocator> create(AllocationStrategy strategy, vk::DeviceSize size);
+
+    virtual ~PageAllocator() = default;
+
+    /// @brief Allocate a block of size with its offset aligned to alignment.
+    /// @return Allocation with block == InvalidBlock if there is no free block big enough.
+    virtual Allocation allocate(vk::DeviceSize size, vk::DeviceSize alignment) = 0;
+
+    /// @brief Free a block returned by allocate().
+    virtual void free(uint32_t block) = 0;
+
+    /// @brief Get size of managed range.
+    virtual vk::DeviceSize size() const = 0;
+    /// @brief Get number of bytes in allocated blocks.
+    virtual vk::DeviceSize usedSize() const = 0;
+    /// @brief Returns true if there are no allocated blocks.
+    virtual bool empty() const = 0;
+    /// @brief Get number of free blocks.
+    virtual uint32_t freeBlockCount() const = 0;
+    /// @brief Get size of the largest block that can be allocated.
+    virtual vk::DeviceSize largestFreeBlock() const = 0;
+};
+
+/// @brief Two-level segregated fit (TLSF) allocator.
+/// Free blocks are kept in size-segregated bins indexed by two bitmaps, so finding a free block
+/// and freeing a block (including coalescing with free neighbours) is O(1), no matter how many blocks are live.
+class TlsfAllocator: public PageAllocator
+{
+public:
+    /// @brief Create allocator managing the range [0, size).
+    TlsfAllocator(vk::DeviceSize size = 0);
+
+    Allocation allocate(vk::DeviceSize size, vk::DeviceSize alignment) override;
+    /// @brief Free a block returned by allocate(). Coalesces it with free neighbours.
+    void free(uint32_t block) override;
+    vk::DeviceSize size() const override;
+    vk::DeviceSize usedSize() const override;
+    bool empty() const override;
+    uint32_t freeBlockCount() const override;
+    vk::DeviceSize largestFreeBlock() const override;
+
+private:
+    static constexpr uint32_t SecondLevelLog2 = 5;
+    static constexpr uint32_t SecondLevelCount = 1 << SecondLevelLog2;
+    static constexpr uint32_t FirstLevelCount = 64 - SecondLevelLog2 + 1;
+
+    struct BlockInfo
+    {
+        vk::DeviceSize offset = 0;
+        vk::DeviceSize size = 0;
+        uint32_t prevPhysical = InvalidBlock; // Block before this one in memory.
+        uint32_t nextPhysical = InvalidBlock; // Block after this one in memory.
+        uint32_t prevFree = InvalidBlock;     // Previous block in free list. Also used to chain unused block records.
+        uint32_t nextFree = InvalidBlock;     // Next block in free list.
+        bool isFree = false;
+    };
+
+    static void mapping(vk::DeviceSize size, uint32_t &firstLevel, uint32_t &secondLevel);
+    uint32_t findSuitableBlock(vk::DeviceSize size) const;
+    void insertFreeBlock(uint32_t block);
+    void removeFreeBlock(uint32_t block);
+    uint32_t newBlock(vk::DeviceSize offset, vk::DeviceSize size);
+    void releaseBlock(uint32_t block);
+    uint32_t splitBlock(uint32_t block, vk::DeviceSize size);
+    void mergeWithNext(uint32_t block);
+
+    vk::DeviceSize m_size = 0;
+    vk::DeviceSize m_usedSize = 0;
+    uint32_t m_freeBlockCount = 0;
+    uint64_t m_firstLevelMap = 0;                                // Bit set if any second level bin of this first level is non-empty.
+    uint32_t m_secondLevelMap[FirstLevelCount] = {};             // Bit set if the bin contains free blocks.
+    uint32_t m_bins[FirstLevelCount][SecondLevelCount];          // Head of free list per bin.
+    std::vector<BlockInfo> m_blocks;                             // Block records. Contiguous for better locality than node-based lists.
+    uint32_t m_unusedBlocks = InvalidBlock;                      // Chain of unused block records for reuse.
+};
+
+/// @brief Binary buddy allocator.
+/// Blocks are powers of two of at least MinBlockSize and are aligned to their size. Freed blocks merge with their buddy.
+/// Allocation sizes are rounded up to the next power of two, which is counted as used.
+/// Only the largest power of two that fits into the range is managed.
+class BuddyAllocator: public PageAllocator
+{
+public:
+    static constexpr vk::DeviceSize MinBlockSize = 256;
+
+    /// @brief Create allocator managing the range [0, size).
+    BuddyAllocator(vk::DeviceSize size = 0);
+
+    Allocation allocate(vk::DeviceSize size, vk::DeviceSize alignment) override;
+    void free(uint32_t block) override;
+    vk::DeviceSize size() const override;
+    vk::DeviceSize usedSize() const override;
+    bool empty() const override;
+    uint32_t freeBlockCount() const override;
+    vk::DeviceSize largestFreeBlock() const override;
+
+private:
+    static constexpr uint32_t MinBlockLog2 = 8;
+
+    vk::DeviceSize m_size = 0;
+    vk::DeviceSize m_usedSize = 0;
+    uint32_t m_orderCount = 0;                              // Number of block sizes. Order 0 is MinBlockSize.
+    std::vector<std::set<vk::DeviceSize>> m_freeBlocks;     // Offsets of free blocks per order.
+    std::unordered_map<uint32_t, uint32_t> m_usedOrders;    // Order of allocated blocks by block index, which is offset / MinBlockSize.
+};
+
+/// @brief Linear / stack allocator.
+/// Allocating moves the top of the stack up. Freeing the top block moves it down again, past all blocks below that have been freed.
+/// Blocks freed below the top are only reused after all blocks above them have been freed.
+class LinearAllocator: public PageAllocator
+{
+public:
+    /// @brief Create allocator managing the range [0, size).
+    LinearAllocator(vk::DeviceSize size = 0);
+
+    Allocation allocate(vk::DeviceSize size, vk::DeviceSize alignment) override;
+    void free(uint32_t block) override;
+    vk::DeviceSize size() const override;
+    vk::DeviceSize usedSize() const override;
+    bool empty() const override;
+    uint32_t freeBlockCount() const override;
+    vk::DeviceSize largestFreeBlock() const override;
+
+private:
+    struct BlockInfo
+    {
+        vk::DeviceSize offset = 0; // Offset of block. Includes padding for alignment.
+        vk::DeviceSize size = 0;
+        bool isFree = false;
+    };
+
+    vk::DeviceSize m_size = 0;
+    vk::DeviceSize m_usedSize = 0;
+    vk::DeviceSize m_top = 0;             // Offset behind the top block.
+    uint32_t m_freedCount = 0;            // Number of freed blocks below the top.
+    std::vector<BlockInfo> m_blocks;      // Blocks in allocation order. Block index is index in vector.
+};
+
+}
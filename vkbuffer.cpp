@@ -2,18 +2,42 @@
 
 #include "vkutils.h"
 #include "vkdevice.h"
+#include "vkstaging.h"
+#include <algorithm>
 #include <cstring>
+#include <functional>
 #include <numeric>
+#include <sstream>
+#include <thread>
+#include <tuple>
 
 namespace vsvr
 {
 
+RawData::RawData(const void *data, vk::DeviceSize size, vk::DeviceSize offset)
+    : data(data)
+    , size(size)
+    , offset(offset)
+{
+}
+
+const void *RawData::begin() const
+{
+    return static_cast<const uint8_t *>(data) + offset;
+}
+
+vk::DeviceSize RawData::copySize() const
+{
+    return offset < size ? size - offset : 0;
+}
+
 SHAREDRESOURCE_FUNCTIONS_CPP(Buffer)
 
-Buffer::Buffer(vk::Buffer buffer, vk::DeviceSize size, vk::DeviceSize offset, const Settings &settings)
+Buffer::Buffer(vk::Buffer buffer, vk::DeviceSize size, vk::DeviceSize offset, const Settings &settings, void *data)
     : m_buffer(buffer)
     , m_size(size)
     , m_offset(offset)
+    , m_data(data)
     , m_settings(settings)
 {
 }
@@ -38,12 +62,37 @@ const Buffer::Settings &Buffer::settings() const
     return m_settings;
 }
 
+void *Buffer::data() const
+{
+    return m_data;
+}
+
+bool Buffer::Handle::isValid() const
+{
+    return index != InvalidIndex;
+}
+
+Buffer::Handle Buffer::handle() const
+{
+    return m_handle;
+}
+
+void Buffer::updateBuffer(vk::Buffer newBuffer, vk::DeviceSize newSize, vk::DeviceSize newOffset, void *newData)
+{
+    m_buffer = newBuffer;
+    m_size = newSize;
+    m_offset = newOffset;
+    m_data = newData;
+}
+
 //-------------------------------------------------------------------------------------------------
 
 std::map<vk::Device, MemoryPool::Ptr> MemoryPool::DevicePools;
+std::mutex MemoryPool::DevicePoolsMutex;
 
 MemoryPool::Ptr MemoryPool::create(vk::PhysicalDevice physicalDevice, vk::Device logicalDevice)
 {
+    std::lock_guard<std::mutex> lock(DevicePoolsMutex);
     // try to find existing pool
     auto pool = DevicePools.find(logicalDevice);
     if (pool != DevicePools.cend())
@@ -62,6 +111,12 @@ MemoryPool::MemoryPool(vk::PhysicalDevice physicalDevice, vk::Device logicalDevi
     : DeviceResource()
 {
     m_physicalDevice = physicalDevice;
+    m_hasMemoryBudget = isDeviceExtensionSupported(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    for (auto & size : m_heapAllocatedSize)
+    {
+        size = 0;
+    }
+    m_lastStatsTime = std::chrono::steady_clock::now();
     setCreated(logicalDevice);
 }
 
@@ -70,257 +125,1665 @@ MemoryPool &MemoryPool::operator=(MemoryPool &&other)
     if (&other != this)
     {
         DeviceResource::operator=(std::move(other));
+        // the mutexes stay where they are
         m_pools = std::move(other.m_pools); other.m_pools.clear();
-        m_buffers = std::move(other.m_buffers); other.m_buffers.clear();
+        m_sharedRequirements = std::move(other.m_sharedRequirements); other.m_sharedRequirements.clear();
+        m_slotChunks = std::move(other.m_slotChunks);
+        m_slotCount = other.m_slotCount.exchange(0);
+        m_freeSlots = std::move(other.m_freeSlots); other.m_freeSlots.clear();
+        m_dirtySlots = std::move(other.m_dirtySlots); other.m_dirtySlots.clear();
+        m_images = std::move(other.m_images); other.m_images.clear();
         m_physicalDevice = std::move(other.m_physicalDevice); other.m_physicalDevice = nullptr;
+        m_transferQueue = std::move(other.m_transferQueue); other.m_transferQueue = nullptr;
+        m_transferFamily = std::move(other.m_transferFamily); other.m_transferFamily = 0;
+        m_transferCommandPool = std::move(other.m_transferCommandPool); other.m_transferCommandPool = nullptr;
+        m_stagingSize = std::move(other.m_stagingSize); other.m_stagingSize = DefaultStagingSize;
+        m_stagingRing = std::move(other.m_stagingRing); other.m_stagingRing = nullptr;
+        m_hasMemoryBudget = other.m_hasMemoryBudget; other.m_hasMemoryBudget = false;
+        m_budgetLimit = other.m_budgetLimit.load();
+        for (size_t i = 0; i < m_heapAllocatedSize.size(); i++)
+        {
+            m_heapAllocatedSize[i] = other.m_heapAllocatedSize[i].exchange(0);
+        }
+        m_allocationCount = other.m_allocationCount.exchange(0);
+        m_freeCount = other.m_freeCount.exchange(0);
+        m_lastStatsAllocationCount = other.m_lastStatsAllocationCount; other.m_lastStatsAllocationCount = 0;
+        m_lastStatsTime = other.m_lastStatsTime;
+        m_frame = other.m_frame.exchange(0);
+        m_spareEmptyPages = other.m_spareEmptyPages.load();
+        m_trimIdleFrames = other.m_trimIdleFrames.load();
+        m_traceCallback = std::move(other.m_traceCallback); other.m_traceCallback = nullptr;
     }
     return *this;
 }
 
-vk::DeviceSize MemoryPool::minAligmentFor(vk::PhysicalDevice physicalDevice, vk::BufferUsageFlags usage)
+void MemoryPool::destroyResource()
 {
-    if (usage == vk::BufferUsageFlagBits::eStorageTexelBuffer)
+    // waits for pending uploads
+    m_stagingRing = nullptr;
+    // the pages of deferred blocks are freed below, but buffer objects of their own are not
+    for (const auto & block : m_deferredBlocks)
+    {
+        if (!block.page->sharedBuffer)
+        {
+            logicalDevice().destroyBuffer(block.buffer);
+        }
+    }
+    m_deferredBlocks.clear();
+    m_acquireRanges.clear();
+    for (uint32_t index = 0; index < m_slotCount; index++)
+    {
+        const auto &block = slotBlock(index);
+        if (slotBuffer(index) && !block.page->sharedBuffer)
+        {
+            logicalDevice().destroyBuffer(block.buffer);
+        }
+    }
+    for (auto & chunk : m_slotChunks)
+    {
+        chunk.reset();
+    }
+    m_slotCount = 0;
+    m_freeSlots.clear();
+    for (auto & i : m_images)
     {
-        return DeviceInfoCache::getProperties(physicalDevice).limits.minTexelBufferOffsetAlignment;
+        logicalDevice().destroyImage(i.first->image());
+    }
+    m_images.clear();
+    m_dirtySlots.clear();
+    for (auto & p : m_pools)
+    {
+        for (auto & page : p.second.pages)
+        {
+            if (page.sharedBuffer)
+            {
+                logicalDevice().destroyBuffer(page.sharedBuffer);
+            }
+            logicalDevice().freeMemory(page.memory);
+        }
     }
-    else if (usage == vk::BufferUsageFlagBits::eUniformBuffer)
+    m_pools.clear();
+    m_sharedRequirements.clear();
+    for (auto & size : m_heapAllocatedSize)
     {
-        return DeviceInfoCache::getProperties(physicalDevice).limits.minUniformBufferOffsetAlignment;
+        size = 0;
     }
-    else if (usage == vk::BufferUsageFlagBits::eStorageBuffer)
+    if (m_transferCommandPool)
     {
-        return DeviceInfoCache::getProperties(physicalDevice).limits.minStorageBufferOffsetAlignment;
+        logicalDevice().destroyCommandPool(m_transferCommandPool);
+        m_transferCommandPool = nullptr;
     }
-    return 64;
 }
 
-Buffer::Ptr MemoryPool::createBuffer(vk::DeviceSize size, const Buffer::Settings &settings)
+void MemoryPool::setTransferQueue(vk::Queue queue, uint32_t queueFamilyIndex, vk::DeviceSize stagingSize, uint32_t dstQueueFamilyIndex)
 {
-    vk::BufferCreateInfo bufferInfo({}, size, settings.usage, settings.sharingMode);
-    auto buffer = logicalDevice().createBuffer(bufferInfo);
-    auto blockIt = allocateMemory(buffer, size, settings);
-    blockIt->buffer = buffer;
-    logicalDevice().bindBufferMemory(buffer, blockIt->page->memory, blockIt->offset);
-    auto sharedBuffer = std::make_shared<Buffer>(buffer, blockIt->size, blockIt->offset, settings);
-    m_buffers[sharedBuffer] = blockIt;
-    return sharedBuffer;
+    // create the staging ring buffer before locking, because creating buffers locks the pools
+    Buffer::Settings settings;
+    settings.usage = vk::BufferUsageFlagBits::eTransferSrc;
+    settings.properties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    auto ringBuffer = createBuffer(stagingSize, settings);
+    Buffer::Ptr oldRingBuffer;
+    {
+        std::lock_guard<std::mutex> lock(m_transferMutex);
+        if (m_stagingRing)
+        {
+            // the staging ring uses command buffers from the old pool and might need a different size
+            oldRingBuffer = m_stagingRing->buffer();
+            m_stagingRing = nullptr;
+        }
+        if (m_transferCommandPool)
+        {
+            logicalDevice().destroyCommandPool(m_transferCommandPool);
+        }
+        m_transferQueue = queue;
+        m_transferFamily = queueFamilyIndex;
+        m_dstFamily = dstQueueFamilyIndex;
+        m_stagingSize = stagingSize;
+        m_transferCommandPool = createCommandPool(logicalDevice(), queueFamilyIndex, vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
+        m_stagingRing = std::make_shared<StagingRing>(logicalDevice(), ringBuffer);
+    }
+    if (oldRingBuffer)
+    {
+        destroyBuffer(oldRingBuffer);
+    }
 }
 
-std::vector<Buffer::Ptr> MemoryPool::createBuffers(const std::vector<vk::DeviceSize> &sizes, const Buffer::Settings &settings)
+vk::CommandBuffer MemoryPool::beginTransferCommands()
 {
-    std::vector<Buffer::Ptr> buffers;
-    std::transform(sizes.cbegin(), sizes.cend(), std::back_inserter(buffers), [this, settings](const auto & s){ return createBuffer(s, settings); });
-    return buffers;
+    if (!m_transferQueue)
+    {
+        throw std::runtime_error("No transfer queue set!");
+    }
+    auto commandBuffer = allocateCommandBuffers(logicalDevice(), m_transferCommandPool, 1).front();
+    commandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+    return commandBuffer;
 }
 
-MemoryPool::Page MemoryPool::allocatePage(MemoryPool::Pool::Iter pool, vk::DeviceSize pageSize)
+void MemoryPool::submitTransferCommandsAndWait(vk::CommandBuffer commandBuffer)
 {
-    MemoryPool::Page page;
-    vk::MemoryAllocateInfo allocInfo(pageSize, pool->second.memoryTypeIndex);
-    page.memory = logicalDevice().allocateMemory(allocInfo);
-    // add free block that spans the whole page
-    page.blocks.emplace_front(Block({nullptr, pageSize, 0, 0}));
-    page.pool = pool;
-    return page;
+    commandBuffer.end();
+    auto fence = logicalDevice().createFence(vk::FenceCreateInfo());
+    vk::SubmitInfo submitInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    m_transferQueue.submit(1, &submitInfo, fence);
+    logicalDevice().waitForFences(1, &fence, VK_TRUE, UINT64_MAX);
+    logicalDevice().destroyFence(fence);
+    logicalDevice().freeCommandBuffers(m_transferCommandPool, 1, &commandBuffer);
+}
+
+uint64_t MemoryPool::submitTransferCommands(vk::CommandBuffer commandBuffer, const std::vector<AcquireRange> &acquireRanges)
+{
+    commandBuffer.end();
+    // the staging ring regions used by the commands are recycled and the command buffer freed when the fence signals.
+    // then blocks written by the commands can be released and the ranges released to the destination family acquired
+    // the caller holds the transfer lock, so the id is only published once the submission went through
+    const uint64_t id = m_uploadId + 1;
+    auto fence = stagingRing().commit([this, commandBuffer, id, acquireRanges]()
+    {
+        logicalDevice().freeCommandBuffers(m_transferCommandPool, 1, &commandBuffer);
+        m_acquireRanges.insert(m_acquireRanges.end(), acquireRanges.cbegin(), acquireRanges.cend());
+        m_completedUploadId = id;
+    });
+    vk::SubmitInfo submitInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    try
+    {
+        m_transferQueue.submit(1, &submitInfo, fence);
+    }
+    catch (...)
+    {
+        // the fence would never signal, so waiting for the upload would block forever and the staging space never be reclaimed
+        stagingRing().rollback();
+        logicalDevice().freeCommandBuffers(m_transferCommandPool, 1, &commandBuffer);
+        throw;
+    }
+    m_uploadId = id;
+    return id;
 }
 
-vk::DeviceSize MemoryPool::getOffsetShiftForAlignment(const MemoryPool::Block::Iter block, vk::DeviceSize requiredAlignment)
+StagingRing &MemoryPool::stagingRing()
 {
-    // if the offset is not zero and not aligned with the required alignment
-    // the usable size of the block shrinks as we need to increase the offset...
-    auto alignmentDiff = (block->offset % requiredAlignment);
-    return (alignmentDiff > 0 ? (requiredAlignment - alignmentDiff) : 0);
+    if (!m_stagingRing)
+    {
+        throw std::runtime_error("No transfer queue set!");
+    }
+    return *m_stagingRing;
 }
 
-vk::DeviceSize MemoryPool::getUsableBlockSizeForAlignment(const MemoryPool::Block::Iter block, vk::DeviceSize requiredAlignment)
+bool MemoryPool::needsOwnershipTransfer(const Buffer::Settings &settings) const
 {
-    // if the offset is not zero and not aligned with the required alignment
-    // the usable size of the block shrinks as we need to increase the offset...
-    return block->size - getOffsetShiftForAlignment(block, requiredAlignment);
+    // buffers with concurrent sharing do not need an ownership transfer
+    return m_dstFamily != VK_QUEUE_FAMILY_IGNORED && m_dstFamily != m_transferFamily && settings.sharingMode == vk::SharingMode::eExclusive;
 }
 
-MemoryPool::Block::Iter MemoryPool::getFreeBlockAligned(MemoryPool::Pool::Iter pool, vk::DeviceSize requiredSize, vk::DeviceSize requiredAlignment)
+uint64_t MemoryPool::uploadStaged(const StagedUpload &upload)
 {
-    if (requiredSize > DefaultPageSize)
-    {
-        throw std::runtime_error("Allocation size too big!");
-    }
-    for (auto & page : pool->second.pages)
+    std::lock_guard<std::mutex> lock(m_transferMutex);
+    // split data that does not fit into the staging ring into multiple submissions
+    const auto &block = upload.block;
+    const auto chunkSize = stagingRing().size() / 2;
+    const auto offset = bufferOffset(block) + upload.offset;
+    const auto srcFamily = upload.release ? m_transferFamily : VK_QUEUE_FAMILY_IGNORED;
+    const auto dstFamily = upload.release ? m_dstFamily : VK_QUEUE_FAMILY_IGNORED;
+    uint64_t id = 0;
+    vk::DeviceSize done = 0;
+    while (done < upload.size)
     {
-        // try to find a free block
-        auto block = page.blocks.begin();
-        while (block != page.blocks.end())
+        const auto copySize = std::min(upload.size - done, chunkSize);
+        auto region = stagingRing().allocate(copySize);
+        std::memcpy(region.data, static_cast<const uint8_t *>(upload.data) + done, copySize);
+        auto commandBuffer = beginTransferCommands();
+        vk::BufferCopy copyRegion(region.offset, offset + done, copySize);
+        commandBuffer.copyBuffer(region.buffer, block.buffer, 1, &copyRegion);
+        // make the data visible to all following commands reading the buffer or release it to the destination family
+        vk::BufferMemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite, upload.release ? vk::AccessFlags() : vk::AccessFlags(vk::AccessFlagBits::eMemoryRead), srcFamily, dstFamily, block.buffer, offset + done, copySize);
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, 0, nullptr, 1, &barrier, 0, nullptr);
+        std::vector<AcquireRange> acquireRanges;
+        if (upload.release)
         {
-            // check if block is free
-            if (!block->buffer)
-            {
-                auto freeBlock = block; // just for readability
-                // check if the block is big enough with alignment
-                const auto usableBlockSize = getUsableBlockSizeForAlignment(freeBlock, requiredAlignment);
-                if (usableBlockSize >= requiredSize)
-                {
-                    // found a block. split it up
-                    const auto offsetShift = getOffsetShiftForAlignment(freeBlock, requiredAlignment);
-                    if (offsetShift > 0)
-                    {
-                        // if we must shift the offset we insert a free block before, so the previous block might use the memory if it expands
-                        page.blocks.insert(block, Block({nullptr, offsetShift, block->offset, 0}));
-                        // and shift the free block back by the same offset
-                        freeBlock->offset += offsetShift;
-                        freeBlock->size -= offsetShift;
-                    }
-                    // insert our block. note that the free blocks offset is already adjusted to the alignment we need
-                    auto newBlock = page.blocks.insert(block, Block({nullptr, requiredSize, freeBlock->offset, requiredAlignment}));
-                    // and shift the following free block behind back
-                    freeBlock->offset += requiredSize;
-                    freeBlock->size -= requiredSize;
-                    return newBlock;
-                }
-            }
-            ++block;
+            acquireRanges.push_back({upload.handle, block.buffer, block.offset, offset + done, copySize});
         }
+        id = submitTransferCommands(commandBuffer, acquireRanges);
+        done += copySize;
     }
-    // when we get here, we haven't found a block so we need to allocate a new page
-    auto newPage = allocatePage(pool, DefaultPageSize);
-    // this memory starts at offset 0 in a fresh memory object, so alignment is not an issue
-    auto newBlock = newPage.blocks.insert(newPage.blocks.begin(), Block({nullptr, requiredSize, 0, requiredAlignment}));
-    pool->second.pages.push_back(newPage);
-    return newBlock;
+    return id;
 }
 
-MemoryPool::Block::Iter MemoryPool::allocateMemory(vk::Buffer buffer, vk::DeviceSize size, const Buffer::Settings &settings)
+void MemoryPool::setTraceCallback(TraceCallback callback)
 {
-    // find out memory requirements and type for buffer
-    vk::MemoryRequirements memRequirements = logicalDevice().getBufferMemoryRequirements(buffer);
-    auto memTypeIndex = findMemoryTypeIndex(m_physicalDevice, memRequirements.memoryTypeBits, settings.properties);
-    // check if memory pool for this type exists
-    auto mpIt = m_pools.find(memTypeIndex);
-    if (mpIt == m_pools.cend())
+    m_traceCallback = callback;
+}
+
+void MemoryPool::trace(TraceEvent::Type type, Buffer::Handle handle, vk::DeviceSize size, vk::DeviceSize alignment) const
+{
+    if (m_traceCallback)
     {
-        // no. allocate new pool
-        mpIt = m_pools.insert(m_pools.end(), std::make_pair(memTypeIndex, Pool()));
-        mpIt->second.memoryTypeIndex = memTypeIndex;
-        mpIt->second.pages.emplace_front(allocatePage(mpIt, DefaultPageSize));
+        TraceEvent event;
+        event.type = type;
+        event.handle = handle;
+        event.size = size;
+        event.alignment = alignment;
+        m_traceCallback(event);
+    }
+}
+
+vk::DeviceSize MemoryPool::minAligmentFor(vk::PhysicalDevice physicalDevice, vk::BufferUsageFlags usage)
+{
+    // a buffer can be bound in all ways its usage allows, so it needs the largest alignment of them
+    const auto &limits = DeviceInfoCache::getProperties(physicalDevice).limits;
+    vk::DeviceSize alignment = 0;
+    if (usage & (vk::BufferUsageFlagBits::eUniformTexelBuffer | vk::BufferUsageFlagBits::eStorageTexelBuffer))
+    {
+        alignment = std::max(alignment, limits.minTexelBufferOffsetAlignment);
+    }
+    if (usage & vk::BufferUsageFlagBits::eUniformBuffer)
+    {
+        alignment = std::max(alignment, limits.minUniformBufferOffsetAlignment);
+    }
+    if (usage & vk::BufferUsageFlagBits::eStorageBuffer)
+    {
+        alignment = std::max(alignment, limits.minStorageBufferOffsetAlignment);
+    }
+    return alignment > 0 ? alignment : 64;
+}
+
+vk::Buffer MemoryPool::createBufferObject(vk::DeviceSize size, const Buffer::Settings &settings)
+{
+    // buffers can always be copied from and to, so we can move them around when defragmenting
+    const auto usage = settings.usage | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
+    vk::BufferCreateInfo bufferInfo({}, size, usage, settings.sharingMode);
+    return logicalDevice().createBuffer(bufferInfo);
+}
+
+std::mutex &MemoryPool::slotMutex(uint32_t index)
+{
+    return m_slotLocks[index % SlotLockCount];
+}
+
+MemoryPool::Block &MemoryPool::slotBlock(uint32_t index)
+{
+    return m_slotChunks[index / SlotChunkSize]->blocks[index % SlotChunkSize];
+}
+
+Buffer::Ptr &MemoryPool::slotBuffer(uint32_t index)
+{
+    return m_slotChunks[index / SlotChunkSize]->buffers[index % SlotChunkSize];
+}
+
+MemoryPool::DirtyRange &MemoryPool::slotDirtyRange(uint32_t index)
+{
+    return m_slotChunks[index / SlotChunkSize]->dirty[index % SlotChunkSize];
+}
+
+void MemoryPool::addDirtyRange(uint32_t index, vk::DeviceSize offset, vk::DeviceSize size)
+{
+    // the caller holds the slot lock
+    auto &range = slotDirtyRange(index);
+    if (range.end <= range.begin)
+    {
+        range.begin = offset;
+        range.end = offset + size;
+        std::lock_guard<std::mutex> lock(m_dirtyMutex);
+        m_dirtySlots.push_back(index);
+    }
+    else
+    {
+        // we keep one range per buffer. flushing a few bytes too much is cheaper than tracking many ranges
+        range.begin = std::min(range.begin, offset);
+        range.end = std::max(range.end, offset + size);
     }
-    // find first free block of appropriate size and properly aligned
-    return getFreeBlockAligned(mpIt, size, memRequirements.alignment);
 }
 
-void MemoryPool::combineBlockWithFreeNeighbours(Block::Iter block)
+uint32_t MemoryPool::flushDirtyRanges()
 {
-    auto &blocks = block->page->blocks;
-    if (block != blocks.cbegin())
+    // the caller holds all slot locks, so buffers can not be destroyed or moved
+    std::vector<uint32_t> dirtySlots;
     {
-        // not the first block, combine with previous block if free
-        auto prevIt = std::prev(block);
-        if (!prevIt->buffer)
+        std::lock_guard<std::mutex> lock(m_dirtyMutex);
+        dirtySlots.swap(m_dirtySlots);
+    }
+    const auto atomSize = DeviceInfoCache::getProperties(m_physicalDevice).limits.nonCoherentAtomSize;
+    std::vector<vk::MappedMemoryRange> ranges;
+    for (auto index : dirtySlots)
+    {
+        auto &range = slotDirtyRange(index);
+        // the range is empty if the slot has been listed twice or the buffer has been destroyed
+        if (range.end <= range.begin || !slotBuffer(index))
         {
-            block->size += prevIt->size;
-            block->offset = prevIt->offset;
+            continue;
         }
-        blocks.erase(prevIt);
+        // flushed ranges must start and end on a multiple of nonCoherentAtomSize or at the end of the memory
+        const auto &block = slotBlock(index);
+        const auto begin = ((block.offset + range.begin) / atomSize) * atomSize;
+        const auto end = std::min(((block.offset + std::min(range.end, block.size) + atomSize - 1) / atomSize) * atomSize, block.page->allocator->size());
+        ranges.push_back(vk::MappedMemoryRange(block.page->memory, begin, end - begin));
+        range = DirtyRange();
+    }
+    if (!ranges.empty())
+    {
+        logicalDevice().flushMappedMemoryRanges(static_cast<uint32_t>(ranges.size()), ranges.data());
     }
-    // coalesce free memory with next
-    if (block != blocks.cend())
+    return static_cast<uint32_t>(ranges.size());
+}
+
+void MemoryPool::writeRange(uint32_t index, vk::DeviceSize dstOffset, const RawData &data)
+{
+    // the caller holds the slot lock
+    auto &block = slotBlock(index);
+    const auto size = data.copySize();
+    if (block.page->mapped)
     {
-        // not the last block, combine with next block if free
-        auto nextIt = std::next(block);
-        if (!nextIt->buffer)
+        std::memcpy(static_cast<uint8_t *>(blockData(block)) + dstOffset, data.begin(), size);
+        if (!block.page->coherent && size > 0)
         {
-            block->size += nextIt->size;
+            addDirtyRange(index, dstOffset, size);
         }
-        blocks.erase(nextIt);
     }
+    else if (size > 0)
+    {
+        const auto &buffer = slotBuffer(index);
+        StagedUpload upload;
+        upload.block = block;
+        upload.offset = dstOffset;
+        upload.data = data.begin();
+        upload.size = size;
+        upload.handle = buffer->handle();
+        upload.release = needsOwnershipTransfer(buffer->settings());
+        block.uploadId = uploadStaged(upload);
+    }
+}
+
+bool MemoryPool::isValidSlot(Buffer::Handle handle) const
+{
+    // the slot count is only increased after the chunk has been created, so the chunk exists if the index is below it
+    if (handle.index >= m_slotCount)
+    {
+        return false;
+    }
+    const auto &chunk = *m_slotChunks[handle.index / SlotChunkSize];
+    const auto i = handle.index % SlotChunkSize;
+    return chunk.buffers[i] && chunk.generations[i] == handle.generation;
 }
 
-MemoryPool::Block::Iter MemoryPool::reallocateMemory(Buffer::Ptr buffer, vk::DeviceSize size)
+Buffer::Handle MemoryPool::allocateSlot(const Buffer::Ptr &buffer, const Block &block)
 {
-    // try to find buffer and block
-    auto bmIt = m_buffers.find(buffer);
-    if (bmIt != m_buffers.end())
+    uint32_t index = 0;
     {
-        auto newSize = buffer->size();
-        // check if we need to grow the buffer
-        if (size > buffer->size())
+        std::lock_guard<std::mutex> lock(m_slotsMutex);
+        if (!m_freeSlots.empty())
+        {
+            index = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        }
+        else
         {
-            if (buffer->settings().reallocStrategy == Buffer::ReallocStrategy::eGrow)
+            if (m_slotCount >= SlotChunkSize * MaxSlotChunks)
             {
-                newSize = size;
+                throw std::runtime_error("Too many buffers!");
             }
-            else if (buffer->settings().reallocStrategy == Buffer::ReallocStrategy::eGrowOverprovision ||
-                     buffer->settings().reallocStrategy == Buffer::ReallocStrategy::eGrowOverprovisionAndShrink)
+            if (m_slotCount % SlotChunkSize == 0)
             {
-                newSize = (size * 105) / 100;
+                m_slotChunks[m_slotCount / SlotChunkSize].reset(new SlotChunk());
             }
-            // do nothing for fixed size buffers
+            index = m_slotCount++;
         }
-        // check if we need to shrink the buffer
-        else if (size < ((buffer->size() * 75) / 100))
+    }
+    std::lock_guard<std::mutex> lock(slotMutex(index));
+    auto &chunk = *m_slotChunks[index / SlotChunkSize];
+    const auto i = index % SlotChunkSize;
+    chunk.blocks[i] = block;
+    chunk.buffers[i] = buffer;
+    Buffer::Handle handle;
+    handle.index = index;
+    handle.generation = chunk.generations[i];
+    buffer->m_handle = handle;
+    trace(TraceEvent::Type::eCreate, handle, block.size, block.requiredAlignment);
+    return handle;
+}
+
+MemoryPool::Block MemoryPool::allocateBuffer(vk::DeviceSize size, const Buffer::Settings &settings)
+{
+    if (settings.subAllocate && settings.sharingMode == vk::SharingMode::eExclusive)
+    {
+        return allocateSharedMemory(size, settings);
+    }
+    return allocateUnsharedBuffer(size, settings);
+}
+
+MemoryPool::Block MemoryPool::allocateUnsharedBuffer(vk::DeviceSize size, const Buffer::Settings &settings)
+{
+    auto buffer = createBufferObject(size, settings);
+    Block block;
+    try
+    {
+        block = allocateMemory(buffer, size, settings);
+    }
+    catch (...)
+    {
+        // running out of memory or budget is expected, so do not leak the buffer object
+        logicalDevice().destroyBuffer(buffer);
+        throw;
+    }
+    block.buffer = buffer;
+    logicalDevice().bindBufferMemory(buffer, block.page->memory, block.offset);
+    return block;
+}
+
+void MemoryPool::releaseBuffer(const Block &block)
+{
+    // the device might still copy staged data to the block. keep it until the copy has finished
+    if (block.uploadId > m_completedUploadId)
+    {
+        std::lock_guard<std::mutex> lock(m_deferredMutex);
+        m_deferredBlocks.push_back(block);
+        return;
+    }
+    destroyBlock(block);
+}
+
+void MemoryPool::destroyBlock(const Block &block)
+{
+    // the shared buffer of a page lives as long as the page
+    if (!block.page->sharedBuffer)
+    {
+        logicalDevice().destroyBuffer(block.buffer);
+    }
+    freeBlock(block);
+}
+
+void MemoryPool::releaseDeferredBlocks()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_deferredMutex);
+        if (m_deferredBlocks.empty())
         {
-            if (buffer->settings().reallocStrategy == Buffer::ReallocStrategy::eGrowOverprovisionAndShrink)
-            {
-                newSize = size;
-            }
+            return;
         }
-        auto block = bmIt->second;
-        // check if we need to reallocate
-        if (newSize != buffer->size())
-        {
-            // coalesce block with free free blocks before or behind
-            combineBlockWithFreeNeighbours(block);
-            // now find a new block
-            auto requiredAlignment = block->requiredAlignment;
-            block->buffer = nullptr;
-            block->requiredAlignment = 0;
-            auto newBlock = getFreeBlockAligned(block->page->pool, newSize, requiredAlignment);
-            // rebind memory
-            logicalDevice().bindBufferMemory(buffer->buffer(), newBlock->page->memory, newBlock->offset);
-            buffer->updateBuffer(block->size, block->offset);
+    }
+    // find out which uploads have finished
+    {
+        std::lock_guard<std::mutex> lock(m_transferMutex);
+        if (m_stagingRing)
+        {
+            m_stagingRing->retire();
         }
-        return block;
     }
-    throw std::runtime_error("Unknown buffer!");
+    std::vector<Block> blocks;
+    {
+        std::lock_guard<std::mutex> lock(m_deferredMutex);
+        const uint64_t completedId = m_completedUploadId;
+        auto finished = std::partition(m_deferredBlocks.begin(), m_deferredBlocks.end(), [completedId](const Block & b){ return b.uploadId > completedId; });
+        blocks.assign(finished, m_deferredBlocks.end());
+        m_deferredBlocks.erase(finished, m_deferredBlocks.end());
+    }
+    for (const auto & block : blocks)
+    {
+        destroyBlock(block);
+    }
+}
+
+vk::MemoryPropertyFlags MemoryPool::memoryProperties(vk::MemoryPropertyFlags properties, MemoryUsage memoryUsage)
+{
+    // with a usage the memory type is picked by score. properties still set would rule out the best types
+    return memoryUsage == MemoryUsage::eUnknown ? properties : vk::MemoryPropertyFlags();
+}
+
+vk::DeviceSize MemoryPool::bufferOffset(const Block &block)
+{
+    // a buffer object of its own is bound at the start of the block
+    return block.page->sharedBuffer ? block.offset : 0;
+}
+
+Buffer::Ptr MemoryPool::createBuffer(vk::DeviceSize size, const Buffer::Settings &settings)
+{
+    auto block = allocateBuffer(size, settings);
+    auto sharedBuffer = std::make_shared<Buffer>(block.buffer, block.size, bufferOffset(block), settings, blockData(block));
+    allocateSlot(sharedBuffer, block);
+    return sharedBuffer;
+}
+
+std::vector<Buffer::Ptr> MemoryPool::createBuffers(const std::vector<vk::DeviceSize> &sizes, const Buffer::Settings &settings)
+{
+    std::vector<Buffer::Ptr> buffers;
+    std::transform(sizes.cbegin(), sizes.cend(), std::back_inserter(buffers), [this, settings](const auto & s){ return createBuffer(s, settings); });
+    return buffers;
+}
+
+void MemoryPool::setAllocationStrategy(uint32_t memoryTypeIndex, AllocationStrategy strategy)
+{
+    // existing pages keep their strategy
+    getPool(memoryTypeIndex)->second.strategy = strategy == AllocationStrategy::eDefault ? AllocationStrategy::eTlsf : strategy;
 }
 
-void MemoryPool::updateBuffer(Buffer::Ptr buffer, const RawData &data)
+void MemoryPool::setPageSize(uint32_t memoryTypeIndex, vk::DeviceSize pageSize)
 {
-    auto block = reallocateMemory(buffer, data.size);
-    if (data.size > buffer->size())
+    if (pageSize == 0)
     {
-        throw std::runtime_error("Data too big for buffer!");
+        throw std::runtime_error("Page size must be > 0!");
     }
-    void *dst = logicalDevice().mapMemory(block->page->memory, buffer->offset(), data.size);
-    std::memcpy(dst, data.data, data.size);
-    logicalDevice().unmapMemory(block->page->memory);
+    // existing pages keep their size
+    getPool(memoryTypeIndex)->second.pageSize = pageSize;
 }
 
-void MemoryPool::updateBuffers(const std::vector<Buffer::Ptr> &buffers, const std::vector<RawData> &data)
+vk::DeviceSize MemoryPool::pageSize(uint32_t memoryTypeIndex)
 {
-    for (size_t i = 0; i < buffers.size(); i++)
+    return getPool(memoryTypeIndex)->second.pageSize;
+}
+
+void MemoryPool::setTrimPolicy(uint32_t spareEmptyPages, uint32_t idleFrames)
+{
+    m_spareEmptyPages = spareEmptyPages;
+    m_trimIdleFrames = idleFrames;
+}
+
+uint32_t MemoryPool::nextFrame()
+{
+    m_frame++;
+    releaseDeferredBlocks();
+    return releaseEmptyPages(m_spareEmptyPages, m_trimIdleFrames);
+}
+
+uint32_t MemoryPool::trim()
+{
+    releaseDeferredBlocks();
+    return releaseEmptyPages(0, 0);
+}
+
+uint64_t MemoryPool::lastUploadId() const
+{
+    return m_uploadId;
+}
+
+bool MemoryPool::isUploadComplete(uint64_t id)
+{
+    if (m_completedUploadId >= id)
     {
-        updateBuffer(buffers[i], data[i]);
+        return true;
     }
+    std::lock_guard<std::mutex> lock(m_transferMutex);
+    if (m_stagingRing)
+    {
+        m_stagingRing->retire();
+    }
+    return m_completedUploadId >= id;
 }
 
-void MemoryPool::destroyBuffer(Buffer::Ptr buffer)
+void MemoryPool::waitForUpload(uint64_t id)
 {
-    auto bmIt = m_buffers.find(buffer);
-    if (bmIt != m_buffers.end())
+    std::lock_guard<std::mutex> lock(m_transferMutex);
+    while (m_completedUploadId < id && m_stagingRing && m_stagingRing->waitOldest())
     {
-        auto block = bmIt->second;
-        // remove from map
-        m_buffers.erase(bmIt);
-        // free buffer and memory
-        logicalDevice().destroyBuffer(block->buffer);
-        block->buffer = nullptr;
-        // coalesce free memory
-        combineBlockWithFreeNeighbours(block);
     }
 }
 
-void MemoryPool::destroyBuffers(const std::vector<Buffer::Ptr> &buffers)
+void MemoryPool::recordAcquireBarriers(vk::CommandBuffer commandBuffer, vk::PipelineStageFlags dstStages)
 {
-    std::for_each(buffers.cbegin(), buffers.cend(), [this](const auto & b){ return destroyBuffer(b); });
+    std::vector<AcquireRange> ranges;
+    {
+        std::lock_guard<std::mutex> lock(m_transferMutex);
+        if (m_stagingRing)
+        {
+            m_stagingRing->retire();
+        }
+        ranges.swap(m_acquireRanges);
+    }
+    std::vector<vk::BufferMemoryBarrier> barriers;
+    for (const auto & range : ranges)
+    {
+        // the buffer object might be gone if the buffer has been destroyed or reallocated since
+        std::lock_guard<std::mutex> lock(slotMutex(range.handle.index));
+        if (isValidSlot(range.handle) && slotBlock(range.handle.index).buffer == range.buffer && slotBlock(range.handle.index).offset == range.blockOffset)
+        {
+            barriers.push_back(vk::BufferMemoryBarrier(vk::AccessFlags(), vk::AccessFlagBits::eMemoryRead, m_transferFamily, m_dstFamily, range.buffer, range.offset, range.size));
+        }
+    }
+    if (!barriers.empty())
+    {
+        // the release on the transfer queue has finished, so there is nothing to wait for on the source side
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, dstStages, {}, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+    }
+}
+
+uint32_t MemoryPool::releaseEmptyPages(uint32_t spareEmptyPages, uint32_t idleFrames)
+{
+    uint32_t freedPages = 0;
+    std::lock_guard<std::mutex> poolsLock(m_poolsMutex);
+    for (auto pool = m_pools.begin(); pool != m_pools.end(); ++pool)
+    {
+        // we need the exclusive lock to remove pages. no thread can allocate from or free to the pool then,
+        // so pages stay empty and we do not need to lock them
+        std::unique_lock<std::shared_timed_mutex> poolLock(pool->second.mutex);
+        freedPages += releaseEmptyPagesLocked(pool, spareEmptyPages, idleFrames);
+    }
+    return freedPages;
+}
+
+uint32_t MemoryPool::releaseEmptyPagesLocked(Pool::Iter pool, uint32_t spareEmptyPages, uint32_t idleFrames)
+{
+    const uint64_t frame = m_frame;
+    std::vector<Page::Iter> emptyPages;
+    for (auto page = pool->second.pages.begin(); page != pool->second.pages.end(); ++page)
+    {
+        // dedicated pages are released with their buffer
+        if (!page->dedicated && page->allocator->empty())
+        {
+            emptyPages.push_back(page);
+        }
+    }
+    if (emptyPages.size() <= spareEmptyPages)
+    {
+        return 0;
+    }
+    // keep the pages that became empty last as spares and release the ones idle the longest
+    std::sort(emptyPages.begin(), emptyPages.end(), [](const Page::Iter & a, const Page::Iter & b){ return a->emptySince < b->emptySince; });
+    const auto releaseCount = emptyPages.size() - spareEmptyPages;
+    uint32_t freedPages = 0;
+    for (size_t i = 0; i < releaseCount; i++)
+    {
+        if (frame - emptyPages[i]->emptySince >= idleFrames)
+        {
+            freePage(emptyPages[i]);
+            freedPages++;
+        }
+    }
+    return freedPages;
 }
 
-}
\ No newline at end of file
+MemoryPool::Pool::Iter MemoryPool::getPool(uint32_t memTypeIndex)
+{
+    std::lock_guard<std::mutex> lock(m_poolsMutex);
+    // check if memory pool for this type exists
+    auto mpIt = m_pools.find(memTypeIndex);
+    if (mpIt == m_pools.end())
+    {
+        // no. allocate new pool. map iterators stay valid when inserting, so the pool can be used after unlocking
+        mpIt = m_pools.emplace(std::piecewise_construct, std::forward_as_tuple(memTypeIndex), std::forward_as_tuple()).first;
+        mpIt->second.memoryTypeIndex = memTypeIndex;
+        mpIt->second.heapIndex = DeviceInfoCache::getMemoryProperties(m_physicalDevice).memoryTypes[memTypeIndex].heapIndex;
+    }
+    return mpIt;
+}
+
+MemoryPool::Page::Iter MemoryPool::allocatePage(MemoryPool::Pool::Iter pool, vk::DeviceSize pageSize, AllocationStrategy strategy, const vk::MemoryDedicatedAllocateInfo *dedicatedInfo, vk::BufferUsageFlags sharedUsage, bool optimalImages)
+{
+    // buffers are sub-allocated from a buffer spanning the whole page. its memory requirements might differ from
+    // the buffer the memory type was picked with, e.g. the driver may pad the size, so check them on the buffer itself
+    vk::Buffer sharedBuffer = nullptr;
+    vk::DeviceSize memorySize = pageSize;
+    if (sharedUsage)
+    {
+        vk::BufferCreateInfo bufferInfo({}, pageSize, sharedUsage, vk::SharingMode::eExclusive);
+        sharedBuffer = logicalDevice().createBuffer(bufferInfo);
+        const auto requirements = logicalDevice().getBufferMemoryRequirements(sharedBuffer);
+        if ((requirements.memoryTypeBits & (1u << pool->second.memoryTypeIndex)) == 0)
+        {
+            logicalDevice().destroyBuffer(sharedBuffer);
+            throw std::runtime_error("Memory type can not be used for shared buffer!");
+        }
+        memorySize = std::max(memorySize, requirements.size);
+    }
+    vk::DeviceMemory memory = nullptr;
+    try
+    {
+        // fail before the driver does or starts paging memory
+        if (!isWithinBudget(pool->second.memoryTypeIndex, memorySize))
+        {
+            throw std::runtime_error("Memory budget exceeded!");
+        }
+        vk::MemoryAllocateInfo allocInfo(memorySize, pool->second.memoryTypeIndex);
+        // if the page is dedicated to a buffer or image, tell the driver about it
+        if (dedicatedInfo)
+        {
+            allocInfo.pNext = dedicatedInfo;
+        }
+        memory = logicalDevice().allocateMemory(allocInfo);
+    }
+    catch (...)
+    {
+        if (sharedBuffer)
+        {
+            logicalDevice().destroyBuffer(sharedBuffer);
+        }
+        throw;
+    }
+    m_heapAllocatedSize[pool->second.heapIndex] += memorySize;
+    // keep host-visible memory mapped for the lifetime of the page, so updates are a plain memcpy
+    void *mapped = nullptr;
+    const auto &memProperties = DeviceInfoCache::getMemoryProperties(m_physicalDevice);
+    const auto propertyFlags = memProperties.memoryTypes[pool->second.memoryTypeIndex].propertyFlags;
+    if (propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+    {
+        mapped = logicalDevice().mapMemory(memory, 0, VK_WHOLE_SIZE);
+    }
+    // pages can not be moved because of their mutex, so construct the page in the list. the caller holds the pool lock
+    auto &pages = pool->second.pages;
+    auto page = pages.emplace(pages.end());
+    page->memory = memory;
+    page->memorySize = memorySize;
+    page->mapped = mapped;
+    page->coherent = (propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent) ? true : false;
+    page->dedicated = dedicatedInfo ? true : false;
+    page->optimalImages = optimalImages;
+    // allocator starts with a free block that spans the whole page
+    page->allocator = PageAllocator::create(strategy, pageSize);
+    page->strategy = strategy;
+    page->pool = pool;
+    page->emptySince = m_frame;
+    page->index = pool->second.pageIndex.size();
+    pool->second.pageIndex.push_back(page);
+    if (sharedBuffer)
+    {
+        page->sharedBuffer = sharedBuffer;
+        page->sharedUsage = sharedUsage;
+        logicalDevice().bindBufferMemory(sharedBuffer, memory, 0);
+    }
+    return page;
+}
+
+void MemoryPool::freePage(MemoryPool::Page::Iter page)
+{
+    // the caller holds the pool lock
+    auto &pool = page->pool->second;
+    m_heapAllocatedSize[pool.heapIndex] -= page->memorySize;
+    if (page->sharedBuffer)
+    {
+        logicalDevice().destroyBuffer(page->sharedBuffer);
+    }
+    logicalDevice().freeMemory(page->memory);
+    // move the last page into the hole in the index, so removing is O(1)
+    auto last = pool.pageIndex.back();
+    pool.pageIndex[page->index] = last;
+    last->index = page->index;
+    pool.pageIndex.pop_back();
+    pool.pages.erase(page);
+}
+
+MemoryPool::Block MemoryPool::getFreeBlockAligned(MemoryPool::Pool::Iter pool, vk::DeviceSize requiredSize, vk::DeviceSize requiredAlignment, AllocationStrategy strategy, vk::BufferUsageFlags sharedUsage, bool optimalImages)
+{
+    const vk::DeviceSize pageSize = pool->second.pageSize;
+    if (requiredSize > pageSize)
+    {
+        throw std::runtime_error("Allocation size too big!");
+    }
+    // every thread starts searching at a different page, so threads allocating at the same time spread over the pages
+    static thread_local const size_t threadStart = std::hash<std::thread::id>()(std::this_thread::get_id());
+    Block block;
+    block.size = requiredSize;
+    block.requiredAlignment = requiredAlignment;
+    {
+        std::shared_lock<std::shared_timed_mutex> poolLock(pool->second.mutex);
+        const auto &pages = pool->second.pageIndex;
+        const auto pageCount = pages.size();
+        // first only try pages no other thread is allocating from, then wait for the busy ones
+        for (int pass = 0; pass < 2 && pageCount > 0; pass++)
+        {
+            for (size_t i = 0; i < pageCount; i++)
+            {
+                auto page = pages[(threadStart + i) % pageCount];
+                // sub-allocated buffers must go into a page with a shared buffer of the same usage. optimal images must be kept apart from linear resources
+                if (page->dedicated || page->strategy != strategy || page->sharedUsage != sharedUsage || page->optimalImages != optimalImages)
+                {
+                    continue;
+                }
+                std::unique_lock<std::mutex> pageLock(page->mutex, std::defer_lock);
+                if (pass == 0)
+                {
+                    if (!pageLock.try_lock())
+                    {
+                        continue;
+                    }
+                }
+                else
+                {
+                    pageLock.lock();
+                }
+                // try to find a free block. this is O(1) in the TLSF page allocator
+                auto allocation = page->allocator->allocate(requiredSize, requiredAlignment);
+                if (allocation.block != PageAllocator::InvalidBlock)
+                {
+                    block.offset = allocation.offset;
+                    block.allocatorBlock = allocation.block;
+                    block.page = page;
+                    return block;
+                }
+            }
+        }
+    }
+    // when we get here, we haven't found a block so we need to allocate a new page.
+    // other threads might have added pages in the meantime, but we do not care, it is a rare case
+    std::unique_lock<std::shared_timed_mutex> poolLock(pool->second.mutex);
+    auto newPage = allocatePage(pool, pageSize, strategy, nullptr, sharedUsage, optimalImages);
+    // this memory starts at offset 0 in a fresh memory object, so alignment is not an issue.
+    // it can still fail, e.g. the buddy allocator only manages the largest power of two of a page
+    auto allocation = newPage->allocator->allocate(requiredSize, requiredAlignment);
+    if (allocation.block == PageAllocator::InvalidBlock)
+    {
+        freePage(newPage);
+        throw std::runtime_error("Allocation size too big for page allocator!");
+    }
+    block.offset = allocation.offset;
+    block.allocatorBlock = allocation.block;
+    block.page = newPage;
+    return block;
+}
+
+MemoryPool::Block MemoryPool::allocateMemory(vk::Buffer buffer, vk::DeviceSize size, const Buffer::Settings &settings)
+{
+    // find out memory requirements and type for buffer and if the driver wants a dedicated allocation
+    auto requirements = logicalDevice().getBufferMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>(vk::BufferMemoryRequirementsInfo2(buffer));
+    const auto &memRequirements = requirements.get<vk::MemoryRequirements2>().memoryRequirements;
+    const auto &dedicatedRequirements = requirements.get<vk::MemoryDedicatedRequirements>();
+    const auto memTypeIndices = findMemoryTypeIndices(m_physicalDevice, memRequirements.memoryTypeBits, memoryProperties(settings.properties, settings.memoryUsage), settings.memoryUsage);
+    return allocateWithFallback(memTypeIndices, memRequirements.size, [&](uint32_t memTypeIndex)
+    {
+        return allocateBlock(memRequirements, dedicatedRequirements, vk::MemoryDedicatedAllocateInfo(nullptr, buffer), size, memTypeIndex, settings.allocationStrategy, false);
+    });
+}
+
+MemoryPool::Block MemoryPool::allocateImageMemory(vk::Image image, const Image::Settings &settings)
+{
+    auto requirements = logicalDevice().getImageMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>(vk::ImageMemoryRequirementsInfo2(image));
+    const auto &memRequirements = requirements.get<vk::MemoryRequirements2>().memoryRequirements;
+    const auto &dedicatedRequirements = requirements.get<vk::MemoryDedicatedRequirements>();
+    const auto memTypeIndices = findMemoryTypeIndices(m_physicalDevice, memRequirements.memoryTypeBits, memoryProperties(settings.properties, settings.memoryUsage), settings.memoryUsage);
+    // linear and optimal resources closer than bufferImageGranularity alias on some devices. we keep optimal images in pages of their own then
+    const auto granularity = DeviceInfoCache::getProperties(m_physicalDevice).limits.bufferImageGranularity;
+    const bool optimalImages = settings.tiling == vk::ImageTiling::eOptimal && granularity > 1;
+    return allocateWithFallback(memTypeIndices, memRequirements.size, [&](uint32_t memTypeIndex)
+    {
+        return allocateBlock(memRequirements, dedicatedRequirements, vk::MemoryDedicatedAllocateInfo(image, nullptr), memRequirements.size, memTypeIndex, settings.allocationStrategy, optimalImages);
+    });
+}
+
+MemoryPool::Block MemoryPool::allocateBlock(const vk::MemoryRequirements &memRequirements, const vk::MemoryDedicatedRequirements &dedicatedRequirements, const vk::MemoryDedicatedAllocateInfo &dedicatedInfo, vk::DeviceSize size, uint32_t memTypeIndex, AllocationStrategy strategy, bool optimalImages)
+{
+    auto mpIt = getPool(memTypeIndex);
+    // resources too big for a page or that the driver wants to have their own memory get a dedicated page
+    if (memRequirements.size > mpIt->second.pageSize || dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation)
+    {
+        std::unique_lock<std::shared_timed_mutex> poolLock(mpIt->second.mutex);
+        auto page = allocatePage(mpIt, memRequirements.size, AllocationStrategy::eTlsf, &dedicatedInfo);
+        auto allocation = page->allocator->allocate(size, memRequirements.alignment);
+        if (allocation.block == PageAllocator::InvalidBlock)
+        {
+            freePage(page);
+            throw std::runtime_error("Allocation size too big for page allocator!");
+        }
+        Block block;
+        block.size = size;
+        block.offset = allocation.offset;
+        block.requiredAlignment = memRequirements.alignment;
+        block.allocatorBlock = allocation.block;
+        block.page = page;
+        mpIt->second.allocationCount++;
+        m_allocationCount++;
+        return block;
+    }
+    // find free block of appropriate size and properly aligned
+    if (strategy == AllocationStrategy::eDefault)
+    {
+        strategy = mpIt->second.strategy;
+    }
+    auto block = getFreeBlockAligned(mpIt, size, memRequirements.alignment, strategy, vk::BufferUsageFlags(), optimalImages);
+    mpIt->second.allocationCount++;
+    m_allocationCount++;
+    return block;
+}
+
+MemoryPool::Block MemoryPool::allocateSharedMemory(vk::DeviceSize size, const Buffer::Settings &settings)
+{
+    const auto usage = settings.usage | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
+    vk::MemoryRequirements memRequirements;
+    {
+        // memory type bits and alignment are the same for all buffers with the same usage,
+        // so we only need to query them once using a temporary buffer
+        std::lock_guard<std::mutex> lock(m_poolsMutex);
+        auto key = std::make_pair(usage, settings.properties);
+        auto rIt = m_sharedRequirements.find(key);
+        if (rIt == m_sharedRequirements.end())
+        {
+            auto buffer = createBufferObject(DefaultPageSize, settings);
+            rIt = m_sharedRequirements.insert(std::make_pair(key, logicalDevice().getBufferMemoryRequirements(buffer))).first;
+            logicalDevice().destroyBuffer(buffer);
+        }
+        memRequirements = rIt->second;
+    }
+    const auto memTypeIndices = findMemoryTypeIndices(m_physicalDevice, memRequirements.memoryTypeBits, memoryProperties(settings.properties, settings.memoryUsage), settings.memoryUsage);
+    // buffers too big for a page get their own buffer object and memory anyway
+    if (size > getPool(memTypeIndices.front())->second.pageSize)
+    {
+        return allocateUnsharedBuffer(size, settings);
+    }
+    // the offset must be valid for binding the buffer, e.g. as a uniform buffer
+    const auto alignment = std::max(memRequirements.alignment, minAligmentFor(m_physicalDevice, settings.usage));
+    return allocateWithFallback(memTypeIndices, size, [&](uint32_t memTypeIndex)
+    {
+        auto mpIt = getPool(memTypeIndex);
+        if (size > mpIt->second.pageSize)
+        {
+            throw std::runtime_error("Allocation size too big!");
+        }
+        const auto strategy = settings.allocationStrategy == AllocationStrategy::eDefault ? mpIt->second.strategy.load() : settings.allocationStrategy;
+        auto block = getFreeBlockAligned(mpIt, size, alignment, strategy, usage);
+        block.buffer = block.page->sharedBuffer;
+        mpIt->second.allocationCount++;
+        m_allocationCount++;
+        return block;
+    });
+}
+
+MemoryPool::Block MemoryPool::allocateWithFallback(const std::vector<uint32_t> &memTypeIndices, vk::DeviceSize size, const std::function<Block(uint32_t memTypeIndex)> &allocate)
+{
+    for (size_t i = 0; i + 1 < memTypeIndices.size(); i++)
+    {
+        try
+        {
+            return allocate(memTypeIndices[i]);
+        }
+        catch (const vk::OutOfDeviceMemoryError &)
+        {
+            // heap is full. try the next best memory type
+        }
+        catch (const std::runtime_error &)
+        {
+            // only fall back if a new page would exceed the budget of the heap, e.g. device-local host-visible memory without resizable BAR
+            if (isWithinBudget(memTypeIndices[i], std::max(size, pageSize(memTypeIndices[i]))))
+            {
+                throw;
+            }
+        }
+    }
+    return allocate(memTypeIndices.back());
+}
+
+void MemoryPool::freeBlock(const Block &block)
+{
+    auto &pool = block.page->pool->second;
+    pool.allocationCount--;
+    m_freeCount++;
+    if (block.page->dedicated)
+    {
+        // dedicated memory is released with the buffer
+        std::unique_lock<std::shared_timed_mutex> poolLock(pool.mutex);
+        freePage(block.page);
+    }
+    else
+    {
+        // the page allocator coalesces the free memory with its neighbours if its strategy does
+        std::shared_lock<std::shared_timed_mutex> poolLock(pool.mutex);
+        std::lock_guard<std::mutex> pageLock(block.page->mutex);
+        block.page->allocator->free(block.allocatorBlock);
+        // the page is not released right away, so it can be reused if memory is needed again soon
+        if (block.page->allocator->empty())
+        {
+            block.page->emptySince = m_frame;
+        }
+    }
+}
+
+void *MemoryPool::blockData(const Block &block) const
+{
+    return block.page->mapped ? static_cast<uint8_t *>(block.page->mapped) + block.offset : nullptr;
+}
+
+void MemoryPool::reallocateMemory(const Buffer::Ptr &buffer, Block &block, vk::DeviceSize size)
+{
+    auto newSize = buffer->size();
+    // check if we need to grow the buffer
+    if (size > buffer->size())
+    {
+        if (buffer->settings().reallocStrategy == Buffer::ReallocStrategy::eGrow)
+        {
+            newSize = size;
+        }
+        else if (buffer->settings().reallocStrategy == Buffer::ReallocStrategy::eGrowOverprovision ||
+                 buffer->settings().reallocStrategy == Buffer::ReallocStrategy::eGrowOverprovisionAndShrink)
+        {
+            newSize = (size * 105) / 100;
+        }
+        // do nothing for fixed size buffers
+    }
+    // check if we need to shrink the buffer
+    else if (size < ((buffer->size() * 75) / 100))
+    {
+        if (buffer->settings().reallocStrategy == Buffer::ReallocStrategy::eGrowOverprovisionAndShrink)
+        {
+            newSize = size;
+        }
+    }
+    // check if we need to reallocate
+    if (newSize != buffer->size())
+    {
+        // a buffers size and memory binding can not change, so we need a new buffer object or range.
+        // allocate before releasing the old block, so the buffer stays valid if the allocation throws
+        auto newBlock = allocateBuffer(newSize, buffer->settings());
+        buffer->updateBuffer(newBlock.buffer, newBlock.size, bufferOffset(newBlock), blockData(newBlock));
+        std::swap(block, newBlock);
+        releaseBuffer(newBlock);
+    }
+}
+
+uint64_t MemoryPool::uploadStagedBatch(const std::vector<StagedUpload> &uploads)
+{
+    static const vk::DeviceSize StagingAlignment = 16;
+    const auto maxBatchSize = m_stagingSize / 2;
+    uint64_t id = 0;
+    size_t first = 0;
+    while (first < uploads.size())
+    {
+        // collect uploads until the batch is full
+        size_t last = first;
+        vk::DeviceSize batchSize = 0;
+        while (last < uploads.size())
+        {
+            const auto alignedSize = ((uploads[last].size + StagingAlignment - 1) / StagingAlignment) * StagingAlignment;
+            if (batchSize + alignedSize > maxBatchSize)
+            {
+                break;
+            }
+            batchSize += alignedSize;
+            last++;
+        }
+        if (last == first)
+        {
+            // too big for a batch. upload separately in chunks
+            id = uploadStaged(uploads[first]);
+            first++;
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(m_transferMutex);
+        // copy all data to one staging region and group the copies per destination buffer
+        auto region = stagingRing().allocate(batchSize, StagingAlignment);
+        std::map<vk::Buffer, std::vector<vk::BufferCopy>> copies;
+        std::vector<vk::BufferMemoryBarrier> releaseBarriers;
+        std::vector<AcquireRange> acquireRanges;
+        vk::DeviceSize offset = 0;
+        for (auto i = first; i < last; i++)
+        {
+            const auto &upload = uploads[i];
+            const auto dstOffset = bufferOffset(upload.block) + upload.offset;
+            std::memcpy(static_cast<uint8_t *>(region.data) + offset, upload.data, upload.size);
+            copies[upload.block.buffer].push_back(vk::BufferCopy(region.offset + offset, dstOffset, upload.size));
+            if (upload.release)
+            {
+                releaseBarriers.push_back(vk::BufferMemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlags(), m_transferFamily, m_dstFamily, upload.block.buffer, dstOffset, upload.size));
+                acquireRanges.push_back({upload.handle, upload.block.buffer, upload.block.offset, dstOffset, upload.size});
+            }
+            offset += ((upload.size + StagingAlignment - 1) / StagingAlignment) * StagingAlignment;
+        }
+        auto commandBuffer = beginTransferCommands();
+        for (const auto & c : copies)
+        {
+            commandBuffer.copyBuffer(region.buffer, c.first, static_cast<uint32_t>(c.second.size()), c.second.data());
+        }
+        // make the data visible to all following commands reading the buffers and release ranges to the destination family
+        vk::MemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eMemoryRead);
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, 1, &barrier, static_cast<uint32_t>(releaseBarriers.size()), releaseBarriers.data(), 0, nullptr);
+        id = submitTransferCommands(commandBuffer, acquireRanges);
+        first = last;
+    }
+    return id;
+}
+
+MemoryPool::FragmentationStats MemoryPool::fragmentationStats() const
+{
+    // lock in the same order as defragment() does
+    std::lock_guard<std::mutex> poolsLock(m_poolsMutex);
+    std::vector<std::unique_lock<std::shared_timed_mutex>> poolLocks;
+    for (auto & p : m_pools)
+    {
+        poolLocks.emplace_back(p.second.mutex);
+    }
+    return collectFragmentationStats();
+}
+
+MemoryPool::FragmentationStats MemoryPool::collectFragmentationStats() const
+{
+    FragmentationStats stats;
+    for (const auto & p : m_pools)
+    {
+        for (const auto & page : p.second.pages)
+        {
+            stats.pageCount++;
+            stats.allocatedSize += page.allocator->size();
+            stats.usedSize += page.allocator->usedSize();
+            stats.freeBlockCount += page.allocator->freeBlockCount();
+            stats.largestFreeBlock = std::max(stats.largestFreeBlock, page.allocator->largestFreeBlock());
+        }
+    }
+    const auto freeSize = stats.allocatedSize - stats.usedSize;
+    stats.fragmentation = freeSize > 0 ? 1.0f - static_cast<float>(static_cast<double>(stats.largestFreeBlock) / static_cast<double>(freeSize)) : 0.0f;
+    return stats;
+}
+
+void MemoryPool::queryHeapBudgets(std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> &budget, std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> &usage) const
+{
+    const auto &memProperties = DeviceInfoCache::getMemoryProperties(m_physicalDevice);
+    if (m_hasMemoryBudget)
+    {
+        // budget and usage change at runtime, so we need to query them every time
+        auto properties = m_physicalDevice.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2, vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+        const auto &budgetProperties = properties.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+        for (uint32_t i = 0; i < memProperties.memoryHeapCount; i++)
+        {
+            budget[i] = budgetProperties.heapBudget[i];
+            usage[i] = budgetProperties.heapUsage[i];
+        }
+    }
+    else
+    {
+        // without the extension we can only estimate. using more than ~80% of a heap is asking for trouble
+        for (uint32_t i = 0; i < memProperties.memoryHeapCount; i++)
+        {
+            budget[i] = (memProperties.memoryHeaps[i].size * 8) / 10;
+            usage[i] = m_heapAllocatedSize[i];
+        }
+    }
+}
+
+void MemoryPool::setBudgetLimit(float fraction)
+{
+    m_budgetLimit = fraction;
+}
+
+bool MemoryPool::isWithinBudget(uint32_t memoryTypeIndex, vk::DeviceSize size) const
+{
+    std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> budget;
+    std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> usage;
+    queryHeapBudgets(budget, usage);
+    const auto heapIndex = DeviceInfoCache::getMemoryProperties(m_physicalDevice).memoryTypes[memoryTypeIndex].heapIndex;
+    const auto limit = static_cast<vk::DeviceSize>(static_cast<double>(budget[heapIndex]) * m_budgetLimit);
+    return usage[heapIndex] + size <= limit;
+}
+
+MemoryPool::Statistics MemoryPool::statistics()
+{
+    const auto &memProperties = DeviceInfoCache::getMemoryProperties(m_physicalDevice);
+    Statistics stats;
+    stats.hasMemoryBudget = m_hasMemoryBudget;
+    for (uint32_t i = 0; i < memProperties.memoryHeapCount; i++)
+    {
+        HeapStats heap;
+        heap.heapIndex = i;
+        heap.flags = memProperties.memoryHeaps[i].flags;
+        heap.heapSize = memProperties.memoryHeaps[i].size;
+        stats.heaps.push_back(heap);
+    }
+    std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> budget;
+    std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> usage;
+    queryHeapBudgets(budget, usage);
+    std::lock_guard<std::mutex> poolsLock(m_poolsMutex);
+    for (auto & p : m_pools)
+    {
+        MemoryTypeStats type;
+        type.memoryTypeIndex = p.second.memoryTypeIndex;
+        type.heapIndex = p.second.heapIndex;
+        type.properties = memProperties.memoryTypes[type.memoryTypeIndex].propertyFlags;
+        type.allocationCount = p.second.allocationCount;
+        type.pageSize = p.second.pageSize;
+        {
+            std::shared_lock<std::shared_timed_mutex> poolLock(p.second.mutex);
+            for (auto & page : p.second.pages)
+            {
+                std::lock_guard<std::mutex> pageLock(page.mutex);
+                type.pageCount++;
+                type.emptyPageCount += (!page.dedicated && page.allocator->empty()) ? 1 : 0;
+                type.allocatedSize += page.memorySize;
+                type.usedSize += page.allocator->usedSize();
+                type.freeBlockCount += page.allocator->freeBlockCount();
+                type.largestFreeBlock = std::max(type.largestFreeBlock, page.allocator->largestFreeBlock());
+            }
+        }
+        auto &heap = stats.heaps[type.heapIndex];
+        heap.pageCount += type.pageCount;
+        heap.allocatedSize += type.allocatedSize;
+        heap.usedSize += type.usedSize;
+        heap.allocationCount += type.allocationCount;
+        stats.memoryTypes.push_back(type);
+    }
+    for (auto & heap : stats.heaps)
+    {
+        heap.budget = budget[heap.heapIndex];
+        heap.usage = usage[heap.heapIndex];
+    }
+    // allocation rate since last call
+    const auto now = std::chrono::steady_clock::now();
+    stats.totalAllocations = m_allocationCount;
+    stats.totalFrees = m_freeCount;
+    const auto seconds = std::chrono::duration<float>(now - m_lastStatsTime).count();
+    stats.allocationRate = seconds > 0.0f ? static_cast<float>(stats.totalAllocations - m_lastStatsAllocationCount) / seconds : 0.0f;
+    m_lastStatsAllocationCount = stats.totalAllocations;
+    m_lastStatsTime = now;
+    return stats;
+}
+
+std::string MemoryPool::statisticsJson()
+{
+    const auto stats = statistics();
+    std::ostringstream json;
+    json << "{";
+    json << "\"hasMemoryBudget\":" << (stats.hasMemoryBudget ? "true" : "false");
+    json << ",\"totalAllocations\":" << stats.totalAllocations;
+    json << ",\"totalFrees\":" << stats.totalFrees;
+    json << ",\"allocationRate\":" << stats.allocationRate;
+    json << ",\"memoryTypes\":[";
+    for (size_t i = 0; i < stats.memoryTypes.size(); i++)
+    {
+        const auto &type = stats.memoryTypes[i];
+        json << (i > 0 ? "," : "") << "{";
+        json << "\"memoryTypeIndex\":" << type.memoryTypeIndex;
+        json << ",\"heapIndex\":" << type.heapIndex;
+        json << ",\"properties\":" << static_cast<uint32_t>(type.properties);
+        json << ",\"pageCount\":" << type.pageCount;
+        json << ",\"emptyPageCount\":" << type.emptyPageCount;
+        json << ",\"pageSize\":" << type.pageSize;
+        json << ",\"allocatedSize\":" << type.allocatedSize;
+        json << ",\"usedSize\":" << type.usedSize;
+        json << ",\"freeBlockCount\":" << type.freeBlockCount;
+        json << ",\"largestFreeBlock\":" << type.largestFreeBlock;
+        json << ",\"allocationCount\":" << type.allocationCount;
+        json << "}";
+    }
+    json << "],\"heaps\":[";
+    for (size_t i = 0; i < stats.heaps.size(); i++)
+    {
+        const auto &heap = stats.heaps[i];
+        json << (i > 0 ? "," : "") << "{";
+        json << "\"heapIndex\":" << heap.heapIndex;
+        json << ",\"flags\":" << static_cast<uint32_t>(heap.flags);
+        json << ",\"heapSize\":" << heap.heapSize;
+        json << ",\"pageCount\":" << heap.pageCount;
+        json << ",\"allocatedSize\":" << heap.allocatedSize;
+        json << ",\"usedSize\":" << heap.usedSize;
+        json << ",\"allocationCount\":" << heap.allocationCount;
+        json << ",\"budget\":" << heap.budget;
+        json << ",\"usage\":" << heap.usage;
+        json << "}";
+    }
+    json << "]}";
+    return json.str();
+}
+
+MemoryPool::DefragmentationResult MemoryPool::defragment(vk::DeviceSize maxSize, uint32_t maxMoves)
+{
+    // moving buffers touches everything, so we lock everything
+    std::vector<std::unique_lock<std::mutex>> slotLocks;
+    for (auto & mutex : m_slotLocks)
+    {
+        slotLocks.emplace_back(mutex);
+    }
+    std::lock_guard<std::mutex> slotsLock(m_slotsMutex);
+    std::lock_guard<std::mutex> poolsLock(m_poolsMutex);
+    std::vector<std::unique_lock<std::shared_timed_mutex>> poolLocks;
+    for (auto & p : m_pools)
+    {
+        poolLocks.emplace_back(p.second.mutex);
+    }
+    std::lock_guard<std::mutex> transferLock(m_transferMutex);
+    if (!m_transferQueue)
+    {
+        throw std::runtime_error("No transfer queue set!");
+    }
+    // host writes must reach the device before buffers are copied
+    flushDirtyRanges();
+    // staged uploads to buffers we move must finish before we copy the buffers and free their old blocks
+    if (m_stagingRing)
+    {
+        m_stagingRing->waitIdle();
+    }
+    DefragmentationResult result;
+    result.before = collectFragmentationStats();
+    // find the buffers living in each page
+    std::map<const Page *, std::vector<uint32_t>> pageBuffers;
+    for (uint32_t index = 0; index < m_slotCount; index++)
+    {
+        if (slotBuffer(index))
+        {
+            pageBuffers[&(*slotBlock(index).page)].push_back(index);
+        }
+    }
+    // find new blocks for buffers until the budget is used up
+    struct Move
+    {
+        uint32_t slot;
+        Block newBlock;
+    };
+    std::vector<Move> moves;
+    bool budgetLeft = maxSize > 0 && maxMoves > 0;
+    for (auto pIt = m_pools.begin(); pIt != m_pools.end() && budgetLeft; ++pIt)
+    {
+        // sort pages by usage. we move buffers from the sparsest pages to the densest pages
+        std::vector<Page::Iter> pages;
+        for (auto page = pIt->second.pages.begin(); page != pIt->second.pages.end(); ++page)
+        {
+            // dedicated pages hold exactly one buffer and are never moved
+            if (!page->dedicated)
+            {
+                pages.push_back(page);
+            }
+        }
+        std::sort(pages.begin(), pages.end(), [](const Page::Iter & a, const Page::Iter & b){ return a->allocator->usedSize() < b->allocator->usedSize(); });
+        for (size_t source = 0; (source + 1) < pages.size() && budgetLeft; source++)
+        {
+            for (auto slot : pageBuffers[&(*pages[source])])
+            {
+                // the staging ring might have uploads in flight, so we leave it where it is
+                if (m_stagingRing && slotBuffer(slot) == m_stagingRing->buffer())
+                {
+                    continue;
+                }
+                const auto &block = slotBlock(slot);
+                if (moves.size() >= maxMoves || result.movedSize + block.size > maxSize)
+                {
+                    budgetLeft = false;
+                    break;
+                }
+                // try to fit the buffer into a denser page, densest first. the page must use the same strategy and shared buffer usage
+                for (size_t target = pages.size() - 1; target > source; target--)
+                {
+                    if (pages[target]->strategy != pages[source]->strategy || pages[target]->sharedUsage != pages[source]->sharedUsage || pages[target]->optimalImages != pages[source]->optimalImages)
+                    {
+                        continue;
+                    }
+                    auto allocation = pages[target]->allocator->allocate(block.size, block.requiredAlignment);
+                    if (allocation.block != PageAllocator::InvalidBlock)
+                    {
+                        Block newBlock = block;
+                        newBlock.offset = allocation.offset;
+                        newBlock.allocatorBlock = allocation.block;
+                        newBlock.page = pages[target];
+                        if (newBlock.page->sharedBuffer)
+                        {
+                            newBlock.buffer = newBlock.page->sharedBuffer;
+                        }
+                        else
+                        {
+                            newBlock.buffer = createBufferObject(block.size, slotBuffer(slot)->settings());
+                            logicalDevice().bindBufferMemory(newBlock.buffer, newBlock.page->memory, newBlock.offset);
+                        }
+                        moves.push_back({slot, newBlock});
+                        result.movedSize += block.size;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    if (!moves.empty())
+    {
+        // copy buffer data on the device and wait for it to finish
+        auto commandBuffer = beginTransferCommands();
+        for (const auto & m : moves)
+        {
+            const auto &block = slotBlock(m.slot);
+            vk::BufferCopy region(bufferOffset(block), bufferOffset(m.newBlock), m.newBlock.size);
+            commandBuffer.copyBuffer(block.buffer, m.newBlock.buffer, 1, &region);
+        }
+        submitTransferCommandsAndWait(commandBuffer);
+        // now release the old buffers and rebind the buffer objects.
+        // we hold all locks, so free directly in the page allocator instead of calling freeBlock()
+        for (auto & m : moves)
+        {
+            auto &block = slotBlock(m.slot);
+            if (!block.page->sharedBuffer)
+            {
+                logicalDevice().destroyBuffer(block.buffer);
+            }
+            block.page->allocator->free(block.allocatorBlock);
+            if (block.page->allocator->empty())
+            {
+                block.page->emptySince = m_frame;
+            }
+            block = m.newBlock;
+            const auto &buffer = slotBuffer(m.slot);
+            buffer->updateBuffer(block.buffer, block.size, bufferOffset(block), blockData(block));
+            result.movedBuffers.push_back(buffer);
+        }
+        // release pages that are empty now, but keep spares like nextFrame() does, so we do not allocate them again right away
+        for (auto pool = m_pools.begin(); pool != m_pools.end(); ++pool)
+        {
+            result.freedPages += releaseEmptyPagesLocked(pool, m_spareEmptyPages, 0);
+        }
+    }
+    result.after = collectFragmentationStats();
+    return result;
+}
+
+void MemoryPool::updateBuffer(const Buffer::Ptr &buffer, const RawData &data)
+{
+    if (!buffer || !buffer->handle().isValid())
+    {
+        throw std::runtime_error("Unknown buffer!");
+    }
+    updateBuffer(buffer->handle(), data);
+}
+
+void MemoryPool::updateBuffer(Buffer::Handle handle, const RawData &data)
+{
+    std::lock_guard<std::mutex> lock(slotMutex(handle.index));
+    if (!isValidSlot(handle))
+    {
+        throw std::runtime_error("Stale or invalid buffer handle!");
+    }
+    auto &block = slotBlock(handle.index);
+    const auto &buffer = slotBuffer(handle.index);
+    reallocateMemory(buffer, block, data.copySize());
+    if (data.copySize() > buffer->size())
+    {
+        throw std::runtime_error("Data too big for buffer!");
+    }
+    writeRange(handle.index, 0, data);
+    trace(TraceEvent::Type::eUpdate, handle, data.copySize());
+}
+
+void MemoryPool::updateRange(const Buffer::Ptr &buffer, vk::DeviceSize dstOffset, const RawData &data)
+{
+    if (!buffer || !buffer->handle().isValid())
+    {
+        throw std::runtime_error("Unknown buffer!");
+    }
+    updateRange(buffer->handle(), dstOffset, data);
+}
+
+void MemoryPool::updateRange(Buffer::Handle handle, vk::DeviceSize dstOffset, const RawData &data)
+{
+    std::lock_guard<std::mutex> lock(slotMutex(handle.index));
+    if (!isValidSlot(handle))
+    {
+        throw std::runtime_error("Stale or invalid buffer handle!");
+    }
+    if (dstOffset + data.copySize() > slotBuffer(handle.index)->size())
+    {
+        throw std::runtime_error("Range exceeds buffer size!");
+    }
+    writeRange(handle.index, dstOffset, data);
+    trace(TraceEvent::Type::eUpdate, handle, dstOffset + data.copySize());
+}
+
+void MemoryPool::markDirty(const Buffer::Ptr &buffer, vk::DeviceSize offset, vk::DeviceSize size)
+{
+    const auto handle = buffer ? buffer->handle() : Buffer::Handle();
+    std::lock_guard<std::mutex> lock(slotMutex(handle.index));
+    if (!isValidSlot(handle))
+    {
+        throw std::runtime_error("Unknown buffer!");
+    }
+    // a bad range would flush memory of neighbouring blocks or past the end of the page
+    const auto bufferSize = slotBuffer(handle.index)->size();
+    if (offset > bufferSize || size > bufferSize - offset)
+    {
+        throw std::runtime_error("Range exceeds buffer size!");
+    }
+    const auto &block = slotBlock(handle.index);
+    if (block.page->mapped && !block.page->coherent && size > 0)
+    {
+        addDirtyRange(handle.index, offset, size);
+    }
+}
+
+uint32_t MemoryPool::flushBuffers()
+{
+    std::vector<std::unique_lock<std::mutex>> slotLocks;
+    for (auto & mutex : m_slotLocks)
+    {
+        slotLocks.emplace_back(mutex);
+    }
+    return flushDirtyRanges();
+}
+
+void MemoryPool::updateBuffers(const std::vector<Buffer::Ptr> &buffers, const std::vector<RawData> &data)
+{
+    if (buffers.size() != data.size())
+    {
+        throw std::runtime_error("Number of buffers and data must match!");
+    }
+    // lock the slots of all buffers in lock order until the batch is submitted, so no other thread can
+    // reallocate or destroy a buffer and free its block while we copy to it
+    std::array<bool, SlotLockCount> needsLock = {};
+    for (const auto & buffer : buffers)
+    {
+        needsLock[(buffer ? buffer->handle().index : Buffer::Handle::InvalidIndex) % SlotLockCount] = true;
+    }
+    std::vector<std::unique_lock<std::mutex>> slotLocks;
+    for (uint32_t i = 0; i < SlotLockCount; i++)
+    {
+        if (needsLock[i])
+        {
+            slotLocks.emplace_back(m_slotLocks[i]);
+        }
+    }
+    // write host-visible buffers directly and collect the others for staging
+    std::vector<StagedUpload> staged;
+    std::map<uint32_t, size_t> stagedSlots; // Index of upload for slot in staged.
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        const auto handle = buffers[i] ? buffers[i]->handle() : Buffer::Handle();
+        if (!isValidSlot(handle))
+        {
+            throw std::runtime_error("Unknown buffer!");
+        }
+        auto &block = slotBlock(handle.index);
+        const auto size = data[i].copySize();
+        reallocateMemory(buffers[i], block, size);
+        if (size > buffers[i]->size())
+        {
+            throw std::runtime_error("Data too big for buffer!");
+        }
+        trace(TraceEvent::Type::eUpdate, handle, size);
+        if (block.page->mapped)
+        {
+            writeRange(handle.index, 0, data[i]);
+        }
+        else if (size > 0)
+        {
+            StagedUpload upload;
+            upload.block = block;
+            upload.data = data[i].begin();
+            upload.size = size;
+            upload.handle = handle;
+            upload.release = needsOwnershipTransfer(buffers[i]->settings());
+            // a buffer passed twice is written with the last data. the earlier block might have been reallocated too
+            auto slot = stagedSlots.find(handle.index);
+            if (slot != stagedSlots.end())
+            {
+                staged[slot->second] = upload;
+            }
+            else
+            {
+                stagedSlots[handle.index] = staged.size();
+                staged.push_back(upload);
+            }
+        }
+    }
+    if (!staged.empty())
+    {
+        // the blocks must not be released before the last submission of the batch has finished
+        const auto id = uploadStagedBatch(staged);
+        for (const auto & slot : stagedSlots)
+        {
+            slotBlock(slot.first).uploadId = id;
+        }
+    }
+}
+
+void MemoryPool::destroyBuffer(const Buffer::Ptr &buffer)
+{
+    if (buffer)
+    {
+        destroyBuffer(buffer->handle());
+    }
+}
+
+void MemoryPool::destroyBuffer(Buffer::Handle handle)
+{
+    Block block;
+    {
+        std::lock_guard<std::mutex> lock(slotMutex(handle.index));
+        if (!isValidSlot(handle))
+        {
+            return;
+        }
+        block = slotBlock(handle.index);
+        // trace before the slot can be reused, so the destruction is recorded before a new buffer in the slot
+        trace(TraceEvent::Type::eDestroy, handle);
+        // invalidate all handles to the slot
+        auto &buffer = slotBuffer(handle.index);
+        buffer->m_handle = Buffer::Handle();
+        buffer.reset();
+        slotDirtyRange(handle.index) = DirtyRange();
+        m_slotChunks[handle.index / SlotChunkSize]->generations[handle.index % SlotChunkSize]++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_slotsMutex);
+        m_freeSlots.push_back(handle.index);
+    }
+    // free buffer and memory
+    releaseBuffer(block);
+}
+
+void MemoryPool::destroyBuffers(const std::vector<Buffer::Ptr> &buffers)
+{
+    std::for_each(buffers.cbegin(), buffers.cend(), [this](const auto & b){ return destroyBuffer(b); });
+}
+
+Image::Ptr MemoryPool::createImage(vk::Extent3D extent, const Image::Settings &settings)
+{
+    vk::ImageCreateInfo imageInfo({}, settings.type, settings.format, extent, settings.mipLevels, settings.arrayLayers, settings.samples, settings.tiling, settings.usage, settings.sharingMode);
+    auto image = logicalDevice().createImage(imageInfo);
+    Block block;
+    try
+    {
+        block = allocateImageMemory(image, settings);
+    }
+    catch (...)
+    {
+        logicalDevice().destroyImage(image);
+        throw;
+    }
+    logicalDevice().bindImageMemory(image, block.page->memory, block.offset);
+    auto sharedImage = std::make_shared<Image>(image, extent, settings, blockData(block));
+    std::lock_guard<std::mutex> lock(m_imagesMutex);
+    m_images[sharedImage] = block;
+    return sharedImage;
+}
+
+void MemoryPool::destroyImage(const Image::Ptr &image)
+{
+    Block block;
+    {
+        std::lock_guard<std::mutex> lock(m_imagesMutex);
+        auto iIt = m_images.find(image);
+        if (iIt == m_images.end())
+        {
+            return;
+        }
+        block = iIt->second;
+        m_images.erase(iIt);
+    }
+    logicalDevice().destroyImage(image->image());
+    freeBlock(block);
+}
+
+}
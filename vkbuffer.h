@@ -1,10 +1,20 @@
 #pragma once
 
 #include "vkresource.h"
+#include "vkallocator.h"
+#include "vkdevice.h"
+#include "vkimage.h"
 #include "vkincludes.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
 #include <vector>
 #include <list>
 #include <map>
+#include <mutex>
+#include <shared_mutex>
 #include <utility>
 #include <memory>
 
@@ -16,17 +26,26 @@ struct RawData
 {
     const void *data = nullptr; // Pointer to raw data.
     vk::DeviceSize size = 0;    // Byte size of raw data.
-    vk::DeviceSize offset = 0;  // Byte offset into raw data.
+    vk::DeviceSize offset = 0;  // Byte offset into raw data. Bytes [offset, size) are copied.
+
+    RawData(const void *data, vk::DeviceSize size, vk::DeviceSize offset = 0);
 
     template <typename T>
-    RawData(const std::vector<T> &data)
+    RawData(const std::vector<T> &data, vk::DeviceSize offset = 0)
         : data(data.data())
-        , size(data.size)
+        , size(data.size() * sizeof(T))
+        , offset(offset)
     {
     }
+
+    /// @brief Get pointer to first byte to copy.
+    const void *begin() const;
+    /// @brief Get number of bytes to copy.
+    vk::DeviceSize copySize() const;
 };
 
 class MemoryPool;
+class StagingRing;
 
 /// @brief Vulkan buffer object. Can be used as a vertex, index constant or uniform buffers etc.
 /// Create using MemoryPool::createBuffer().
@@ -48,41 +67,77 @@ public:
         vk::BufferUsageFlags usage;
         vk::SharingMode sharingMode = vk::SharingMode::eExclusive;
         vk::MemoryPropertyFlags properties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+        MemoryUsage memoryUsage = MemoryUsage::eUnknown; // If set, the best memory type for the usage is picked and properties are ignored.
         ReallocStrategy reallocStrategy = ReallocStrategy::eFixedSize;
+        AllocationStrategy allocationStrategy = AllocationStrategy::eDefault; // How free memory in pages is managed.
+        bool subAllocate = false; // If true the buffer is a range in a vk::Buffer shared with buffers of the same usage and properties. Needs eExclusive sharing mode.
     };
     
+    /// @brief Generational handle of a buffer in its MemoryPool.
+    /// Handles are cheap to copy and compare. A handle becomes stale when its buffer is destroyed, even if the slot is reused.
+    struct Handle
+    {
+        static constexpr uint32_t InvalidIndex = UINT32_MAX;
+        uint32_t index = InvalidIndex; // Slot index in pool.
+        uint32_t generation = 0;       // Generation of slot when the buffer was created.
+
+        /// @brief Returns true if the handle was assigned by a pool. The buffer might have been destroyed since.
+        bool isValid() const;
+    };
+
     SHAREDRESOURCE_FUNCTIONS_H(Buffer)
 
     /// @brief Create buffer.
-    Buffer(vk::Buffer buffer, vk::DeviceSize size, vk::DeviceSize offset, const Settings &settings);
+    Buffer(vk::Buffer buffer, vk::DeviceSize size, vk::DeviceSize offset, const Settings &settings, void *data = nullptr);
 
-    /// @brief Get buffer handle.
+    /// @brief Get buffer handle. Sub-allocated buffers return the handle of the shared buffer.
     vk::Buffer buffer() const;
-    /// @brief Get buffer offset.
+    /// @brief Get offset of buffer data in buffer(). Pass this when binding the buffer or writing descriptors.
+    /// Always 0 for buffers that are not sub-allocated.
     vk::DeviceSize offset() const;
     /// @brief Get buffer size.
     vk::DeviceSize size() const;
     /// @brief Get buffer settings.
     const Settings &settings() const;
+    /// @brief Get pointer to buffer memory if it is host-visible, else nullptr.
+    /// Host-visible memory stays mapped, so you can write to this directly.
+    /// @note The pointer changes if the buffer is reallocated or moved.
+    /// If the memory is not host-coherent, call MemoryPool::markDirty() after writing and MemoryPool::flushBuffers() before the device reads.
+    void *data() const;
+    /// @brief Get handle of buffer in its pool. Invalid if the buffer has been destroyed.
+    Handle handle() const;
 
 private:
     /// @brief Update buffer with new values. MemoryPool uses this to update buffer info on reallocation.
-    void updateBuffer(vk::DeviceSize newSize, vk::DeviceSize newOffset);
+    void updateBuffer(vk::Buffer newBuffer, vk::DeviceSize newSize, vk::DeviceSize newOffset, void *newData);
 
     vk::Buffer m_buffer = nullptr; // The buffer object
     vk::DeviceSize m_size = 0; // The size that was passed in allocation.
-    vk::DeviceSize m_offset = 0; // The offset of the buffer in buffer memory.
+    vk::DeviceSize m_offset = 0; // The offset of the buffer data in the buffer object.
+    void *m_data = nullptr; // Pointer to mapped buffer memory or nullptr if not host-visible.
     Settings m_settings;
+    Handle m_handle; // Set by MemoryPool.
 };
 
 /// @brief Simple memory allocator. Will pool types of memory that can go into the same category.
-/// @note Does coalesce free memory, but currently does NOT defragment memory!
+/// Free memory in pages is managed by a TlsfAllocator by default, so finding a free block is O(1) per page.
+/// Other strategies can be set per memory type or per buffer. Buffers only share pages with buffers using the same strategy.
+/// Buffers bigger than a page or that the driver prefers to have their own memory get a dedicated allocation.
+/// Images are allocated from the same pages, so they do not use up the maxMemoryAllocationCount limit either.
+/// Buffers created with Buffer::Settings::subAllocate share one vk::Buffer per page and usage, which cuts down
+/// the number of buffer objects and lets you bind one buffer and draw many buffers with different offsets.
+/// @note Does coalesce free memory. Call defragment() to compact sparsely used pages.
+/// Empty pages are released to the driver in nextFrame() after they have been idle for a while. Call trim() to release them right away.
+/// All functions can be called from multiple threads. Pages are locked individually, so threads allocating
+/// from the same memory type only contend if they hit the same page. Buffers are tracked in a slot table indexed by
+/// Buffer::Handle, so looking up a buffer is an array access instead of a map search.
 class MemoryPool: public DeviceResource
 {
 public:
     DEVICERESOURCE_FUNCTIONS_H(MemoryPool)
 
     /// @brief Get / create memory pool for device. Note that you can only have one pool per logical device.
+    /// Safe to call from multiple threads.
     static MemoryPool::Ptr create(vk::PhysicalDevice physicalDevice, vk::Device logicalDevice);
 
     /// @brief Will allocate buffer and device memory. Call updateBuffer() to fill with data.
@@ -92,24 +147,229 @@ public:
     std::vector<Buffer::Ptr> createBuffers(const std::vector<vk::DeviceSize> &sizes, const Buffer::Settings &settings);
 
     /// @brief Copy data to device memory. Depending on the ReallocStrategy it will reallocate memory if the size changes or throw.
-    /// @note If the buffer is not host-visible a staging buffer will be used.
-    void updateBuffer(Buffer::Ptr buffer, const RawData &data);
+    /// Host-visible memory is mapped persistently, so this is a plain memcpy. Writes to non-coherent memory are flushed in flushBuffers().
+    /// @note If the buffer is not host-visible the data is copied to a staging ring and a copy is submitted to the transfer queue.
+    /// This does not wait for the copy to finish. The copy is done before subsequent commands on the transfer queue read the buffer.
+    /// To use the buffer on another queue, wait for lastUploadId() with isUploadComplete() or waitForUpload() and call
+    /// recordAcquireBarriers() on that queue. If the buffer is reallocated or destroyed while the copy is in flight,
+    /// its old memory is released in nextFrame() or trim() after the copy has finished.
+    void updateBuffer(const Buffer::Ptr &buffer, const RawData &data);
+
+    /// @brief Copy data to device memory of buffer with handle. Same as updateBuffer() with the buffer.
+    /// @throw Throws if the handle is invalid or stale.
+    void updateBuffer(Buffer::Handle handle, const RawData &data);
+
+    /// @brief Copy data to a range of a buffer starting at dstOffset. The rest of the buffer is left as is and the buffer is never reallocated.
+    /// Use this to update parts of big dynamic buffers. Works like updateBuffer() otherwise.
+    /// @throw Throws if the range does not fit into the buffer.
+    void updateRange(const Buffer::Ptr &buffer, vk::DeviceSize dstOffset, const RawData &data);
+
+    /// @brief Copy data to a range of the buffer with handle starting at dstOffset. Same as updateRange() with the buffer.
+    /// @throw Throws if the handle is invalid or stale or the range does not fit into the buffer.
+    void updateRange(Buffer::Handle handle, vk::DeviceSize dstOffset, const RawData &data);
+
+    /// @brief Mark a range of a buffer as written, after writing to Buffer::data() directly.
+    /// Only needed for memory that is not host-coherent, so flushBuffers() makes the writes visible to the device.
+    /// @throw Throws if the buffer is unknown or the range exceeds the buffer size.
+    void markDirty(const Buffer::Ptr &buffer, vk::DeviceSize offset, vk::DeviceSize size);
+
+    /// @brief Make all writes to non-coherent memory since the last call visible to the device.
+    /// Written ranges are accumulated per buffer, aligned to nonCoherentAtomSize and flushed with a single vkFlushMappedMemoryRanges call.
+    /// Call this before submitting commands that read the buffers. Does nothing for host-coherent memory.
+    /// @return Number of ranges flushed.
+    uint32_t flushBuffers();
 
     /// @brief Copy multiple sets of data to device memory. Depending on the ReallocStrategy it will reallocate memory if the size changes or throw.
-    /// @note If the buffer is not host-visible a staging buffer will be used.
+    /// @note Data for buffers that are not host-visible is collected in one staging region and uploaded with a single
+    /// submission containing the copies for all buffers. Data too big for the staging ring is uploaded separately.
+    /// The buffers stay locked until the copies are submitted. If a buffer is passed more than once, the last data is written.
     void updateBuffers(const std::vector<Buffer::Ptr> &buffers, const std::vector<RawData> &data);
 
     /// @brief Destroy buffer.
-    void destroyBuffer(Buffer::Ptr buffer);
+    void destroyBuffer(const Buffer::Ptr &buffer);
+
+    /// @brief Destroy buffer with handle. Does nothing if the handle is invalid or stale.
+    void destroyBuffer(Buffer::Handle handle);
 
     /// @brief Destroy buffers.
     void destroyBuffers(const std::vector<Buffer::Ptr> &buffers);
 
+    /// @brief Will create image and allocate device memory for it from the pool pages. The image is in layout eUndefined.
+    /// If the device has a bufferImageGranularity > 1, optimal tiling images get pages of their own,
+    /// so they never share a granularity page with buffers or linear images.
+    Image::Ptr createImage(vk::Extent3D extent, const Image::Settings &settings);
+
+    /// @brief Destroy image.
+    void destroyImage(const Image::Ptr &image);
+
+    /// @brief Set queue used for copying buffer data on the device, e.g. for staging uploads or when defragmenting.
+    /// @param stagingSize Size of the host-visible staging ring used to upload data to memory that is not host-visible.
+    /// @param dstQueueFamilyIndex Family of the queue using the buffers, e.g. the graphics family. If it is not VK_QUEUE_FAMILY_IGNORED
+    /// and differs from queueFamilyIndex, staged uploads release ownership of buffers with exclusive sharing to it.
+    /// @note The queue must support transfer operations. Do not submit to it from other threads while the pool is using it.
+    /// Call this before using the pool from multiple threads.
+    /// Staged uploads are made visible with a pipeline barrier on the transfer queue. If you use the buffers on another queue,
+    /// make sure the upload is complete with isUploadComplete() or waitForUpload() and call recordAcquireBarriers() on that queue.
+    void setTransferQueue(vk::Queue queue, uint32_t queueFamilyIndex, vk::DeviceSize stagingSize = DefaultStagingSize, uint32_t dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED);
+
+    /// @brief Get id of the last staged upload submitted to the transfer queue or 0 if there was none.
+    /// Ids increase with every submission and uploads finish in order, so an id also stands for all uploads before it.
+    uint64_t lastUploadId() const;
+
+    /// @brief Returns true if the staged upload with id has finished on the device. Does not block.
+    bool isUploadComplete(uint64_t id);
+
+    /// @brief Wait for the staged upload with id to finish on the device.
+    void waitForUpload(uint64_t id);
+
+    /// @brief Record barriers acquiring ownership of the ranges of finished staged uploads for dstQueueFamilyIndex.
+    /// Call this once per frame on a command buffer of that queue before the buffers are used.
+    /// Does nothing if no ownership transfer is needed. Ranges of buffers that have been destroyed or reallocated since are skipped.
+    void recordAcquireBarriers(vk::CommandBuffer commandBuffer, vk::PipelineStageFlags dstStages = vk::PipelineStageFlagBits::eAllCommands);
+
+    /// @brief Fragmentation statistics over all pages.
+    struct FragmentationStats
+    {
+        uint32_t pageCount = 0;                 // Number of device memory pages.
+        vk::DeviceSize allocatedSize = 0;       // Byte size of all pages.
+        vk::DeviceSize usedSize = 0;            // Bytes used by buffers.
+        uint32_t freeBlockCount = 0;            // Number of free blocks.
+        vk::DeviceSize largestFreeBlock = 0;    // Byte size of largest free block.
+        float fragmentation = 0.0f;             // 1 - largestFreeBlock / free bytes. 0 means all free memory is in one block.
+    };
+
+    /// @brief Result of a defragmentation step.
+    struct DefragmentationResult
+    {
+        FragmentationStats before;              // Statistics before defragmenting.
+        FragmentationStats after;               // Statistics after defragmenting.
+        std::vector<Buffer::Ptr> movedBuffers;  // Buffers that have been moved and have a new vk::Buffer handle.
+        vk::DeviceSize movedSize = 0;           // Bytes copied.
+        uint32_t freedPages = 0;                // Number of pages released.
+    };
+
+    /// @brief Get current fragmentation statistics.
+    FragmentationStats fragmentationStats() const;
+
+    /// @brief Incrementally defragment memory. Moves buffers from sparsely used pages to denser pages
+    /// using device copies and frees pages that end up empty, except for the spare pages set with setTrimPolicy().
+    /// Call e.g. once per frame with a small budget.
+    /// @param maxSize Maximum number of bytes to move.
+    /// @param maxMoves Maximum number of buffers to move.
+    /// @note Moved buffers get a new vk::Buffer handle and offset. They must not be in use by the device and
+    /// command buffers or descriptor sets referencing them must be updated. Needs setTransferQueue() to be called before.
+    /// Blocks all other pool operations while running.
+    DefragmentationResult defragment(vk::DeviceSize maxSize, uint32_t maxMoves = UINT32_MAX);
+
+    /// @brief Set allocation strategy for buffers in memory type that use AllocationStrategy::eDefault.
+    /// Only affects pages allocated afterwards. Use e.g. eBuddy for memory types holding mostly power-of-two sized uniform blocks.
+    void setAllocationStrategy(uint32_t memoryTypeIndex, AllocationStrategy strategy);
+
+    /// @brief Set size of device memory pages for memory type. Defaults to 64 MiB.
+    /// Only affects pages allocated afterwards. Buffers bigger than a page get a dedicated allocation.
+    /// Use smaller pages for memory types holding little data, so the footprint follows the load more closely.
+    void setPageSize(uint32_t memoryTypeIndex, vk::DeviceSize pageSize);
+
+    /// @brief Get size of device memory pages for memory type.
+    vk::DeviceSize pageSize(uint32_t memoryTypeIndex);
+
+    /// @brief Set when empty pages are released to the driver.
+    /// @param spareEmptyPages Number of empty pages to keep per memory type, so allocation peaks do not allocate new pages every frame.
+    /// @param idleFrames Number of calls to nextFrame() an empty page must stay empty before it is released.
+    void setTrimPolicy(uint32_t spareEmptyPages, uint32_t idleFrames);
+
+    /// @brief Call once per frame. Releases memory of destroyed buffers whose staged uploads have finished
+    /// and pages that have been empty for longer than the trim policy allows.
+    /// @return Number of pages released.
+    uint32_t nextFrame();
+
+    /// @brief Release all empty pages now, e.g. when running out of memory or after loading a level.
+    /// @return Number of pages released.
+    uint32_t trim();
+
+    /// @brief Statistics for a memory type the pool allocates from.
+    struct MemoryTypeStats
+    {
+        uint32_t memoryTypeIndex = 0;           // Vulkan memory type index.
+        uint32_t heapIndex = 0;                 // Heap the memory type allocates from.
+        vk::MemoryPropertyFlags properties;     // Properties of memory type.
+        uint32_t pageCount = 0;                 // Number of device memory pages.
+        uint32_t emptyPageCount = 0;            // Number of empty pages waiting to be released or kept as spares.
+        vk::DeviceSize pageSize = 0;            // Size of new pages.
+        vk::DeviceSize allocatedSize = 0;       // Byte size of all pages.
+        vk::DeviceSize usedSize = 0;            // Bytes used by buffers.
+        uint32_t freeBlockCount = 0;            // Number of free blocks.
+        vk::DeviceSize largestFreeBlock = 0;    // Byte size of largest free block.
+        uint32_t allocationCount = 0;           // Number of buffers.
+    };
+
+    /// @brief Statistics for a memory heap of the device.
+    struct HeapStats
+    {
+        uint32_t heapIndex = 0;                 // Vulkan memory heap index.
+        vk::MemoryHeapFlags flags;              // Flags of memory heap.
+        vk::DeviceSize heapSize = 0;            // Byte size of heap.
+        uint32_t pageCount = 0;                 // Number of device memory pages in heap.
+        vk::DeviceSize allocatedSize = 0;       // Byte size of all pages in heap.
+        vk::DeviceSize usedSize = 0;            // Bytes used by buffers in heap.
+        uint32_t allocationCount = 0;           // Number of buffers in heap.
+        vk::DeviceSize budget = 0;              // Bytes the process can allocate from heap. 80% of heap size without VK_EXT_memory_budget.
+        vk::DeviceSize usage = 0;               // Bytes the process has allocated from heap. Only pool pages without VK_EXT_memory_budget.
+    };
+
+    /// @brief Allocation statistics over all memory types and heaps.
+    struct Statistics
+    {
+        std::vector<MemoryTypeStats> memoryTypes;   // Memory types the pool has allocated from.
+        std::vector<HeapStats> heaps;               // All heaps of the device.
+        bool hasMemoryBudget = false;               // True if budget and usage are queried via VK_EXT_memory_budget.
+        uint64_t totalAllocations = 0;              // Number of buffer allocations since pool creation.
+        uint64_t totalFrees = 0;                    // Number of buffer frees since pool creation.
+        float allocationRate = 0.0f;                // Buffer allocations per second since the last call to statistics().
+    };
+
+    /// @brief Get allocation statistics for all memory types and heaps.
+    Statistics statistics();
+
+    /// @brief Get allocation statistics as a JSON string, e.g. for monitoring.
+    std::string statisticsJson();
+
+    /// @brief Set the fraction of a heaps budget the pool may use. Allocating device memory beyond that throws.
+    /// Defaults to 1, so allocations fail before the driver has to start paging.
+    void setBudgetLimit(float fraction);
+
+    /// @brief Check if size bytes of device memory can be allocated from the heap of a memory type without exceeding the budget limit.
+    /// Use this to defer allocations, e.g. streaming in assets, when memory runs out.
+    bool isWithinBudget(uint32_t memoryTypeIndex, vk::DeviceSize size) const;
+
     /// @brief Get the minimum alignment for a buffer type and its sub-buffers.
-    /// This will return minTexelBufferOffsetAlignment, minUniformBufferOffsetAlignment, minStorageBufferOffsetAlignment,
-    /// depending on the usage type. For other usage types it returns 64, which seems to be a good middle ground...
+    /// This will return the largest of minTexelBufferOffsetAlignment, minUniformBufferOffsetAlignment, minStorageBufferOffsetAlignment
+    /// for the usage flags present. For other usage types it returns 64, which seems to be a good middle ground...
     static vk::DeviceSize minAligmentFor(vk::PhysicalDevice physicalDevice, vk::BufferUsageFlags usage);
 
+    /// @brief A buffer operation passed to the trace callback.
+    struct TraceEvent
+    {
+        enum class Type
+        {
+            eCreate,  // Buffer was created with size and alignment.
+            eUpdate,  // Buffer was updated with size bytes. Range updates pass the end of the range.
+            eDestroy, // Buffer was destroyed. Its slot index can be reused after this.
+        };
+
+        Type type = Type::eCreate;
+        Buffer::Handle handle;        // Handle of buffer. Slot indices are dense, so they can be used as ids.
+        vk::DeviceSize size = 0;      // Size for eCreate and eUpdate.
+        vk::DeviceSize alignment = 0; // Required alignment for eCreate.
+    };
+    using TraceCallback = std::function<void(const TraceEvent &)>;
+
+    /// @brief Set function called for every buffer creation, update and destruction, e.g. to record an allocation trace
+    /// of an application for vsvr_bench. Pass nullptr to stop tracing.
+    /// @note The callback is called from the thread doing the operation while the buffer is locked, so events of a buffer
+    /// arrive in order. It must not call into the pool. Set this before using the pool from multiple threads.
+    void setTraceCallback(TraceCallback callback);
+
 private:
     struct Block;
     struct Page;
@@ -120,41 +380,166 @@ private:
         using Iter = std::map<uint32_t, Pool>::iterator;
 
         uint32_t memoryTypeIndex = 0;
+        uint32_t heapIndex = 0;
+        std::atomic<AllocationStrategy> strategy{AllocationStrategy::eTlsf}; // Strategy used for buffers with AllocationStrategy::eDefault.
+        std::atomic<vk::DeviceSize> pageSize{DefaultPageSize}; // Size of new pages.
         std::list<Page> pages;
+        std::vector<std::list<Page>::iterator> pageIndex; // Iterators of pages, so allocating threads can start at any page in O(1).
+        std::atomic<uint32_t> allocationCount{0}; // Number of buffers allocated from pool.
+        mutable std::shared_timed_mutex mutex; // Locked shared when allocating from pages, exclusive when adding or removing pages.
     };
     struct Page
     {
         using Iter = std::list<Page>::iterator;
 
         vk::DeviceMemory memory = nullptr;
-        std::list<Block> blocks;
+        vk::DeviceSize memorySize = 0; // Size of page memory. Can be bigger than the allocator range if the driver pads the shared buffer.
+        std::unique_ptr<PageAllocator> allocator; // Manages free and used memory in page.
+        AllocationStrategy strategy = AllocationStrategy::eTlsf; // Strategy of page allocator.
         Pool::Iter pool;
+        void *mapped = nullptr; // Pointer to mapped page memory if host-visible.
+        bool dedicated = false; // If true the page memory is dedicated to a single buffer.
+        bool coherent = true; // False if writes to mapped memory must be flushed.
+        bool optimalImages = false; // If true the page holds only optimal tiling images, because of bufferImageGranularity.
+        vk::Buffer sharedBuffer = nullptr; // Buffer spanning the whole page that buffers are sub-allocated from or nullptr.
+        vk::BufferUsageFlags sharedUsage; // Usage of shared buffer.
+        uint64_t emptySince = 0; // Frame the page became empty. Protected by the page mutex.
+        size_t index = 0; // Index of page in pool pageIndex.
+        std::mutex mutex; // Protects the page allocator.
     };
     struct Block
     {
-        using Iter = std::list<Block>::iterator;
-
-        vk::Buffer buffer = nullptr; // Buffer handle.
+        vk::Buffer buffer = nullptr; // Buffer handle. The shared buffer of the page for sub-allocated buffers.
         vk::DeviceSize size = 0; // Size of buffer.
         vk::DeviceSize offset = 0; // Offset of buffer in page memory.
         vk::DeviceSize requiredAlignment = 0; // Required aligment for this buffer.
+        uint32_t allocatorBlock = PageAllocator::InvalidBlock; // Block index in page allocator.
         Page::Iter page;
+        uint64_t uploadId = 0; // Id of the last staged upload to the block. The block must not be released before it has finished.
+    };
+    static const uint32_t SlotChunkSize = 4096; // Slots per chunk.
+    static const uint32_t MaxSlotChunks = 1024; // Maximum number of chunks. Chunks are never freed, so slots never move.
+    static const uint32_t SlotLockCount = 16; // Number of slot locks. Slot i is protected by lock i % SlotLockCount.
+    struct DirtyRange
+    {
+        vk::DeviceSize begin = 0; // Offset of first byte written in buffer.
+        vk::DeviceSize end = 0; // Offset behind last byte written. Range is empty if end <= begin.
+    };
+    // Slot data is stored as separate arrays, so the hot block data is packed densely
+    struct SlotChunk
+    {
+        std::array<uint32_t, SlotChunkSize> generations = {}; // Incremented when the buffer in a slot is destroyed.
+        std::array<Block, SlotChunkSize> blocks;
+        std::array<Buffer::Ptr, SlotChunkSize> buffers; // nullptr if slot is free.
+        std::array<DirtyRange, SlotChunkSize> dirty; // Range written to non-coherent memory since the last flush.
+    };
+    struct StagedUpload
+    {
+        Block block; // Destination block.
+        vk::DeviceSize offset = 0; // Offset in destination buffer.
+        const void *data = nullptr;
+        vk::DeviceSize size = 0;
+        Buffer::Handle handle; // Handle of destination buffer.
+        bool release = false; // If true ownership of the range is released to the destination queue family.
+    };
+    struct AcquireRange
+    {
+        Buffer::Handle handle; // Handle of buffer.
+        vk::Buffer buffer = nullptr; // Buffer object the range was released in.
+        vk::DeviceSize blockOffset = 0; // Offset of buffer block in page when the range was released.
+        vk::DeviceSize offset = 0; // Offset of range in buffer object.
+        vk::DeviceSize size = 0;
     };
+    // Locking order is slot -> slots / images -> dirty -> pools -> pool -> page -> transfer. Locks are never held while acquiring one to the left.
+    mutable std::mutex m_poolsMutex; // Protects m_pools, but not the pools in it.
     std::map<uint32_t, Pool> m_pools; // Memory pools for a specific memory type index found via findMemoryTypeIndex()
-    std::map<Buffer::Ptr, std::list<Block>::iterator> m_buffers; // for fast access to block of buffers
+    std::map<std::pair<vk::BufferUsageFlags, vk::MemoryPropertyFlags>, vk::MemoryRequirements> m_sharedRequirements; // Requirements of shared buffers. Protected by m_poolsMutex.
+    std::mutex m_slotsMutex; // Protects m_freeSlots and chunk creation.
+    std::array<std::unique_ptr<SlotChunk>, MaxSlotChunks> m_slotChunks; // Slot table for buffers.
+    std::atomic<uint32_t> m_slotCount{0}; // Number of slots in use or on free list. Increased after the chunk is created.
+    std::vector<uint32_t> m_freeSlots; // Indices of free slots for reuse.
+    std::array<std::mutex, SlotLockCount> m_slotLocks; // Locks striped over slots, so threads rarely contend.
+    std::mutex m_imagesMutex; // Protects m_images.
+    std::map<Image::Ptr, Block> m_images; // Blocks of images. Images are created rarely, so a map is fine.
+    std::mutex m_dirtyMutex; // Protects m_dirtySlots.
+    std::vector<uint32_t> m_dirtySlots; // Slots with a non-empty dirty range. Might contain slots that have been flushed or destroyed since.
     vk::PhysicalDevice m_physicalDevice = nullptr;
+    vk::Queue m_transferQueue = nullptr; // Queue used for device copies.
+    uint32_t m_transferFamily = 0; // Queue family index of transfer queue.
+    vk::CommandPool m_transferCommandPool = nullptr; // Command pool for transfer command buffers.
+    vk::DeviceSize m_stagingSize = DefaultStagingSize; // Size of staging ring.
+    std::shared_ptr<StagingRing> m_stagingRing; // Staging ring for uploads. Created in setTransferQueue().
+    std::mutex m_transferMutex; // Protects transfer queue, command pool, staging ring and m_acquireRanges.
+    uint32_t m_dstFamily = VK_QUEUE_FAMILY_IGNORED; // Queue family staged uploads release ownership to.
+    std::atomic<uint64_t> m_uploadId{0}; // Id of the last staged upload submitted.
+    std::atomic<uint64_t> m_completedUploadId{0}; // Id of the last staged upload that has finished.
+    std::vector<AcquireRange> m_acquireRanges; // Ranges of finished uploads released to the destination family.
+    std::mutex m_deferredMutex; // Protects m_deferredBlocks. Never held while acquiring another lock.
+    std::vector<Block> m_deferredBlocks; // Blocks of destroyed or reallocated buffers waiting for their uploads to finish.
+    bool m_hasMemoryBudget = false; // True if VK_EXT_memory_budget is supported.
+    std::atomic<float> m_budgetLimit{1.0f}; // Fraction of heap budget pool may use.
+    std::array<std::atomic<vk::DeviceSize>, VK_MAX_MEMORY_HEAPS> m_heapAllocatedSize; // Bytes of pages allocated per heap.
+    std::atomic<uint64_t> m_allocationCount{0}; // Buffer allocations since pool creation.
+    std::atomic<uint64_t> m_freeCount{0}; // Buffer frees since pool creation.
+    uint64_t m_lastStatsAllocationCount = 0; // Allocations at last call to statistics(). Protected by m_poolsMutex.
+    std::chrono::steady_clock::time_point m_lastStatsTime; // Time of last call to statistics(). Protected by m_poolsMutex.
+    std::atomic<uint64_t> m_frame{0}; // Number of calls to nextFrame().
+    std::atomic<uint32_t> m_spareEmptyPages{DefaultSpareEmptyPages}; // Empty pages kept per memory type.
+    std::atomic<uint32_t> m_trimIdleFrames{DefaultTrimIdleFrames}; // Frames a page must be empty before it is released.
+    TraceCallback m_traceCallback; // Called for buffer operations if set.
 
     MemoryPool(vk::PhysicalDevice physicalDevice, vk::Device logicalDevice);
-    Page allocatePage(Pool::Iter pool, vk::DeviceSize pageSize);
-    Block::Iter getFreeBlockAligned(Pool::Iter pool, vk::DeviceSize requiredSize, vk::DeviceSize requiredAlignment);
-    vk::DeviceSize getOffsetShiftForAlignment(const Block::Iter block, vk::DeviceSize requiredAlignment);
-    vk::DeviceSize getUsableBlockSizeForAlignment(const Block::Iter block, vk::DeviceSize requiredAlignment);
-    Block::Iter allocateMemory(vk::Buffer buffer, vk::DeviceSize size, const Buffer::Settings &settings);
-    Block::Iter reallocateMemory(Buffer::Ptr buffer, vk::DeviceSize size);
-    void combineBlockWithFreeNeighbours(Block::Iter block);
+    Buffer::Handle allocateSlot(const Buffer::Ptr &buffer, const Block &block);
+    std::mutex &slotMutex(uint32_t index);
+    bool isValidSlot(Buffer::Handle handle) const;
+    Block &slotBlock(uint32_t index);
+    Buffer::Ptr &slotBuffer(uint32_t index);
+    DirtyRange &slotDirtyRange(uint32_t index);
+    void addDirtyRange(uint32_t index, vk::DeviceSize offset, vk::DeviceSize size);
+    uint32_t flushDirtyRanges();
+    void writeRange(uint32_t index, vk::DeviceSize dstOffset, const RawData &data);
+    void trace(TraceEvent::Type type, Buffer::Handle handle, vk::DeviceSize size = 0, vk::DeviceSize alignment = 0) const;
+    Pool::Iter getPool(uint32_t memTypeIndex);
+    Page::Iter allocatePage(Pool::Iter pool, vk::DeviceSize pageSize, AllocationStrategy strategy, const vk::MemoryDedicatedAllocateInfo *dedicatedInfo = nullptr, vk::BufferUsageFlags sharedUsage = vk::BufferUsageFlags(), bool optimalImages = false);
+    void freePage(Page::Iter page);
+    uint32_t releaseEmptyPages(uint32_t spareEmptyPages, uint32_t idleFrames);
+    /// @brief Release empty pages of a pool like releaseEmptyPages(). The caller must hold the exclusive lock of the pool.
+    uint32_t releaseEmptyPagesLocked(Pool::Iter pool, uint32_t spareEmptyPages, uint32_t idleFrames);
+    void queryHeapBudgets(std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> &budget, std::array<vk::DeviceSize, VK_MAX_MEMORY_HEAPS> &usage) const;
+    Block getFreeBlockAligned(Pool::Iter pool, vk::DeviceSize requiredSize, vk::DeviceSize requiredAlignment, AllocationStrategy strategy, vk::BufferUsageFlags sharedUsage = vk::BufferUsageFlags(), bool optimalImages = false);
+    Block allocateMemory(vk::Buffer buffer, vk::DeviceSize size, const Buffer::Settings &settings);
+    Block allocateImageMemory(vk::Image image, const Image::Settings &settings);
+    Block allocateBlock(const vk::MemoryRequirements &memRequirements, const vk::MemoryDedicatedRequirements &dedicatedRequirements, const vk::MemoryDedicatedAllocateInfo &dedicatedInfo, vk::DeviceSize size, uint32_t memTypeIndex, AllocationStrategy strategy, bool optimalImages);
+    Block allocateUnsharedBuffer(vk::DeviceSize size, const Buffer::Settings &settings);
+    Block allocateSharedMemory(vk::DeviceSize size, const Buffer::Settings &settings);
+    /// @brief Call allocate with the memory types in order until it succeeds. Falls back to the next type only if the heap is out of memory or budget.
+    /// @param size Size of the resource, to check if a page for it fits into the budget.
+    Block allocateWithFallback(const std::vector<uint32_t> &memTypeIndices, vk::DeviceSize size, const std::function<Block(uint32_t memTypeIndex)> &allocate);
+    Block allocateBuffer(vk::DeviceSize size, const Buffer::Settings &settings);
+    void releaseBuffer(const Block &block);
+    void destroyBlock(const Block &block);
+    void releaseDeferredBlocks();
+    static vk::DeviceSize bufferOffset(const Block &block);
+    static vk::MemoryPropertyFlags memoryProperties(vk::MemoryPropertyFlags properties, MemoryUsage memoryUsage);
+    void reallocateMemory(const Buffer::Ptr &buffer, Block &block, vk::DeviceSize size);
+    void freeBlock(const Block &block);
+    FragmentationStats collectFragmentationStats() const;
+    void *blockData(const Block &block) const;
+    vk::Buffer createBufferObject(vk::DeviceSize size, const Buffer::Settings &settings);
+    vk::CommandBuffer beginTransferCommands();
+    void submitTransferCommandsAndWait(vk::CommandBuffer commandBuffer);
+    uint64_t submitTransferCommands(vk::CommandBuffer commandBuffer, const std::vector<AcquireRange> &acquireRanges);
+    StagingRing &stagingRing();
+    bool needsOwnershipTransfer(const Buffer::Settings &settings) const;
+    uint64_t uploadStaged(const StagedUpload &upload);
+    uint64_t uploadStagedBatch(const std::vector<StagedUpload> &uploads);
 
     static const vk::DeviceSize DefaultPageSize = 64*1024*1024;
+    static const vk::DeviceSize DefaultStagingSize = 16*1024*1024;
+    static const uint32_t DefaultSpareEmptyPages = 1;
+    static const uint32_t DefaultTrimIdleFrames = 60;
     static std::map<vk::Device, MemoryPool::Ptr> DevicePools;
+    static std::mutex DevicePoolsMutex;
 };
 
 }
@@ -1,6 +1,10 @@
 #include "vkbuffers.h"
 
+#include "vkutils.h"
+#include <algorithm>
+#include <cstring>
 #include <numeric>
+#include <stdexcept>
 
 namespace vsvr
 {
@@ -11,7 +15,15 @@ IndexBuffer::IndexBuffer(MemoryPool::Ptr pool, vk::IndexType indexType, vk::Devi
     : m_pool(pool)
     , m_indexType(indexType)
 {
-    pool->createBuffer(size, settings);
+    m_buffer = pool->createBuffer(size, settings);
+}
+
+IndexBuffer::~IndexBuffer()
+{
+    if (m_pool && m_buffer)
+    {
+        m_pool->destroyBuffer(m_buffer);
+    }
 }
 
 IndexBuffer &IndexBuffer::operator=(IndexBuffer &&other)
@@ -21,6 +33,7 @@ IndexBuffer &IndexBuffer::operator=(IndexBuffer &&other)
         m_pool = std::move(other.m_pool); other.m_pool = nullptr;
         m_buffer = std::move(other.m_buffer); other.m_buffer = nullptr;
         m_indexType = std::move(other.m_indexType); other.m_indexType = vk::IndexType();
+        m_indexCount = std::move(other.m_indexCount); other.m_indexCount = 0;
     }
     return *this;
 }
@@ -28,6 +41,30 @@ IndexBuffer &IndexBuffer::operator=(IndexBuffer &&other)
 void IndexBuffer::update(const RawData &data)
 {
     m_pool->updateBuffer(m_buffer, data);
+    m_indexCount = static_cast<uint32_t>(data.copySize() / (m_indexType == vk::IndexType::eUint16 ? 2 : 4));
+}
+
+void IndexBuffer::update(std::vector<uint32_t> indices, uint32_t vertexCount, bool optimize)
+{
+    if (optimize)
+    {
+        optimizeVertexCache(indices, vertexCount);
+    }
+    if (canNarrowIndices(vertexCount))
+    {
+        m_indexType = vk::IndexType::eUint16;
+        update(RawData(narrowIndices(indices)));
+    }
+    else
+    {
+        m_indexType = vk::IndexType::eUint32;
+        update(RawData(indices));
+    }
+}
+
+Buffer::Ptr IndexBuffer::buffer() const
+{
+    return m_buffer;
 }
 
 vk::IndexType IndexBuffer::indexType() const
@@ -35,6 +72,11 @@ vk::IndexType IndexBuffer::indexType() const
     return m_indexType;
 }
 
+uint32_t IndexBuffer::indexCount() const
+{
+    return m_indexCount;
+}
+
 SHAREDRESOURCE_FUNCTIONS_CPP(VertexBuffer)
 
 VertexBuffer::VertexBuffer(MemoryPool::Ptr pool, const std::vector<std::pair<Attribute, vk::DeviceSize>> &attributes, const Buffer::Settings &settings)
@@ -42,10 +84,16 @@ VertexBuffer::VertexBuffer(MemoryPool::Ptr pool, const std::vector<std::pair<Att
 {
     for (const auto & a : attributes)
     {
+        // quantized attributes are tightly packed in their new format
+        const vk::Format format = quantizedFormat(a.first.format, a.first.quantization);
+        const bool quantized = a.first.quantization != Quantization::eNone;
+        const uint32_t stride = quantized ? formatSize(format) : a.first.stride;
+        const vk::DeviceSize size = quantized ? a.second / formatSize(a.first.format) * stride : a.second;
         m_firstBinding = std::min(m_firstBinding, a.first.vertexBinding);
-        m_vertexBindings.push_back({a.first.vertexBinding, a.first.stride, a.first.inputRate});
-        m_attributeBindings.push_back({a.first.attributeLocation, a.first.attributeBinding, a.first.format, 0});
-        m_buffers.emplace_back(m_pool->createBuffer(a.second, settings)); 
+        m_vertexBindings.push_back({a.first.vertexBinding, stride, a.first.inputRate});
+        m_attributeBindings.push_back({a.first.attributeLocation, a.first.attributeBinding, format, 0});
+        m_quantizations.emplace_back(a.first.format, a.first.quantization);
+        m_buffers.emplace_back(m_pool->createBuffer(size, settings)); 
     }
 }
 
@@ -55,6 +103,7 @@ VertexBuffer &VertexBuffer::operator=(VertexBuffer &&other)
     {
         m_pool = std::move(other.m_pool); other.m_pool = nullptr;
         m_buffers = std::move(other.m_buffers); other.m_buffers.clear();
+        m_quantizations = std::move(other.m_quantizations); other.m_quantizations.clear();
         m_firstBinding = std::move(other.m_firstBinding); other.m_firstBinding = 0;
         m_vertexBindings = std::move(other.m_vertexBindings); other.m_vertexBindings.clear();
         m_attributeBindings = std::move(other.m_attributeBindings); other.m_attributeBindings.clear();
@@ -64,7 +113,27 @@ VertexBuffer &VertexBuffer::operator=(VertexBuffer &&other)
 
 void VertexBuffer::update(const std::vector<RawData> &data)
 {
-    m_pool->updateBuffers(buffers(), data);
+    if (std::none_of(m_quantizations.cbegin(), m_quantizations.cend(), [](const auto & q){ return q.second != Quantization::eNone; }))
+    {
+        m_pool->updateBuffers(buffers(), data);
+        return;
+    }
+    // quantize data, but keep passing unquantized data as is
+    std::vector<std::vector<uint8_t>> quantized(data.size());
+    std::vector<RawData> quantizedData;
+    for (uint32_t i = 0; i < data.size(); i++)
+    {
+        if (i < m_quantizations.size() && m_quantizations[i].second != Quantization::eNone)
+        {
+            quantized[i] = quantize(data[i], m_quantizations[i].first, m_quantizations[i].second);
+            quantizedData.emplace_back(quantized[i]);
+        }
+        else
+        {
+            quantizedData.push_back(data[i]);
+        }
+    }
+    m_pool->updateBuffers(buffers(), quantizedData);
 }
 
 std::vector<Buffer::Ptr> VertexBuffer::buffers() const
@@ -99,4 +168,130 @@ const std::vector<vk::VertexInputAttributeDescription> &VertexBuffer::attributeB
     return m_attributeBindings;
 }
 
+SHAREDRESOURCE_FUNCTIONS_CPP(InterleavedVertexBuffer)
+
+InterleavedVertexBuffer::InterleavedVertexBuffer(MemoryPool::Ptr pool, const std::vector<Attribute> &attributes, uint32_t vertexCount, const Buffer::Settings &settings)
+    : m_pool(pool)
+    , m_vertexCount(vertexCount)
+{
+    if (attributes.empty())
+    {
+        throw std::runtime_error("Interleaved vertex buffer needs at least one attribute!");
+    }
+    // pack attributes in order, aligning each to AttributeAlignment
+    const uint32_t binding = attributes.front().vertexBinding;
+    for (const auto & a : attributes)
+    {
+        const vk::Format format = quantizedFormat(a.format, a.quantization);
+        const uint32_t size = formatSize(format);
+        m_attributeBindings.push_back({a.attributeLocation, binding, format, m_stride});
+        m_attributeSizes.push_back(size);
+        m_quantizations.emplace_back(a.format, a.quantization);
+        m_stride += (size + AttributeAlignment - 1) & ~(AttributeAlignment - 1);
+    }
+    m_vertexBindings.push_back({binding, m_stride, attributes.front().inputRate});
+    m_buffer = m_pool->createBuffer(static_cast<vk::DeviceSize>(m_stride) * vertexCount, settings);
+}
+
+InterleavedVertexBuffer::~InterleavedVertexBuffer()
+{
+    if (m_pool && m_buffer)
+    {
+        m_pool->destroyBuffer(m_buffer);
+    }
+}
+
+InterleavedVertexBuffer &InterleavedVertexBuffer::operator=(InterleavedVertexBuffer &&other)
+{
+    if (&other != this)
+    {
+        m_pool = std::move(other.m_pool); other.m_pool = nullptr;
+        m_buffer = std::move(other.m_buffer); other.m_buffer = nullptr;
+        m_stride = std::move(other.m_stride); other.m_stride = 0;
+        m_vertexCount = std::move(other.m_vertexCount); other.m_vertexCount = 0;
+        m_attributeSizes = std::move(other.m_attributeSizes); other.m_attributeSizes.clear();
+        m_quantizations = std::move(other.m_quantizations); other.m_quantizations.clear();
+        m_vertexBindings = std::move(other.m_vertexBindings); other.m_vertexBindings.clear();
+        m_attributeBindings = std::move(other.m_attributeBindings); other.m_attributeBindings.clear();
+    }
+    return *this;
+}
+
+void InterleavedVertexBuffer::update(const std::vector<RawData> &data)
+{
+    if (data.size() != m_attributeSizes.size())
+    {
+        throw std::runtime_error("Need data for every attribute of interleaved vertex buffer!");
+    }
+    const vk::DeviceSize vertexCount = data.front().copySize() / formatSize(m_quantizations.front().first);
+    for (uint32_t i = 0; i < data.size(); i++)
+    {
+        if (data[i].copySize() != vertexCount * formatSize(m_quantizations[i].first))
+        {
+            throw std::runtime_error("Attribute data must have the same number of vertices!");
+        }
+    }
+    // copy attribute by attribute. reads are sequential and padding stays zero
+    std::vector<uint8_t> interleaved(vertexCount * m_stride, 0);
+    std::vector<uint8_t> quantized;
+    for (uint32_t i = 0; i < data.size(); i++)
+    {
+        const uint32_t size = m_attributeSizes[i];
+        auto src = static_cast<const uint8_t *>(data[i].begin());
+        if (m_quantizations[i].second != Quantization::eNone)
+        {
+            quantized = quantize(data[i], m_quantizations[i].first, m_quantizations[i].second);
+            src = quantized.data();
+        }
+        auto dst = interleaved.data() + m_attributeBindings[i].offset;
+        for (vk::DeviceSize v = 0; v < vertexCount; v++, src += size, dst += m_stride)
+        {
+            std::memcpy(dst, src, size);
+        }
+    }
+    m_pool->updateBuffer(m_buffer, RawData(interleaved));
+    m_vertexCount = static_cast<uint32_t>(vertexCount);
+}
+
+void InterleavedVertexBuffer::update(const RawData &data)
+{
+    m_pool->updateBuffer(m_buffer, data);
+    m_vertexCount = static_cast<uint32_t>(data.copySize() / m_stride);
+}
+
+Buffer::Ptr InterleavedVertexBuffer::buffer() const
+{
+    return m_buffer;
+}
+
+vk::DeviceSize InterleavedVertexBuffer::offset() const
+{
+    return m_buffer->offset();
+}
+
+uint32_t InterleavedVertexBuffer::binding() const
+{
+    return m_vertexBindings.front().binding;
+}
+
+uint32_t InterleavedVertexBuffer::stride() const
+{
+    return m_stride;
+}
+
+uint32_t InterleavedVertexBuffer::vertexCount() const
+{
+    return m_vertexCount;
+}
+
+const std::vector<vk::VertexInputBindingDescription> &InterleavedVertexBuffer::vertexBindings() const
+{
+    return m_vertexBindings;
+}
+
+const std::vector<vk::VertexInputAttributeDescription> &InterleavedVertexBuffer::attributeBindings() const
+{
+    return m_attributeBindings;
+}
+
 } // namespace vsvr
@@ -3,6 +3,8 @@
 #include "vkincludes.h"
 #include "vkresource.h"
 #include "vkbuffer.h"
+#include "vkindexopt.h"
+#include "vkquantize.h"
 #include <vector>
 #include <utility>
 #include <string>
@@ -26,15 +28,25 @@ public:
     /// @brief Update index data. Will reallocate depending on ReallocationStrategy passed in constructor.
     void update(const RawData &data);
 
+    /// @brief Update from a triangle list for vertexCount vertices, optionally reordered with optimizeVertexCache().
+    /// Indices are narrowed to 16 bit if vertexCount allows it and indexType() changes accordingly.
+    /// Will reallocate depending on ReallocationStrategy passed in constructor.
+    /// @note To also optimize vertex fetch, call optimizeVertexCache() and optimizeVertexFetch() yourself, remap the vertex data and pass optimize = false.
+    void update(std::vector<uint32_t> indices, uint32_t vertexCount, bool optimize = true);
+
+    Buffer::Ptr buffer() const;
     vk::IndexType indexType() const;
+    /// @brief Get number of indices of last update.
+    uint32_t indexCount() const;
 
 private:
     MemoryPool::Ptr m_pool;
     Buffer::Ptr m_buffer;
     vk::IndexType m_indexType;
+    uint32_t m_indexCount = 0;
 };
 
-/// @brief Struct describing a vertex attribute for non-interleaved usage.
+/// @brief Struct describing a vertex attribute for VertexBuffer or InterleavedVertexBuffer.
 struct Attribute
 {
     std::string name;
@@ -44,6 +56,7 @@ struct Attribute
     uint32_t attributeLocation = 0;
     uint32_t attributeBinding = 0;
     vk::Format format;
+    Quantization quantization = Quantization::eNone; // Compress data in format when uploading. The buffer then uses quantizedFormat() and its stride.
 };
 
 /// @brief Vertex buffer with non-interleaved attribute data.
@@ -53,13 +66,16 @@ public:
     SHAREDRESOURCE_FUNCTIONS_H(VertexBuffer)
 
     /// @brief Construct a vertex buffer on device. Call update() to fill with data.
+    /// Buffer sizes are for data in the attribute formats and are scaled down for quantized attributes.
     /// @note Make sure you set the vk::BufferUsageFlagBits::eVertexBuffer flag bit.
+    /// @throw Throws if an attribute quantization does not support its format.
     VertexBuffer(MemoryPool::Ptr pool, const std::vector<std::pair<Attribute, vk::DeviceSize>> &attributes, const Buffer::Settings &settings);
 
     /// @brief Destroy vertex buffer on device. Note that the buffer will immediately be destroyed.
     ~VertexBuffer();
 
     /// @brief Update attribute data. Will reallocate depending on ReallocationStrategy passed in constructor.
+    /// Data of quantized attributes is passed in the attribute format and quantized before uploading.
     /// @note data must have the SAME order as used in setAttributes()!
     void update(const std::vector<RawData> &data);
 
@@ -73,9 +89,62 @@ public:
 private:
     MemoryPool::Ptr m_pool;
     std::vector<Buffer::Ptr> m_buffers;
+    std::vector<std::pair<vk::Format, Quantization>> m_quantizations; // Source format and quantization per attribute.
     uint32_t m_firstBinding = 0;
     std::vector<vk::VertexInputBindingDescription> m_vertexBindings;
     std::vector<vk::VertexInputAttributeDescription> m_attributeBindings;
 };
 
+/// @brief Vertex buffer with interleaved attribute data in a single buffer.
+/// Attributes are packed in the order passed to the constructor, so all attributes of a vertex are fetched from one place in memory.
+class InterleavedVertexBuffer
+{
+public:
+    SHAREDRESOURCE_FUNCTIONS_H(InterleavedVertexBuffer)
+
+    /// @brief Attribute offsets are aligned to this many bytes.
+    static const uint32_t AttributeAlignment = 4;
+
+    /// @brief Construct a vertex buffer on device for vertexCount vertices. Call update() to fill with data.
+    /// Attribute offsets and the vertex stride are computed from the attribute formats, after quantization.
+    /// The binding number and input rate are taken from the first attribute. stride and attributeBinding of attributes are ignored.
+    /// @note Make sure you set the vk::BufferUsageFlagBits::eVertexBuffer flag bit.
+    /// @throw Throws if attributes is empty or a format has no byte size.
+    InterleavedVertexBuffer(MemoryPool::Ptr pool, const std::vector<Attribute> &attributes, uint32_t vertexCount, const Buffer::Settings &settings);
+
+    /// @brief Destroy vertex buffer on device. Note that the buffer will immediately be destroyed.
+    ~InterleavedVertexBuffer();
+
+    /// @brief Update from non-interleaved attribute data, which is quantized and interleaved on the CPU before uploading.
+    /// Will reallocate depending on ReallocationStrategy passed in constructor.
+    /// @note data must have the SAME order as the attributes passed in the constructor!
+    /// @throw Throws if the number of data entries is wrong or the attribute data has different vertex counts.
+    void update(const std::vector<RawData> &data);
+
+    /// @brief Update from data that is already quantized and interleaved with stride().
+    /// Will reallocate depending on ReallocationStrategy passed in constructor.
+    void update(const RawData &data);
+
+    Buffer::Ptr buffer() const;
+    /// @brief Get offset to pass to vkCmdBindVertexBuffers.
+    vk::DeviceSize offset() const;
+    uint32_t binding() const;
+    /// @brief Get byte size of a vertex.
+    uint32_t stride() const;
+    /// @brief Get number of vertices of last update or passed in constructor.
+    uint32_t vertexCount() const;
+    const std::vector<vk::VertexInputBindingDescription> & vertexBindings() const;
+    const std::vector<vk::VertexInputAttributeDescription> & attributeBindings() const;
+
+private:
+    MemoryPool::Ptr m_pool;
+    Buffer::Ptr m_buffer;
+    uint32_t m_stride = 0;
+    uint32_t m_vertexCount = 0;
+    std::vector<uint32_t> m_attributeSizes; // Byte size of attributes in buffer.
+    std::vector<std::pair<vk::Format, Quantization>> m_quantizations; // Source format and quantization per attribute.
+    std::vector<vk::VertexInputBindingDescription> m_vertexBindings;
+    std::vector<vk::VertexInputAttributeDescription> m_attributeBindings;
+};
+
 } // namespace vsvr
@@ -1,6 +1,7 @@
 #include "vkdevice.h"
 
 #include "vkutils.h"
+#include <algorithm>
 #include <set>
 #include <stdexcept>
 #include <iostream>
@@ -30,6 +31,28 @@ void QueueFamilyIndices::setPresentFamily(uint32_t index)
     m_presentFamilySet = true;
 }
 
+uint32_t QueueFamilyIndices::transferFamily() const
+{
+    return m_transferFamilySet ? m_transferFamily : m_graphicsFamily;
+}
+
+uint32_t QueueFamilyIndices::transferQueueIndex() const
+{
+    return m_transferFamilySet ? m_transferQueueIndex : 0;
+}
+
+void QueueFamilyIndices::setTransferFamily(uint32_t index, uint32_t queueIndex)
+{
+    m_transferFamily = index;
+    m_transferQueueIndex = queueIndex;
+    m_transferFamilySet = true;
+}
+
+bool QueueFamilyIndices::hasSeparateTransferQueue() const
+{
+    return transferFamily() != m_graphicsFamily || transferQueueIndex() != 0;
+}
+
 bool QueueFamilyIndices::isComplete() const
 {
     return m_graphicsFamilySet && m_presentFamilySet;
@@ -39,7 +62,7 @@ QueueFamilyIndices findQueueFamilies(vk::PhysicalDevice physicalDevice, vk::Surf
 {
     QueueFamilyIndices indices;
     auto queueFamilies = physicalDevice.getQueueFamilyProperties();
-    for (uint32_t familyIndex = 0; familyIndex < queueFamilies.size(); familyIndex++)
+    for (uint32_t familyIndex = 0; familyIndex < queueFamilies.size() && !indices.isComplete(); familyIndex++)
     {
         const auto &queueFamily = queueFamilies.at(familyIndex);
         if (queueFamily.queueFlags & vk::QueueFlagBits::eGraphics)
@@ -51,11 +74,30 @@ QueueFamilyIndices findQueueFamilies(vk::PhysicalDevice physicalDevice, vk::Surf
         {
             indices.setPresentFamily(familyIndex);
         }
-        if (indices.isComplete())
+    }
+    // prefer a family that can only transfer. these usually map to the DMA engines and run in parallel to rendering.
+    // next best is a family without graphics, e.g. async compute
+    int32_t bestScore = 0;
+    for (uint32_t familyIndex = 0; familyIndex < queueFamilies.size(); familyIndex++)
+    {
+        const auto &flags = queueFamilies.at(familyIndex).queueFlags;
+        // compute queues support transfers implicitly
+        if ((flags & vk::QueueFlagBits::eGraphics) || !(flags & (vk::QueueFlagBits::eTransfer | vk::QueueFlagBits::eCompute)))
+        {
+            continue;
+        }
+        const int32_t score = (flags & vk::QueueFlagBits::eCompute) ? 1 : 2;
+        if (score > bestScore)
         {
-            break;
+            bestScore = score;
+            indices.setTransferFamily(familyIndex);
         }
     }
+    // no separate family. use a second queue of the graphics family if there is one
+    if (bestScore == 0 && indices.isComplete() && queueFamilies.at(indices.graphicsFamily()).queueCount > 1)
+    {
+        indices.setTransferFamily(indices.graphicsFamily(), 1);
+    }
     return indices;
 }
 
@@ -77,12 +119,113 @@ uint32_t findMemoryTypeIndex(vk::PhysicalDevice physicalDevice, uint32_t typeBit
     throw std::runtime_error("Failed to find suitable memory type!");
 }
 
+// score memory type flags for usage. higher is better, negative means the type can not be used
+static int32_t scoreMemoryType(vk::MemoryPropertyFlags flags, vk::MemoryPropertyFlags properties, MemoryUsage usage)
+{
+    if ((flags & properties) != properties)
+    {
+        return -1;
+    }
+    // lazily allocated and protected memory is only usable for special cases
+    if ((flags & (vk::MemoryPropertyFlagBits::eLazilyAllocated | vk::MemoryPropertyFlagBits::eProtected)) & ~properties)
+    {
+        return -1;
+    }
+    const bool deviceLocal = (flags & vk::MemoryPropertyFlagBits::eDeviceLocal) ? true : false;
+    const bool hostVisible = (flags & vk::MemoryPropertyFlagBits::eHostVisible) ? true : false;
+    const bool hostCoherent = (flags & vk::MemoryPropertyFlagBits::eHostCoherent) ? true : false;
+    const bool hostCached = (flags & vk::MemoryPropertyFlagBits::eHostCached) ? true : false;
+    int32_t score = 0;
+    switch (usage)
+    {
+        case MemoryUsage::eGpuOnly:
+            score += deviceLocal ? 100 : 0;
+            // leave device-local host-visible memory to streaming data. it is often small
+            score -= hostVisible ? 10 : 0;
+            break;
+        case MemoryUsage::eCpuToGpu:
+            if (!hostVisible)
+            {
+                return -1;
+            }
+            // the device reads directly from its own memory and the host writes without a staging copy
+            score += deviceLocal ? 100 : 0;
+            score += hostCoherent ? 10 : 0;
+            // uncached write-combined memory is faster for sequential writes
+            score -= hostCached ? 5 : 0;
+            break;
+        case MemoryUsage::eGpuToCpu:
+            if (!hostVisible)
+            {
+                return -1;
+            }
+            // reading uncached memory from the host is very slow
+            score += hostCached ? 100 : 0;
+            score += hostCoherent ? 10 : 0;
+            break;
+        default:
+            break;
+    }
+    return score;
+}
+
+uint32_t findMemoryTypeIndex(vk::PhysicalDevice physicalDevice, uint32_t typeBits, vk::MemoryPropertyFlags properties, MemoryUsage usage)
+{
+    return findMemoryTypeIndices(physicalDevice, typeBits, properties, usage).front();
+}
+
+std::vector<uint32_t> findMemoryTypeIndices(vk::PhysicalDevice physicalDevice, uint32_t typeBits, vk::MemoryPropertyFlags properties, MemoryUsage usage)
+{
+    if (usage == MemoryUsage::eUnknown)
+    {
+        return {findMemoryTypeIndex(physicalDevice, typeBits, properties)};
+    }
+    const auto &memProperties = DeviceInfoCache::getMemoryProperties(physicalDevice);
+    struct Candidate
+    {
+        uint32_t index;
+        int32_t score;
+        vk::DeviceSize heapSize;
+    };
+    std::vector<Candidate> candidates;
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+    {
+        if ((typeBits & (1 << i)) == 0)
+        {
+            continue;
+        }
+        const auto &memoryType = memProperties.memoryTypes[i];
+        const auto score = scoreMemoryType(memoryType.propertyFlags, properties, usage);
+        if (score >= 0)
+        {
+            candidates.push_back({i, score, memProperties.memoryHeaps[memoryType.heapIndex].size});
+        }
+    }
+    if (candidates.empty())
+    {
+        throw std::runtime_error("Failed to find suitable memory type!");
+    }
+    // best score first, bigger heaps first if equal. stable, so equal types keep their order
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate & a, const Candidate & b){ return a.score > b.score || (a.score == b.score && a.heapSize > b.heapSize); });
+    std::vector<uint32_t> indices;
+    for (const auto & candidate : candidates)
+    {
+        indices.push_back(candidate.index);
+    }
+    return indices;
+}
+
 // ------------------------------------------------------------------------------------------------
 
 const std::vector<const char*> deviceExtensions = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
 
+const std::vector<const char*> optionalDeviceExtensions = {
+    VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+    VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME
+};
+
 bool checkDeviceExtensionSupport(vk::PhysicalDevice physicalDevice)
 {
     auto deviceExtensionProperties = physicalDevice.enumerateDeviceExtensionProperties();
@@ -94,6 +237,19 @@ bool checkDeviceExtensionSupport(vk::PhysicalDevice physicalDevice)
     return requiredExtensions.empty();
 }
 
+bool isDeviceExtensionSupported(vk::PhysicalDevice physicalDevice, const char *extensionName)
+{
+    auto deviceExtensionProperties = physicalDevice.enumerateDeviceExtensionProperties();
+    for (const auto &property : deviceExtensionProperties)
+    {
+        if (std::string(property.extensionName) == extensionName)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 // ------------------------------------------------------------------------------------------------
 
 vk::SurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<vk::SurfaceFormatKHR> &availableFormats, vk::Format format, vk::ColorSpaceKHR colorSpace)
@@ -273,30 +429,55 @@ vk::PhysicalDevice pickPhysicalDevice(vk::Instance instance, vk::SurfaceKHR surf
     throw std::runtime_error("Failed to find a suitable GPU!");
 }
 
-vk::Device createLogicalDevice(vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface)
+bool EnabledDeviceFeatures::hasExtension(const char *extensionName) const
+{
+    return std::find(extensions.cbegin(), extensions.cend(), extensionName) != extensions.cend();
+}
+
+vk::Device createLogicalDevice(vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface, EnabledDeviceFeatures *enabledFeatures)
 {
     auto indices = findQueueFamilies(physicalDevice, surface);
     std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily(), indices.presentFamily()};
-    float queuePriority = 1.0f;
+    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily(), indices.presentFamily(), indices.transferFamily()};
+    const float queuePriorities[] = {1.0f, 1.0f};
     for (uint32_t queueFamily : uniqueQueueFamilies)
     {
         vk::DeviceQueueCreateInfo queueCreateInfo;
         queueCreateInfo.queueFamilyIndex = queueFamily;
-        queueCreateInfo.queueCount = 1;
-        queueCreateInfo.pQueuePriorities = &queuePriority;
+        // the transfer queue might be the second queue of the graphics family
+        queueCreateInfo.queueCount = queueFamily == indices.transferFamily() ? indices.transferQueueIndex() + 1 : 1;
+        queueCreateInfo.pQueuePriorities = queuePriorities;
         queueCreateInfos.push_back(queueCreateInfo);
     }
+    // enable features for GPU-driven rendering if the device has them
+    const auto supportedFeatures = physicalDevice.getFeatures();
     vk::PhysicalDeviceFeatures deviceFeatures;
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
     vk::DeviceCreateInfo createInfo;
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    // enable optional extensions if the device has them
+    auto extensions = deviceExtensions;
+    for (auto extension : optionalDeviceExtensions)
+    {
+        if (isDeviceExtensionSupported(physicalDevice, extension))
+        {
+            extensions.push_back(extension);
+        }
+    }
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
     // note that for Vulkan < 1.1 we would need to set up validation layers here too for devices!
     createInfo.enabledLayerCount = 0;
-    return physicalDevice.createDevice(createInfo);
+    auto device = physicalDevice.createDevice(createInfo);
+    if (enabledFeatures)
+    {
+        enabledFeatures->extensions.assign(extensions.cbegin(), extensions.cend());
+        enabledFeatures->features = deviceFeatures;
+    }
+    return device;
 }
 
 void dumpDeviceInfo(vk::PhysicalDevice physicalDevice)
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "vkincludes.h"
+#include <string>
 #include <vector>
 
 namespace vsvr
@@ -14,8 +15,16 @@ public:
     void setGraphicsFamily(uint32_t index);
     uint32_t presentFamily() const;
     void setPresentFamily(uint32_t index);
+    /// @brief Get family for uploads. A transfer-only family if the device has one, else a family with fewer capabilities or the graphics family.
+    uint32_t transferFamily() const;
+    /// @brief Get index of the transfer queue in its family. 1 if the transfer family is the graphics family and has a second queue.
+    uint32_t transferQueueIndex() const;
+    void setTransferFamily(uint32_t index, uint32_t queueIndex = 0);
 
-    /// @brief Returns true if all families have been set.
+    /// @brief Returns true if the transfer queue is a queue of its own, so it can be used from another thread than the graphics queue.
+    bool hasSeparateTransferQueue() const;
+
+    /// @brief Returns true if the graphics and present families have been set. The transfer family falls back to the graphics family.
     bool isComplete() const;
 
 private:
@@ -23,21 +32,63 @@ private:
     uint32_t m_graphicsFamily = 0;
     bool m_presentFamilySet = false;
     uint32_t m_presentFamily = 0;
+    bool m_transferFamilySet = false;
+    uint32_t m_transferFamily = 0;
+    uint32_t m_transferQueueIndex = 0;
 };
 
 /// @brief Find queue families available for physical device and surface.
 QueueFamilyIndices findQueueFamilies(vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface);
 
+/// @brief How memory is accessed. Used to pick the best memory type on the device.
+enum class MemoryUsage
+{
+    eUnknown = 0,  // Pick the first memory type that has the required properties.
+    eGpuOnly = 1,  // Written and read by the device only, or uploaded rarely. Prefers device-local memory that is not host-visible.
+    eCpuToGpu = 2, // Written by the host frequently, read by the device. Prefers device-local host-visible memory (resizable BAR), falls back to host-visible memory if that heap runs out.
+    eGpuToCpu = 3, // Written by the device, read back by the host. Prefers host-cached memory.
+};
+
 /// @brief Find index of device memory.
 uint32_t findMemoryTypeIndex(vk::PhysicalDevice physicalDevice, uint32_t typeFilter, vk::MemoryPropertyFlags properties);
 
+/// @brief Find index of the best device memory type for a usage.
+/// Memory types are scored by their properties for the usage and, if equal, by the size of their heap.
+/// For MemoryUsage::eUnknown this returns the first memory type that has the properties.
+/// @param properties Properties the memory type must have. eCpuToGpu and eGpuToCpu always require eHostVisible.
+/// @throw Throws if there is no memory type that has the properties.
+uint32_t findMemoryTypeIndex(vk::PhysicalDevice physicalDevice, uint32_t typeFilter, vk::MemoryPropertyFlags properties, MemoryUsage usage);
+
+/// @brief Find indices of all device memory types usable for a usage, best first, scored like findMemoryTypeIndex().
+/// Allocate from the next type if the heap of a type is out of memory, e.g. device-local host-visible memory without resizable BAR.
+/// For MemoryUsage::eUnknown this returns only the first memory type that has the properties.
+/// @throw Throws if there is no memory type that has the properties.
+std::vector<uint32_t> findMemoryTypeIndices(vk::PhysicalDevice physicalDevice, uint32_t typeFilter, vk::MemoryPropertyFlags properties, MemoryUsage usage);
+
+/// @brief Check if physical device supports a device extension.
+bool isDeviceExtensionSupported(vk::PhysicalDevice physicalDevice, const char *extensionName);
+
 /// @brief Pick the first physical device that supports Vulkan and has graphics capabilities.
 /// @throw Throws if there are no GPUs supporting Vulkan.
 vk::PhysicalDevice pickPhysicalDevice(vk::Instance instance, vk::SurfaceKHR surface);
 
-/// @brief A logical device that supports Vulkan.
+/// @brief Extensions and features a logical device was created with.
+/// Check these instead of what the physical device supports. Using an extension or feature that was not enabled is invalid.
+struct EnabledDeviceFeatures
+{
+    std::vector<std::string> extensions;  // Names of enabled device extensions.
+    vk::PhysicalDeviceFeatures features;  // Enabled core features.
+
+    /// @brief Returns true if device extension was enabled.
+    bool hasExtension(const char *extensionName) const;
+};
+
+/// @brief A logical device that supports Vulkan. Creates the graphics, present and transfer queues found by findQueueFamilies().
+/// Optional extensions, e.g. VK_EXT_memory_budget or VK_KHR_draw_indirect_count, and the multiDrawIndirect and
+/// drawIndirectFirstInstance features are enabled if the physical device supports them.
+/// @param enabledFeatures If not nullptr, receives the extensions and features that have been enabled.
 /// @throw Throws if there are no GPUs supporting Vulkan.
-vk::Device createLogicalDevice(vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface);
+vk::Device createLogicalDevice(vk::PhysicalDevice physicalDevice, vk::SurfaceKHR surface, EnabledDeviceFeatures *enabledFeatures = nullptr);
 
 /// @brief Dump information about the Vulkan device to stdout.
 void dumpDeviceInfo(vk::PhysicalDevice physicalDevice);
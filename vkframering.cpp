@@ -0,0 +1,144 @@
+#include "vkframering.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace vsvr
+{
+
+uint32_t FrameRingAllocator::Allocation::dynamicOffset() const
+{
+    return static_cast<uint32_t>(ringOffset);
+}
+
+FrameRingAllocator::FrameRingAllocator(vk::PhysicalDevice physicalDevice, vk::Device logicalDevice, MemoryPool::Ptr pool, vk::DeviceSize frameSize, vk::BufferUsageFlags usage, uint32_t frameCount)
+    : m_logicalDevice(logicalDevice)
+    , m_pool(pool)
+    , m_frameCount(frameCount)
+{
+    if (frameCount == 0)
+    {
+        throw std::runtime_error("Frame count must be > 0!");
+    }
+    // allocations must be aligned for all ways the buffer can be bound
+    if (usage & vk::BufferUsageFlagBits::eUniformBuffer)
+    {
+        m_alignment = std::max(m_alignment, MemoryPool::minAligmentFor(physicalDevice, vk::BufferUsageFlagBits::eUniformBuffer));
+    }
+    if (usage & vk::BufferUsageFlagBits::eStorageBuffer)
+    {
+        m_alignment = std::max(m_alignment, MemoryPool::minAligmentFor(physicalDevice, vk::BufferUsageFlagBits::eStorageBuffer));
+    }
+    if (usage & (vk::BufferUsageFlagBits::eUniformTexelBuffer | vk::BufferUsageFlagBits::eStorageTexelBuffer))
+    {
+        m_alignment = std::max(m_alignment, MemoryPool::minAligmentFor(physicalDevice, vk::BufferUsageFlagBits::eStorageTexelBuffer));
+    }
+    // partitions start aligned too
+    m_frameSize = ((frameSize + m_alignment - 1) / m_alignment) * m_alignment;
+    Buffer::Settings settings;
+    settings.usage = usage;
+    settings.properties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    m_buffer = m_pool->createBuffer(m_frameSize * m_frameCount, settings);
+    for (uint32_t i = 0; i < m_frameCount; i++)
+    {
+        m_fences.push_back(m_logicalDevice.createFence(vk::FenceCreateInfo()));
+    }
+    m_submitted.resize(m_frameCount, false);
+    // the first beginFrame() starts with the first partition
+    m_frame = m_frameCount - 1;
+}
+
+FrameRingAllocator::~FrameRingAllocator()
+{
+    for (uint32_t i = 0; i < m_frameCount; i++)
+    {
+        if (m_submitted[i])
+        {
+            m_logicalDevice.waitForFences(1, &m_fences[i], VK_TRUE, UINT64_MAX);
+        }
+        m_logicalDevice.destroyFence(m_fences[i]);
+    }
+    m_pool->destroyBuffer(m_buffer);
+}
+
+void FrameRingAllocator::beginFrame()
+{
+    if (m_inFrame)
+    {
+        throw std::runtime_error("Call endFrame() before starting a new frame!");
+    }
+    m_frame = (m_frame + 1) % m_frameCount;
+    // wait until the device is done with the data of the frame that last used this partition
+    if (m_submitted[m_frame])
+    {
+        m_logicalDevice.waitForFences(1, &m_fences[m_frame], VK_TRUE, UINT64_MAX);
+        m_logicalDevice.resetFences(1, &m_fences[m_frame]);
+        m_submitted[m_frame] = false;
+    }
+    m_head = 0;
+    m_inFrame = true;
+}
+
+FrameRingAllocator::Allocation FrameRingAllocator::allocate(vk::DeviceSize size)
+{
+    if (!m_inFrame)
+    {
+        throw std::runtime_error("Call beginFrame() before allocating!");
+    }
+    const auto aligned = ((m_head + m_alignment - 1) / m_alignment) * m_alignment;
+    if (aligned + size > m_frameSize)
+    {
+        throw std::runtime_error("Frame ring full!");
+    }
+    m_head = aligned + size;
+    // read buffer info every time, the pool might have moved the buffer when defragmenting
+    const auto offset = m_frame * m_frameSize + aligned;
+    return Allocation({m_buffer->buffer(), m_buffer->offset() + offset, size, static_cast<uint8_t *>(m_buffer->data()) + offset, offset});
+}
+
+FrameRingAllocator::Allocation FrameRingAllocator::upload(const void *data, vk::DeviceSize size)
+{
+    auto allocation = allocate(size);
+    std::memcpy(allocation.data, data, size);
+    return allocation;
+}
+
+void FrameRingAllocator::endFrame(vk::Queue queue)
+{
+    if (!m_inFrame)
+    {
+        throw std::runtime_error("Call beginFrame() before ending a frame!");
+    }
+    // an empty submission signals the fence when all work submitted to the queue before has finished
+    queue.submit(0, nullptr, m_fences[m_frame]);
+    m_submitted[m_frame] = true;
+    m_inFrame = false;
+}
+
+vk::DescriptorBufferInfo FrameRingAllocator::descriptorInfo(vk::DeviceSize range) const
+{
+    return vk::DescriptorBufferInfo(m_buffer->buffer(), m_buffer->offset(), range);
+}
+
+Buffer::Ptr FrameRingAllocator::buffer() const
+{
+    return m_buffer;
+}
+
+vk::DeviceSize FrameRingAllocator::alignment() const
+{
+    return m_alignment;
+}
+
+vk::DeviceSize FrameRingAllocator::frameSize() const
+{
+    return m_frameSize;
+}
+
+uint32_t FrameRingAllocator::frameCount() const
+{
+    return m_frameCount;
+}
+
+}
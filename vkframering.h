@@ -0,0 +1,89 @@
+#pragma once
+
+#include "vkbuffer.h"
+#include "vkwindow.h"
+#include "vkincludes.h"
+#include <vector>
+
+namespace vsvr
+{
+
+/// @brief Linear allocator for transient per-frame data, e.g. uniforms or dynamic vertex data.
+/// Hands out aligned ranges of a persistently mapped ring buffer that is partitioned into one part per frame in flight.
+/// Allocating is a pointer bump and all ranges of a frame are recycled at once when the frame has finished on the device.
+/// Bind the buffer once with a dynamic uniform / storage buffer descriptor and pass the allocation offsets as dynamic offsets.
+class FrameRingAllocator
+{
+public:
+    /// @brief A range of the ring to write data to.
+    /// The ring might be a range of a bigger vk::Buffer the pool shares between buffers, so there are two offsets:
+    /// offset is relative to the start of the vk::Buffer and is what vkCmdBindVertexBuffers, vkCmdBindIndexBuffer and copies take.
+    /// ringOffset is relative to the start of the ring, which is the base offset of descriptorInfo(), so it is the dynamic offset.
+    struct Allocation
+    {
+        vk::Buffer buffer = nullptr;   // Buffer handle of ring.
+        vk::DeviceSize offset = 0;     // Offset of allocation in buffer. Use this when binding the buffer.
+        vk::DeviceSize size = 0;       // Size of allocation.
+        void *data = nullptr;          // Pointer to mapped allocation memory.
+        vk::DeviceSize ringOffset = 0; // Offset of allocation relative to the start of the ring.
+
+        /// @brief Get offset to pass to vkCmdBindDescriptorSets for a dynamic descriptor written with descriptorInfo().
+        /// This is ringOffset, because the descriptor already starts at the ring.
+        uint32_t dynamicOffset() const;
+    };
+
+    /// @brief Create ring with frameCount partitions of frameSize bytes.
+    /// @param usage Buffer usage, e.g. eUniformBuffer or eVertexBuffer. Allocations are aligned as needed for the usage.
+    FrameRingAllocator(vk::PhysicalDevice physicalDevice, vk::Device logicalDevice, MemoryPool::Ptr pool, vk::DeviceSize frameSize, vk::BufferUsageFlags usage, uint32_t frameCount = Window::MAX_IN_FLIGHT_SUBMISSIONS);
+
+    /// @brief Waits for all frames to finish, then destroys the fences and the ring buffer.
+    ~FrameRingAllocator();
+
+    FrameRingAllocator(const FrameRingAllocator &other) = delete;
+    FrameRingAllocator &operator=(const FrameRingAllocator &other) = delete;
+
+    /// @brief Start a new frame. Waits if the device is still using the partition of the frame frameCount frames ago.
+    void beginFrame();
+
+    /// @brief Get a range of the current frames partition.
+    /// @throw Throws if the partition is full or beginFrame() has not been called.
+    Allocation allocate(vk::DeviceSize size);
+
+    /// @brief Allocate a range and copy data to it.
+    Allocation upload(const void *data, vk::DeviceSize size);
+
+    /// @brief End frame. Call this after submitting all commands using the frames allocations to queue.
+    /// The frames partition is recycled when all work submitted to queue before this call has finished.
+    void endFrame(vk::Queue queue);
+
+    /// @brief Get info for writing a dynamic descriptor. Range is the maximum size of a single allocation the shader reads.
+    /// The descriptor starts at the ring, so pass Allocation::dynamicOffset() as dynamic offset, not Allocation::offset.
+    vk::DescriptorBufferInfo descriptorInfo(vk::DeviceSize range) const;
+
+    /// @brief Get ring buffer.
+    Buffer::Ptr buffer() const;
+
+    /// @brief Get alignment of allocations.
+    vk::DeviceSize alignment() const;
+
+    /// @brief Get size of a frames partition.
+    vk::DeviceSize frameSize() const;
+
+    /// @brief Get number of partitions.
+    uint32_t frameCount() const;
+
+private:
+    vk::Device m_logicalDevice = nullptr;
+    MemoryPool::Ptr m_pool;
+    Buffer::Ptr m_buffer;
+    vk::DeviceSize m_alignment = 16;      // Alignment of allocations.
+    vk::DeviceSize m_frameSize = 0;       // Size of a partition.
+    uint32_t m_frameCount = 0;            // Number of partitions.
+    uint32_t m_frame = 0;                 // Index of current partition.
+    vk::DeviceSize m_head = 0;            // Offset of next allocation in current partition.
+    bool m_inFrame = false;               // True between beginFrame() and endFrame().
+    std::vector<vk::Fence> m_fences;      // Fence per partition, signaled when the frame using it has finished.
+    std::vector<bool> m_submitted;        // True if the fence of a partition has been submitted.
+};
+
+}
@@ -0,0 +1,193 @@
+#include "vkgeometry.h"
+
+#include "vkindexopt.h"
+#include <stdexcept>
+
+namespace vsvr
+{
+
+bool GeometryArena::Mesh::isValid() const
+{
+    return vertexBlock != PageAllocator::InvalidBlock && indexBlock != PageAllocator::InvalidBlock;
+}
+
+SHAREDRESOURCE_FUNCTIONS_CPP(GeometryArena)
+
+GeometryArena::GeometryArena(MemoryPool::Ptr pool, uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity, const Buffer::Settings &settings, vk::IndexType indexType, uint32_t vertexBinding)
+    : m_pool(pool)
+    , m_indexType(indexType)
+    , m_vertexBinding(vertexBinding)
+    , m_vertexStride(vertexStride)
+{
+    if (vertexStride == 0 || vertexCapacity == 0 || indexCapacity == 0)
+    {
+        throw std::runtime_error("Geometry arena needs a vertex stride and capacity!");
+    }
+    const uint32_t indexSize = indexType == vk::IndexType::eUint16 ? 2 : 4;
+    Buffer::Settings vertexSettings = settings;
+    vertexSettings.usage |= vk::BufferUsageFlagBits::eVertexBuffer;
+    m_vertexBuffer = m_pool->createBuffer(static_cast<vk::DeviceSize>(vertexCapacity) * vertexStride, vertexSettings);
+    Buffer::Settings indexSettings = settings;
+    indexSettings.usage |= vk::BufferUsageFlagBits::eIndexBuffer;
+    m_indexBuffer = m_pool->createBuffer(static_cast<vk::DeviceSize>(indexCapacity) * indexSize, indexSettings);
+    m_vertexAllocator = PageAllocator::create(AllocationStrategy::eTlsf, vertexCapacity);
+    m_indexAllocator = PageAllocator::create(AllocationStrategy::eTlsf, indexCapacity);
+}
+
+GeometryArena::~GeometryArena()
+{
+    if (m_pool)
+    {
+        for (auto & buffer : {m_vertexBuffer, m_indexBuffer})
+        {
+            if (buffer)
+            {
+                m_pool->destroyBuffer(buffer);
+            }
+        }
+    }
+}
+
+GeometryArena &GeometryArena::operator=(GeometryArena &&other)
+{
+    if (&other != this)
+    {
+        m_pool = std::move(other.m_pool); other.m_pool = nullptr;
+        m_vertexBuffer = std::move(other.m_vertexBuffer); other.m_vertexBuffer = nullptr;
+        m_indexBuffer = std::move(other.m_indexBuffer); other.m_indexBuffer = nullptr;
+        m_indexType = std::move(other.m_indexType); other.m_indexType = vk::IndexType::eUint32;
+        m_vertexBinding = std::move(other.m_vertexBinding); other.m_vertexBinding = 0;
+        m_vertexStride = std::move(other.m_vertexStride); other.m_vertexStride = 0;
+        m_meshCount = std::move(other.m_meshCount); other.m_meshCount = 0;
+        m_vertexAllocator = std::move(other.m_vertexAllocator);
+        m_indexAllocator = std::move(other.m_indexAllocator);
+    }
+    return *this;
+}
+
+GeometryArena::Mesh GeometryArena::add(const RawData &vertices, const std::vector<uint32_t> &indices)
+{
+    if (vertices.copySize() == 0 || vertices.copySize() % m_vertexStride != 0 || indices.empty())
+    {
+        throw std::runtime_error("Mesh must have vertices of vertex stride and indices!");
+    }
+    const uint32_t vertexCount = static_cast<uint32_t>(vertices.copySize() / m_vertexStride);
+    for (auto index : indices)
+    {
+        if (index >= vertexCount)
+        {
+            throw std::runtime_error("Index out of range of vertices!");
+        }
+    }
+    // narrow before allocating, so we do not leak ranges if this throws
+    std::vector<uint16_t> narrowed;
+    if (m_indexType == vk::IndexType::eUint16)
+    {
+        narrowed = narrowIndices(indices);
+    }
+    const auto vertexAllocation = m_vertexAllocator->allocate(vertexCount, 1);
+    if (vertexAllocation.block == PageAllocator::InvalidBlock)
+    {
+        throw std::runtime_error("No free vertex range for mesh in geometry arena!");
+    }
+    const auto indexAllocation = m_indexAllocator->allocate(indices.size(), 1);
+    if (indexAllocation.block == PageAllocator::InvalidBlock)
+    {
+        m_vertexAllocator->free(vertexAllocation.block);
+        throw std::runtime_error("No free index range for mesh in geometry arena!");
+    }
+    Mesh mesh;
+    mesh.indexCount = static_cast<uint32_t>(indices.size());
+    mesh.firstIndex = static_cast<uint32_t>(indexAllocation.offset);
+    mesh.vertexOffset = static_cast<int32_t>(vertexAllocation.offset);
+    mesh.vertexCount = vertexCount;
+    mesh.vertexBlock = vertexAllocation.block;
+    mesh.indexBlock = indexAllocation.block;
+    m_pool->updateRange(m_vertexBuffer, vertexAllocation.offset * m_vertexStride, vertices);
+    if (m_indexType == vk::IndexType::eUint16)
+    {
+        m_pool->updateRange(m_indexBuffer, indexAllocation.offset * sizeof(uint16_t), RawData(narrowed));
+    }
+    else
+    {
+        m_pool->updateRange(m_indexBuffer, indexAllocation.offset * sizeof(uint32_t), RawData(indices));
+    }
+    m_meshCount++;
+    return mesh;
+}
+
+void GeometryArena::remove(const Mesh &mesh)
+{
+    if (!mesh.isValid())
+    {
+        return;
+    }
+    m_vertexAllocator->free(mesh.vertexBlock);
+    m_indexAllocator->free(mesh.indexBlock);
+    m_meshCount--;
+}
+
+void GeometryArena::bind(vk::CommandBuffer commandBuffer) const
+{
+    const vk::Buffer buffer = m_vertexBuffer->buffer();
+    const vk::DeviceSize offset = m_vertexBuffer->offset();
+    commandBuffer.bindVertexBuffers(m_vertexBinding, 1, &buffer, &offset);
+    commandBuffer.bindIndexBuffer(m_indexBuffer->buffer(), m_indexBuffer->offset(), m_indexType);
+}
+
+void GeometryArena::draw(vk::CommandBuffer commandBuffer, const Mesh &mesh, uint32_t instanceCount, uint32_t firstInstance)
+{
+    commandBuffer.drawIndexed(mesh.indexCount, instanceCount, mesh.firstIndex, mesh.vertexOffset, firstInstance);
+}
+
+Buffer::Ptr GeometryArena::vertexBuffer() const
+{
+    return m_vertexBuffer;
+}
+
+Buffer::Ptr GeometryArena::indexBuffer() const
+{
+    return m_indexBuffer;
+}
+
+vk::IndexType GeometryArena::indexType() const
+{
+    return m_indexType;
+}
+
+uint32_t GeometryArena::vertexBinding() const
+{
+    return m_vertexBinding;
+}
+
+uint32_t GeometryArena::vertexStride() const
+{
+    return m_vertexStride;
+}
+
+uint32_t GeometryArena::meshCount() const
+{
+    return m_meshCount;
+}
+
+uint32_t GeometryArena::vertexCapacity() const
+{
+    return static_cast<uint32_t>(m_vertexAllocator->size());
+}
+
+uint32_t GeometryArena::indexCapacity() const
+{
+    return static_cast<uint32_t>(m_indexAllocator->size());
+}
+
+uint32_t GeometryArena::usedVertexCount() const
+{
+    return static_cast<uint32_t>(m_vertexAllocator->usedSize());
+}
+
+uint32_t GeometryArena::usedIndexCount() const
+{
+    return static_cast<uint32_t>(m_indexAllocator->usedSize());
+}
+
+}
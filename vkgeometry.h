@@ -0,0 +1,96 @@
+#pragma once
+
+#include "vkincludes.h"
+#include "vkallocator.h"
+#include "vkbuffer.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace vsvr
+{
+
+/// @brief Vertices and indices of many meshes in one vertex and one index buffer.
+/// Meshes get ranges of the buffers, so all meshes can be drawn after binding the buffers once with bind().
+/// Vertices are interleaved with a fixed stride for all meshes. Indices are relative to the first vertex of their mesh
+/// and are offset with vertexOffset when drawing, so 16-bit indices can be used as long as no single mesh has more than 65535 vertices.
+/// Free ranges are managed with a TlsfAllocator, so ranges of removed meshes are reused by new meshes.
+/// The Mesh ranges can be used for DrawObject of IndirectDrawer too.
+/// @note Buffers have a fixed capacity. Not thread-safe.
+class GeometryArena
+{
+public:
+    SHAREDRESOURCE_FUNCTIONS_H(GeometryArena)
+
+    /// @brief Ranges of a mesh in the arena.
+    struct Mesh
+    {
+        uint32_t indexCount = 0;  // Number of indices.
+        uint32_t firstIndex = 0;  // First index in index buffer.
+        int32_t vertexOffset = 0; // First vertex in vertex buffer. Added to indices.
+        uint32_t vertexCount = 0; // Number of vertices.
+        uint32_t vertexBlock = PageAllocator::InvalidBlock; // Allocator block of vertices.
+        uint32_t indexBlock = PageAllocator::InvalidBlock;  // Allocator block of indices.
+
+        /// @brief Returns true if the mesh was returned by add().
+        bool isValid() const;
+    };
+
+    /// @brief Create vertex and index buffers with capacity for vertexCapacity vertices and indexCapacity indices.
+    /// @param vertexBinding Binding number used in bind().
+    /// @param settings Settings for both buffers. eVertexBuffer or eIndexBuffer usage is added as needed.
+    /// @note Use device-local memory for static meshes. Meshes are uploaded with MemoryPool::updateRange().
+    /// @throw Throws if vertexStride, vertexCapacity or indexCapacity is 0.
+    GeometryArena(MemoryPool::Ptr pool, uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity, const Buffer::Settings &settings, vk::IndexType indexType = vk::IndexType::eUint32, uint32_t vertexBinding = 0);
+
+    /// @brief Destroy buffers on device. Note that the buffers will immediately be destroyed.
+    ~GeometryArena();
+
+    /// @brief Add a mesh and upload its data.
+    /// @param vertices Interleaved vertex data with vertexStride() bytes per vertex.
+    /// @param indices Triangle list indices relative to the first vertex.
+    /// @return Mesh ranges. Pass these to remove() when the mesh is not needed anymore.
+    /// @throw Throws if the mesh is empty, an index is out of range of the vertices or does not fit into 16 bit,
+    /// or there is no free range big enough.
+    Mesh add(const RawData &vertices, const std::vector<uint32_t> &indices);
+
+    /// @brief Remove a mesh, so its ranges can be reused. Make sure the device does not use the mesh anymore.
+    /// Does nothing for invalid meshes. Do not remove a mesh twice.
+    void remove(const Mesh &mesh);
+
+    /// @brief Bind vertex and index buffer. Call once before drawing meshes.
+    void bind(vk::CommandBuffer commandBuffer) const;
+
+    /// @brief Record an indexed draw of a mesh. Call bind() first.
+    static void draw(vk::CommandBuffer commandBuffer, const Mesh &mesh, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+
+    Buffer::Ptr vertexBuffer() const;
+    Buffer::Ptr indexBuffer() const;
+    vk::IndexType indexType() const;
+    uint32_t vertexBinding() const;
+    /// @brief Get byte size of a vertex.
+    uint32_t vertexStride() const;
+    /// @brief Get number of meshes in arena.
+    uint32_t meshCount() const;
+    /// @brief Get number of vertices that fit into the vertex buffer.
+    uint32_t vertexCapacity() const;
+    /// @brief Get number of indices that fit into the index buffer.
+    uint32_t indexCapacity() const;
+    /// @brief Get number of vertices used by meshes.
+    uint32_t usedVertexCount() const;
+    /// @brief Get number of indices used by meshes.
+    uint32_t usedIndexCount() const;
+
+private:
+    MemoryPool::Ptr m_pool;
+    Buffer::Ptr m_vertexBuffer;
+    Buffer::Ptr m_indexBuffer;
+    vk::IndexType m_indexType = vk::IndexType::eUint32;
+    uint32_t m_vertexBinding = 0;
+    uint32_t m_vertexStride = 0;
+    uint32_t m_meshCount = 0;
+    std::unique_ptr<PageAllocator> m_vertexAllocator; // Manages vertex ranges in units of vertices.
+    std::unique_ptr<PageAllocator> m_indexAllocator;  // Manages index ranges in units of indices.
+};
+
+}
@@ -0,0 +1,48 @@
+#include "vkimage.h"
+
+namespace vsvr
+{
+
+SHAREDRESOURCE_FUNCTIONS_CPP(Image)
+
+Image::Image(vk::Image image, vk::Extent3D extent, const Settings &settings, void *data)
+    : m_image(image)
+    , m_extent(extent)
+    , m_data(data)
+    , m_settings(settings)
+{
+}
+
+Image &Image::operator=(Image &&other)
+{
+    if (&other != this)
+    {
+        m_image = other.m_image; other.m_image = nullptr;
+        m_extent = other.m_extent; other.m_extent = vk::Extent3D();
+        m_data = other.m_data; other.m_data = nullptr;
+        m_settings = other.m_settings;
+    }
+    return *this;
+}
+
+vk::Image Image::image() const
+{
+    return m_image;
+}
+
+vk::Extent3D Image::extent() const
+{
+    return m_extent;
+}
+
+const Image::Settings &Image::settings() const
+{
+    return m_settings;
+}
+
+void *Image::data() const
+{
+    return m_data;
+}
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "vkresource.h"
+#include "vkallocator.h"
+#include "vkdevice.h"
+#include "vkincludes.h"
+
+namespace vsvr
+{
+
+/// @brief Vulkan image object, e.g. a texture or render target.
+/// Create using MemoryPool::createImage().
+class Image
+{
+public:
+    struct Settings
+    {
+        vk::ImageType type = vk::ImageType::e2D;
+        vk::Format format = vk::Format::eR8G8B8A8Unorm;
+        uint32_t mipLevels = 1;
+        uint32_t arrayLayers = 1;
+        vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+        vk::ImageTiling tiling = vk::ImageTiling::eOptimal; // Linear images can be written by the host, but support few formats and usages.
+        vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+        vk::SharingMode sharingMode = vk::SharingMode::eExclusive;
+        vk::MemoryPropertyFlags properties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+        MemoryUsage memoryUsage = MemoryUsage::eUnknown; // If set, the best memory type for the usage is picked and properties are ignored.
+        AllocationStrategy allocationStrategy = AllocationStrategy::eDefault; // How free memory in pages is managed.
+    };
+
+    SHAREDRESOURCE_FUNCTIONS_H(Image)
+
+    /// @brief Create image.
+    Image(vk::Image image, vk::Extent3D extent, const Settings &settings, void *data = nullptr);
+
+    /// @brief Get image handle.
+    vk::Image image() const;
+    /// @brief Get image size in pixels.
+    vk::Extent3D extent() const;
+    /// @brief Get image settings.
+    const Settings &settings() const;
+    /// @brief Get pointer to image memory if it is host-visible, else nullptr.
+    /// Only useful for linear images. Use vkGetImageSubresourceLayout to find out where the subresources are.
+    void *data() const;
+
+private:
+    vk::Image m_image = nullptr; // The image object.
+    vk::Extent3D m_extent; // Image size in pixels.
+    void *m_data = nullptr; // Pointer to mapped image memory or nullptr if not host-visible.
+    Settings m_settings;
+};
+
+}
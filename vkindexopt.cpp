@@ -0,0 +1,266 @@
+#include "vkindexopt.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace vsvr
+{
+
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t> &indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+    VertexCacheStats stats;
+    // a vertex is in the cache if it was added less than cacheSize misses ago
+    std::vector<uint32_t> addedAt(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    uint32_t referencedCount = 0;
+    for (auto index : indices)
+    {
+        if (index >= vertexCount)
+        {
+            throw std::runtime_error("Index out of range of vertices!");
+        }
+        if (addedAt[index] == 0 || stats.transformedCount - addedAt[index] >= cacheSize)
+        {
+            stats.transformedCount++;
+            addedAt[index] = stats.transformedCount;
+        }
+        if (!referenced[index])
+        {
+            referenced[index] = true;
+            referencedCount++;
+        }
+    }
+    const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+    stats.acmr = triangleCount > 0 ? static_cast<float>(stats.transformedCount) / triangleCount : 0.0f;
+    stats.atvr = referencedCount > 0 ? static_cast<float>(stats.transformedCount) / referencedCount : 0.0f;
+    return stats;
+}
+
+// scoring parameters from Forsyths paper
+static const int32_t ForsythCacheSize = 32;
+static const float ForsythCacheDecayPower = 1.5f;
+static const float ForsythLastTriangleScore = 0.75f;
+static const float ForsythValenceBoostScale = 2.0f;
+static const float ForsythValenceBoostPower = 0.5f;
+static const uint32_t ForsythMaxValence = 64;
+
+// score of a vertex from its position in the cache and the number of triangles not added yet.
+// the tables are precomputed, so no pow() is needed in the loop
+static float vertexScore(int32_t cachePosition, uint32_t remaining)
+{
+    struct Tables
+    {
+        float cache[ForsythCacheSize];
+        float valence[ForsythMaxValence];
+        Tables()
+        {
+            for (int32_t i = 0; i < ForsythCacheSize; i++)
+            {
+                // the last triangle added gets a fixed score, so the next triangle does not reuse all its vertices
+                cache[i] = i < 3 ? ForsythLastTriangleScore : std::pow(1.0f - static_cast<float>(i - 3) / (ForsythCacheSize - 3), ForsythCacheDecayPower);
+            }
+            valence[0] = 0.0f;
+            for (uint32_t i = 1; i < ForsythMaxValence; i++)
+            {
+                valence[i] = ForsythValenceBoostScale * std::pow(static_cast<float>(i), -ForsythValenceBoostPower);
+            }
+        }
+    };
+    static const Tables tables;
+    if (remaining == 0)
+    {
+        return -1.0f;
+    }
+    const float cacheScore = cachePosition >= 0 ? tables.cache[cachePosition] : 0.0f;
+    return cacheScore + tables.valence[std::min(remaining, ForsythMaxValence - 1)];
+}
+
+void optimizeVertexCache(std::vector<uint32_t> &indices, uint32_t vertexCount)
+{
+    if (indices.size() % 3 != 0)
+    {
+        throw std::runtime_error("Number of indices must be a multiple of 3!");
+    }
+    const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+    // build triangle lists of vertices. remaining[v] is the number of triangles of v not added yet
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (auto index : indices)
+    {
+        if (index >= vertexCount)
+        {
+            throw std::runtime_error("Index out of range of vertices!");
+        }
+        remaining[index]++;
+    }
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1, 0);
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+        triangleOffsets[v + 1] = triangleOffsets[v] + remaining[v];
+    }
+    std::vector<uint32_t> triangles(indices.size());
+    std::vector<uint32_t> fill(triangleOffsets.cbegin(), triangleOffsets.cend() - 1);
+    for (uint32_t i = 0; i < indices.size(); i++)
+    {
+        triangles[fill[indices[i]]++] = i / 3;
+    }
+    std::vector<int32_t> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+        vertexScores[v] = vertexScore(-1, remaining[v]);
+    }
+    std::vector<float> triangleScores(triangleCount);
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+    }
+    std::vector<bool> added(triangleCount, false);
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    // cache has room for the vertices of one more triangle, which are pushed out after adding it
+    std::vector<uint32_t> cache;
+    cache.reserve(ForsythCacheSize + 3);
+    std::vector<uint32_t> newCache;
+    newCache.reserve(ForsythCacheSize + 3);
+    uint32_t bestTriangle = UINT32_MAX;
+    uint32_t scanPosition = 0;
+    while (result.size() < indices.size())
+    {
+        if (bestTriangle == UINT32_MAX)
+        {
+            // no triangle touches the cache. take the best of the next triangles not added yet. scanning on keeps this linear
+            float bestScore = -1.0f;
+            while (scanPosition < triangleCount && added[scanPosition])
+            {
+                scanPosition++;
+            }
+            for (uint32_t t = scanPosition; t < triangleCount && t < scanPosition + 64; t++)
+            {
+                if (!added[t] && triangleScores[t] > bestScore)
+                {
+                    bestScore = triangleScores[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+        // add triangle and remove it from the triangle lists of its vertices
+        added[bestTriangle] = true;
+        newCache.clear();
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            const uint32_t v = indices[bestTriangle * 3 + i];
+            result.push_back(v);
+            auto first = triangles.begin() + triangleOffsets[v];
+            auto last = first + remaining[v];
+            std::iter_swap(std::find(first, last, bestTriangle), last - 1);
+            remaining[v]--;
+            // degenerate triangles reference a vertex twice
+            if (std::find(newCache.cbegin(), newCache.cend(), v) == newCache.cend())
+            {
+                newCache.push_back(v);
+            }
+        }
+        // move vertices of triangle to the front of the LRU cache
+        const auto triangleVertexCount = newCache.size();
+        for (auto v : cache)
+        {
+            if (std::find(newCache.cbegin(), newCache.cbegin() + triangleVertexCount, v) == newCache.cbegin() + triangleVertexCount)
+            {
+                newCache.push_back(v);
+            }
+        }
+        std::swap(cache, newCache);
+        // update scores of vertices in and pushed out of the cache, then of their triangles
+        for (uint32_t i = 0; i < cache.size(); i++)
+        {
+            const uint32_t v = cache[i];
+            cachePositions[v] = i < static_cast<uint32_t>(ForsythCacheSize) ? static_cast<int32_t>(i) : -1;
+            vertexScores[v] = vertexScore(cachePositions[v], remaining[v]);
+        }
+        bestTriangle = UINT32_MAX;
+        float bestScore = -1.0f;
+        for (auto v : cache)
+        {
+            for (uint32_t j = 0; j < remaining[v]; j++)
+            {
+                const uint32_t t = triangles[triangleOffsets[v] + j];
+                const float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+                triangleScores[t] = score;
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = t;
+                }
+            }
+        }
+        if (cache.size() > static_cast<uint32_t>(ForsythCacheSize))
+        {
+            cache.resize(ForsythCacheSize);
+        }
+    }
+    indices.swap(result);
+}
+
+std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t> &indices, uint32_t vertexCount)
+{
+    std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+    uint32_t next = 0;
+    for (auto & index : indices)
+    {
+        if (index >= vertexCount)
+        {
+            throw std::runtime_error("Index out of range of vertices!");
+        }
+        if (remap[index] == UINT32_MAX)
+        {
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+    for (auto & r : remap)
+    {
+        if (r == UINT32_MAX)
+        {
+            r = next++;
+        }
+    }
+    return remap;
+}
+
+std::vector<uint8_t> remapVertices(const RawData &vertices, uint32_t stride, const std::vector<uint32_t> &remap)
+{
+    if (vertices.copySize() < static_cast<vk::DeviceSize>(remap.size()) * stride)
+    {
+        throw std::runtime_error("Vertex data is smaller than remap table!");
+    }
+    std::vector<uint8_t> result(remap.size() * stride);
+    auto src = static_cast<const uint8_t *>(vertices.begin());
+    for (uint32_t v = 0; v < remap.size(); v++)
+    {
+        std::memcpy(result.data() + static_cast<size_t>(remap[v]) * stride, src + static_cast<size_t>(v) * stride, stride);
+    }
+    return result;
+}
+
+bool canNarrowIndices(uint32_t vertexCount)
+{
+    return vertexCount <= UINT16_MAX;
+}
+
+std::vector<uint16_t> narrowIndices(const std::vector<uint32_t> &indices)
+{
+    std::vector<uint16_t> result(indices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        if (indices[i] >= UINT16_MAX)
+        {
+            throw std::runtime_error("Index does not fit into 16 bit!");
+        }
+        result[i] = static_cast<uint16_t>(indices[i]);
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "vkincludes.h"
+#include "vkbuffer.h"
+#include <cstdint>
+#include <vector>
+
+namespace vsvr
+{
+
+/// @brief Post-transform vertex cache efficiency of a triangle list.
+struct VertexCacheStats
+{
+    uint32_t transformedCount = 0; // Number of vertices transformed, i.e. cache misses.
+    float acmr = 0.0f;             // Average cache miss ratio: transformed vertices per triangle. 0.5 is ideal for big regular meshes, 3 is worst.
+    float atvr = 0.0f;             // Average transformed to vertex ratio: transformed vertices per referenced vertex. 1 is ideal.
+};
+
+/// @brief Simulate a FIFO post-transform vertex cache of cacheSize entries on a triangle list.
+/// Real GPUs differ, but the ratios are a good estimate of how much vertex shading work an index order causes.
+/// @throw Throws if an index is >= vertexCount.
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t> &indices, uint32_t vertexCount, uint32_t cacheSize = 16);
+
+/// @brief Reorder triangles of a triangle list for post-transform vertex cache efficiency.
+/// Uses Tom Forsyths "Linear-speed vertex cache optimisation", which does not depend on the exact cache size of the GPU.
+/// @throw Throws if the number of indices is not a multiple of 3 or an index is >= vertexCount.
+void optimizeVertexCache(std::vector<uint32_t> &indices, uint32_t vertexCount);
+
+/// @brief Renumber vertices in the order they are first referenced by indices, so vertices are fetched mostly sequentially.
+/// Indices are rewritten in place. Unreferenced vertices are moved to the end. Call this after optimizeVertexCache().
+/// @return Remap table with the new index of each old vertex. Pass it to remapVertices() for all vertex data.
+std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t> &indices, uint32_t vertexCount);
+
+/// @brief Reorder vertex data of stride bytes per vertex according to a remap table from optimizeVertexFetch().
+/// Works for interleaved data and each attribute of non-interleaved data.
+std::vector<uint8_t> remapVertices(const RawData &vertices, uint32_t stride, const std::vector<uint32_t> &remap);
+
+/// @brief Returns true if indices for vertexCount vertices fit into 16 bit. The primitive restart index 0xFFFF is not used.
+bool canNarrowIndices(uint32_t vertexCount);
+
+/// @brief Convert 32-bit to 16-bit indices.
+/// @throw Throws if an index does not fit into 16 bit or is the primitive restart index.
+std::vector<uint16_t> narrowIndices(const std::vector<uint32_t> &indices);
+
+}
@@ -0,0 +1,187 @@
+#include "vkindirect.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace vsvr
+{
+
+IndirectDrawer::IndirectDrawer(vk::Device logicalDevice, const EnabledDeviceFeatures &enabledFeatures, MemoryPool::Ptr pool, Shader::ConstPtr cullShader, uint32_t maxObjectCount)
+    : m_logicalDevice(logicalDevice)
+    , m_pool(pool)
+    , m_maxObjectCount(maxObjectCount)
+{
+    // check what the device was created with. what the physical device supports might not have been enabled
+    if (!enabledFeatures.features.drawIndirectFirstInstance)
+    {
+        throw std::runtime_error("Indirect drawing needs the drawIndirectFirstInstance feature!");
+    }
+    m_multiDrawIndirect = enabledFeatures.features.multiDrawIndirect;
+    // a count > 1 needs multiDrawIndirect too. drivers might return a function for extensions that are not enabled, so do not rely on getProcAddr
+    if (m_multiDrawIndirect && enabledFeatures.hasExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME))
+    {
+        m_drawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(logicalDevice.getProcAddr("vkCmdDrawIndexedIndirectCountKHR"));
+    }
+    // objects are written by the host, commands and count only by the device
+    Buffer::Settings objectSettings;
+    objectSettings.usage = vk::BufferUsageFlagBits::eStorageBuffer;
+    objectSettings.memoryUsage = MemoryUsage::eCpuToGpu;
+    m_objectBuffer = m_pool->createBuffer(static_cast<vk::DeviceSize>(maxObjectCount) * sizeof(DrawObject), objectSettings);
+    Buffer::Settings commandSettings;
+    commandSettings.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst;
+    commandSettings.properties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+    commandSettings.memoryUsage = MemoryUsage::eGpuOnly;
+    m_commandBuffer = m_pool->createBuffer(static_cast<vk::DeviceSize>(maxObjectCount) * sizeof(vk::DrawIndexedIndirectCommand), commandSettings);
+    m_countBuffer = m_pool->createBuffer(sizeof(uint32_t), commandSettings);
+    // culling pipeline with objects, commands and count as storage buffers
+    std::vector<vk::DescriptorSetLayoutBinding> bindings(3);
+    for (uint32_t i = 0; i < bindings.size(); i++)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = vk::ShaderStageFlagBits::eCompute;
+    }
+    m_descriptorSetLayout = std::make_shared<DescriptorSetLayout>();
+    m_descriptorSetLayout->create(logicalDevice, bindings);
+    PipelineLayout::Settings layoutSettings;
+    layoutSettings.descriptorSetLayouts.push_back(m_descriptorSetLayout);
+    layoutSettings.pushConstants.push_back(vk::PushConstantRange(vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullParameters)));
+    m_pipelineLayout.create(logicalDevice, layoutSettings);
+    m_pipeline.create(logicalDevice, m_pipelineLayout, cullShader);
+    vk::DescriptorPoolSize poolSize(vk::DescriptorType::eStorageBuffer, static_cast<uint32_t>(bindings.size()));
+    vk::DescriptorPoolCreateInfo poolInfo;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    m_descriptorPool = logicalDevice.createDescriptorPool(poolInfo);
+    const vk::DescriptorSetLayout layout = m_descriptorSetLayout->layout();
+    vk::DescriptorSetAllocateInfo allocateInfo;
+    allocateInfo.descriptorPool = m_descriptorPool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &layout;
+    m_descriptorSet = logicalDevice.allocateDescriptorSets(allocateInfo).front();
+    const Buffer::Ptr buffers[] = {m_objectBuffer, m_commandBuffer, m_countBuffer};
+    std::vector<vk::DescriptorBufferInfo> bufferInfos;
+    for (const auto & buffer : buffers)
+    {
+        bufferInfos.push_back(vk::DescriptorBufferInfo(buffer->buffer(), buffer->offset(), buffer->size()));
+    }
+    std::vector<vk::WriteDescriptorSet> writes(bufferInfos.size());
+    for (uint32_t i = 0; i < writes.size(); i++)
+    {
+        writes[i].dstSet = m_descriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    logicalDevice.updateDescriptorSets(writes, nullptr);
+}
+
+IndirectDrawer::~IndirectDrawer()
+{
+    // destroy explicitly, so the pipeline goes before its layout
+    m_logicalDevice.destroyDescriptorPool(m_descriptorPool);
+    m_pipeline.destroy();
+    m_pipelineLayout.destroy();
+    m_descriptorSetLayout->destroy();
+    m_pool->destroyBuffers({m_objectBuffer, m_commandBuffer, m_countBuffer});
+}
+
+void IndirectDrawer::setObjects(const std::vector<DrawObject> &objects)
+{
+    if (objects.size() > m_maxObjectCount)
+    {
+        throw std::runtime_error("Too many objects for indirect drawer!");
+    }
+    if (!objects.empty())
+    {
+        m_pool->updateRange(m_objectBuffer, 0, RawData(objects));
+    }
+    m_objectCount = static_cast<uint32_t>(objects.size());
+}
+
+void IndirectDrawer::updateObject(uint32_t index, const DrawObject &object)
+{
+    if (index >= m_objectCount)
+    {
+        throw std::runtime_error("Object index out of range!");
+    }
+    m_pool->updateRange(m_objectBuffer, static_cast<vk::DeviceSize>(index) * sizeof(DrawObject), RawData(&object, sizeof(DrawObject)));
+}
+
+uint32_t IndirectDrawer::objectCount() const
+{
+    return m_objectCount;
+}
+
+void IndirectDrawer::recordCulling(vk::CommandBuffer commandBuffer, const float frustumPlanes[6][4])
+{
+    // make host writes to the object buffer visible. non-coherent memory needs a flush too
+    m_pool->flushBuffers();
+    // the previous frame might still read the commands and count, so wait for that before clearing them
+    vk::MemoryBarrier barrier;
+    barrier.srcAccessMask = vk::AccessFlagBits::eIndirectCommandRead;
+    barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderWrite;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect, vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, {}, 1, &barrier, 0, nullptr, 0, nullptr);
+    commandBuffer.fillBuffer(m_countBuffer->buffer(), m_countBuffer->offset(), sizeof(uint32_t), 0);
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eHostWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eHost, vk::PipelineStageFlagBits::eComputeShader, {}, 1, &barrier, 0, nullptr, 0, nullptr);
+    // cull
+    CullParameters parameters;
+    std::memcpy(parameters.frustumPlanes, frustumPlanes, sizeof(parameters.frustumPlanes));
+    parameters.objectCount = m_objectCount;
+    parameters.compact = m_drawIndexedIndirectCount ? 1 : 0;
+    m_pipeline.bind(commandBuffer);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_pipelineLayout.layout(), 0, 1, &m_descriptorSet, 0, nullptr);
+    commandBuffer.pushConstants(m_pipelineLayout.layout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullParameters), &parameters);
+    commandBuffer.dispatch((m_objectCount + WorkGroupSize - 1) / WorkGroupSize, 1, 1);
+    // commands and count are read by the indirect draws
+    barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect, {}, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void IndirectDrawer::recordDraw(vk::CommandBuffer commandBuffer) const
+{
+    const uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+    if (m_drawIndexedIndirectCount)
+    {
+        m_drawIndexedIndirectCount(static_cast<VkCommandBuffer>(commandBuffer), static_cast<VkBuffer>(m_commandBuffer->buffer()), m_commandBuffer->offset(), static_cast<VkBuffer>(m_countBuffer->buffer()), m_countBuffer->offset(), m_objectCount, stride);
+    }
+    else if (m_multiDrawIndirect)
+    {
+        commandBuffer.drawIndexedIndirect(m_commandBuffer->buffer(), m_commandBuffer->offset(), m_objectCount, stride);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < m_objectCount; i++)
+        {
+            commandBuffer.drawIndexedIndirect(m_commandBuffer->buffer(), m_commandBuffer->offset() + i * stride, 1, stride);
+        }
+    }
+}
+
+bool IndirectDrawer::hasDrawIndirectCount() const
+{
+    return m_drawIndexedIndirectCount != nullptr;
+}
+
+Buffer::Ptr IndirectDrawer::objectBuffer() const
+{
+    return m_objectBuffer;
+}
+
+Buffer::Ptr IndirectDrawer::commandBuffer() const
+{
+    return m_commandBuffer;
+}
+
+Buffer::Ptr IndirectDrawer::countBuffer() const
+{
+    return m_countBuffer;
+}
+
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "vkbuffer.h"
+#include "vkdescriptor.h"
+#include "vkdevice.h"
+#include "vkpipeline.h"
+#include "vkshader.h"
+#include "vkincludes.h"
+#include <cstdint>
+#include <vector>
+
+namespace vsvr
+{
+
+/// @brief Per-object data for GPU culling. Matches the DrawObject struct in shaders/cull_draws.comp.
+struct DrawObject
+{
+    float center[3] = {};     // Center of bounding sphere in world space.
+    float radius = 0.0f;      // Radius of bounding sphere. Objects with a negative radius are never drawn.
+    uint32_t indexCount = 0;  // Number of indices to draw.
+    uint32_t firstIndex = 0;  // First index in the bound index buffer.
+    int32_t vertexOffset = 0; // Value added to indices.
+    uint32_t pad = 0;
+};
+
+/// @brief GPU-driven drawing of many objects sharing a pipeline, vertex and index buffers.
+/// Per-object data is in a storage buffer. A compute pass frustum culls the objects and writes indexed indirect draw
+/// commands for the visible ones plus a count, which are drawn with vkCmdDrawIndexedIndirectCountKHR.
+/// The CPU cost of recording does not depend on the number of objects.
+/// Each command draws one instance with firstInstance set to the object index, so vertex shaders can fetch
+/// per-object data, e.g. transforms, with gl_InstanceIndex.
+/// The culling shader is shaders/cull_draws.comp. Compile it with your shaders and pass it to the constructor.
+/// @note Needs the drawIndirectFirstInstance feature. Without VK_KHR_draw_indirect_count all objects are drawn with
+/// vkCmdDrawIndexedIndirect and culled ones have an instance count of 0. Without the multiDrawIndirect feature too,
+/// one vkCmdDrawIndexedIndirect is recorded per object. createLogicalDevice() enables these if the device supports them.
+class IndirectDrawer
+{
+public:
+    /// @brief Push constants of the culling shader.
+    struct CullParameters
+    {
+        float frustumPlanes[6][4] = {}; // Planes as (normal, distance) with normals pointing into the frustum.
+        uint32_t objectCount = 0;
+        uint32_t compact = 1;           // If 1 visible objects are written to the front and counted.
+    };
+
+    /// @brief Create buffers for maxObjectCount objects and the culling pipeline.
+    /// @param cullShader Compiled shaders/cull_draws.comp.
+    /// @param enabledFeatures Extensions and features logicalDevice was created with, as returned by createLogicalDevice().
+    /// multiDrawIndirect and VK_KHR_draw_indirect_count are used if they are enabled.
+    /// @throw Throws if the drawIndirectFirstInstance feature is not enabled.
+    IndirectDrawer(vk::Device logicalDevice, const EnabledDeviceFeatures &enabledFeatures, MemoryPool::Ptr pool, Shader::ConstPtr cullShader, uint32_t maxObjectCount);
+
+    /// @brief Destroys buffers and pipeline. Make sure the device does not use them anymore.
+    ~IndirectDrawer();
+
+    IndirectDrawer(const IndirectDrawer &other) = delete;
+    IndirectDrawer &operator=(const IndirectDrawer &other) = delete;
+
+    /// @brief Set all objects. The object buffer is host-visible, so do not change objects used by frames in flight.
+    /// @throw Throws if there are more than maxObjectCount objects.
+    void setObjects(const std::vector<DrawObject> &objects);
+
+    /// @brief Update a single object, e.g. after it moved.
+    /// @throw Throws if index is >= objectCount().
+    void updateObject(uint32_t index, const DrawObject &object);
+
+    /// @brief Get number of objects.
+    uint32_t objectCount() const;
+
+    /// @brief Record the culling pass. Call this outside of a render pass before recordDraw().
+    /// @param frustumPlanes Planes as (normal, distance) with normals pointing into the frustum.
+    void recordCulling(vk::CommandBuffer commandBuffer, const float frustumPlanes[6][4]);
+
+    /// @brief Record the indirect draws of visible objects. Call this inside a render pass with the graphics pipeline,
+    /// descriptor sets, vertex and index buffers bound.
+    void recordDraw(vk::CommandBuffer commandBuffer) const;
+
+    /// @brief Returns true if draws use vkCmdDrawIndexedIndirectCountKHR.
+    bool hasDrawIndirectCount() const;
+
+    /// @brief Get storage buffer of DrawObjects.
+    Buffer::Ptr objectBuffer() const;
+    /// @brief Get buffer of vk::DrawIndexedIndirectCommands written by the culling pass.
+    Buffer::Ptr commandBuffer() const;
+    /// @brief Get buffer with the number of commands written by the culling pass.
+    Buffer::Ptr countBuffer() const;
+
+private:
+    static const uint32_t WorkGroupSize = 64;
+
+    vk::Device m_logicalDevice = nullptr;
+    MemoryPool::Ptr m_pool;
+    uint32_t m_maxObjectCount = 0;
+    uint32_t m_objectCount = 0;
+    bool m_multiDrawIndirect = false;
+    PFN_vkCmdDrawIndexedIndirectCountKHR m_drawIndexedIndirectCount = nullptr; // Fetched with vkGetDeviceProcAddr. nullptr if not enabled.
+    Buffer::Ptr m_objectBuffer;
+    Buffer::Ptr m_commandBuffer;
+    Buffer::Ptr m_countBuffer;
+    DescriptorSetLayout::Ptr m_descriptorSetLayout;
+    PipelineLayout m_pipelineLayout;
+    ComputePipeline m_pipeline;
+    vk::DescriptorPool m_descriptorPool = nullptr;
+    vk::DescriptorSet m_descriptorSet = nullptr;
+};
+
+}
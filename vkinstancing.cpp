@@ -0,0 +1,238 @@
+#include "vkinstancing.h"
+
+#include "vkutils.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <tuple>
+
+namespace vsvr
+{
+
+InstanceBuffer::InstanceBuffer(vk::PhysicalDevice physicalDevice, vk::Device logicalDevice, MemoryPool::Ptr pool, const std::vector<Attribute> &attributes, uint32_t instanceCapacity, uint32_t frameCount)
+    : m_physicalDevice(physicalDevice)
+    , m_logicalDevice(logicalDevice)
+    , m_pool(pool)
+    , m_frameCount(frameCount)
+    , m_capacity(std::max(instanceCapacity, uint32_t(1)))
+    , m_requestedCount(0)
+{
+    if (attributes.empty())
+    {
+        throw std::runtime_error("Instance buffer needs at least one attribute!");
+    }
+    // pack attributes in order like InterleavedVertexBuffer does
+    const uint32_t binding = attributes.front().vertexBinding;
+    for (const auto & a : attributes)
+    {
+        const uint32_t size = formatSize(a.format);
+        m_attributeBindings.push_back({a.attributeLocation, binding, a.format, m_stride});
+        m_stride += (size + InterleavedVertexBuffer::AttributeAlignment - 1) & ~(InterleavedVertexBuffer::AttributeAlignment - 1);
+    }
+    m_vertexBindings.push_back({binding, m_stride, vk::VertexInputRate::eInstance});
+    createRing();
+}
+
+void InstanceBuffer::createRing()
+{
+    // release the old ring first, so we do not need memory for both
+    m_ring.reset();
+    m_ring.reset(new FrameRingAllocator(m_physicalDevice, m_logicalDevice, m_pool, static_cast<vk::DeviceSize>(m_capacity) * m_stride, vk::BufferUsageFlagBits::eVertexBuffer, m_frameCount));
+}
+
+void InstanceBuffer::beginFrame(uint32_t instanceCount)
+{
+    // grow if the last frame dropped instances or we are told more are coming
+    const uint32_t needed = std::max(instanceCount, m_requestedCount.load());
+    if (needed > m_capacity)
+    {
+        m_capacity = std::max(needed, m_capacity * 2);
+        createRing();
+    }
+    m_ring->beginFrame();
+    m_frameAllocation = m_ring->allocate(static_cast<vk::DeviceSize>(m_capacity) * m_stride);
+    m_requestedCount = 0;
+}
+
+uint32_t InstanceBuffer::reserve(uint32_t count)
+{
+    if (m_frameAllocation.data == nullptr)
+    {
+        throw std::runtime_error("Call beginFrame() before adding instances!");
+    }
+    // keep counting instances that do not fit, so beginFrame() knows how much to grow
+    const uint32_t first = m_requestedCount.fetch_add(count);
+    if (static_cast<uint64_t>(first) + count > m_capacity)
+    {
+        return InvalidInstance;
+    }
+    return first;
+}
+
+void *InstanceBuffer::data(uint32_t instance) const
+{
+    return static_cast<uint8_t *>(m_frameAllocation.data) + static_cast<size_t>(instance) * m_stride;
+}
+
+uint32_t InstanceBuffer::add(const void *data, uint32_t count)
+{
+    const uint32_t first = reserve(count);
+    if (first != InvalidInstance)
+    {
+        std::memcpy(this->data(first), data, static_cast<size_t>(count) * m_stride);
+    }
+    return first;
+}
+
+void InstanceBuffer::endFrame(vk::Queue queue)
+{
+    m_ring->endFrame(queue);
+    m_frameAllocation = FrameRingAllocator::Allocation();
+}
+
+void InstanceBuffer::bind(vk::CommandBuffer commandBuffer) const
+{
+    // the allocation offset is relative to the vk::Buffer, which is what binding takes
+    commandBuffer.bindVertexBuffers(m_vertexBindings.front().binding, 1, &m_frameAllocation.buffer, &m_frameAllocation.offset);
+}
+
+uint32_t InstanceBuffer::instanceCount() const
+{
+    return std::min(m_requestedCount.load(), m_capacity);
+}
+
+uint32_t InstanceBuffer::capacity() const
+{
+    return m_capacity;
+}
+
+uint32_t InstanceBuffer::stride() const
+{
+    return m_stride;
+}
+
+uint32_t InstanceBuffer::binding() const
+{
+    return m_vertexBindings.front().binding;
+}
+
+const std::vector<vk::VertexInputBindingDescription> & InstanceBuffer::vertexBindings() const
+{
+    return m_vertexBindings;
+}
+
+const std::vector<vk::VertexInputAttributeDescription> & InstanceBuffer::attributeBindings() const
+{
+    return m_attributeBindings;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DrawBatcher::Key::operator<(const Key &other) const
+{
+    return std::tie(pipeline, firstIndex, vertexOffset, indexCount) < std::tie(other.pipeline, other.firstIndex, other.vertexOffset, other.indexCount);
+}
+
+DrawBatcher::DrawBatcher(uint32_t instanceStride)
+    : m_instanceStride(instanceStride)
+{
+}
+
+void DrawBatcher::add(vk::Pipeline pipeline, const GeometryArena::Mesh &mesh, const void *instanceData)
+{
+    uint32_t index = m_lastBatch;
+    if (index == UINT32_MAX || m_batches[index].pipeline != pipeline || m_batches[index].mesh.firstIndex != mesh.firstIndex ||
+        m_batches[index].mesh.vertexOffset != mesh.vertexOffset || m_batches[index].mesh.indexCount != mesh.indexCount)
+    {
+        const Key key = {pipeline, mesh.firstIndex, mesh.vertexOffset, mesh.indexCount};
+        auto it = m_batchIndices.find(key);
+        if (it == m_batchIndices.end())
+        {
+            it = m_batchIndices.emplace(key, static_cast<uint32_t>(m_batches.size())).first;
+            Batch batch;
+            batch.pipeline = pipeline;
+            batch.mesh = mesh;
+            m_batches.push_back(std::move(batch));
+        }
+        index = it->second;
+        m_lastBatch = index;
+    }
+    auto & batch = m_batches[index];
+    auto bytes = static_cast<const uint8_t *>(instanceData);
+    batch.instanceData.insert(batch.instanceData.end(), bytes, bytes + m_instanceStride);
+    batch.instanceCount++;
+    m_drawCount++;
+}
+
+void DrawBatcher::build(InstanceBuffer &instances)
+{
+    if (instances.stride() != m_instanceStride)
+    {
+        throw std::runtime_error("Instance buffer stride does not match batcher!");
+    }
+    for (auto & batch : m_batches)
+    {
+        if (batch.instanceCount > 0)
+        {
+            batch.firstInstance = instances.add(batch.instanceData.data(), batch.instanceCount);
+        }
+    }
+}
+
+void DrawBatcher::record(vk::CommandBuffer commandBuffer) const
+{
+    vk::Pipeline boundPipeline = nullptr;
+    for (const auto & entry : m_batchIndices)
+    {
+        const auto & batch = m_batches[entry.second];
+        if (batch.instanceCount == 0 || batch.firstInstance == InstanceBuffer::InvalidInstance)
+        {
+            continue;
+        }
+        if (batch.pipeline != boundPipeline)
+        {
+            commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, batch.pipeline);
+            boundPipeline = batch.pipeline;
+        }
+        GeometryArena::draw(commandBuffer, batch.mesh, batch.instanceCount, batch.firstInstance);
+    }
+}
+
+void DrawBatcher::clear()
+{
+    // drop batches that were not used this frame, so meshes that are gone do not pile up
+    if (std::any_of(m_batches.cbegin(), m_batches.cend(), [](const Batch & b){ return b.instanceCount == 0; }))
+    {
+        std::vector<Batch> batches;
+        m_batchIndices.clear();
+        for (auto & batch : m_batches)
+        {
+            if (batch.instanceCount > 0)
+            {
+                m_batchIndices.emplace(Key({batch.pipeline, batch.mesh.firstIndex, batch.mesh.vertexOffset, batch.mesh.indexCount}), static_cast<uint32_t>(batches.size()));
+                batches.push_back(std::move(batch));
+            }
+        }
+        m_batches.swap(batches);
+    }
+    for (auto & batch : m_batches)
+    {
+        batch.instanceData.clear();
+        batch.instanceCount = 0;
+        batch.firstInstance = InstanceBuffer::InvalidInstance;
+    }
+    m_drawCount = 0;
+    m_lastBatch = UINT32_MAX;
+}
+
+const std::vector<DrawBatcher::Batch> & DrawBatcher::batches() const
+{
+    return m_batches;
+}
+
+uint32_t DrawBatcher::drawCount() const
+{
+    return m_drawCount;
+}
+
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "vkincludes.h"
+#include "vkbuffers.h"
+#include "vkframering.h"
+#include "vkgeometry.h"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace vsvr
+{
+
+/// @brief Per-instance vertex data that is rewritten every frame, e.g. transforms and colors.
+/// Instances are written to the current partition of a FrameRingAllocator, so frames in flight are not overwritten.
+/// Any number of threads can add instances between beginFrame() and endFrame(). Reserving instances is a single atomic add.
+/// If a frame needs more instances than fit, the instances that do not fit are dropped and the buffer grows
+/// in the next beginFrame() to fit the number of instances requested.
+/// @note Instance data is written as is in the attribute formats. Attribute quantization is ignored.
+class InstanceBuffer
+{
+public:
+    static constexpr uint32_t InvalidInstance = UINT32_MAX;
+
+    /// @brief Create buffer for instances with attributes.
+    /// Attribute offsets and the instance stride are computed from the attribute formats like for InterleavedVertexBuffer.
+    /// The binding number is taken from the first attribute. The input rate is always eInstance.
+    /// @param instanceCapacity Initial number of instances per frame.
+    /// @throw Throws if attributes is empty or a format has no byte size.
+    InstanceBuffer(vk::PhysicalDevice physicalDevice, vk::Device logicalDevice, MemoryPool::Ptr pool, const std::vector<Attribute> &attributes, uint32_t instanceCapacity, uint32_t frameCount = Window::MAX_IN_FLIGHT_SUBMISSIONS);
+
+    InstanceBuffer(const InstanceBuffer &other) = delete;
+    InstanceBuffer &operator=(const InstanceBuffer &other) = delete;
+
+    /// @brief Start a new frame. Waits if the device is still using the partition of the frame frameCount frames ago.
+    /// Grows the buffer if the last frame requested more instances than fit or instanceCount is bigger than the capacity.
+    /// Growing waits for all frames in flight to finish.
+    /// @param instanceCount Number of instances you expect to add this frame. Pass this to avoid dropping instances.
+    void beginFrame(uint32_t instanceCount = 0);
+
+    /// @brief Reserve count consecutive instances. Thread-safe.
+    /// @return Index of first instance to pass as firstInstance when drawing, or InvalidInstance if the instances do not fit.
+    uint32_t reserve(uint32_t count);
+
+    /// @brief Get pointer to the data of a reserved instance for writing.
+    void *data(uint32_t instance) const;
+
+    /// @brief Reserve count instances and copy count * stride() bytes of data to them. Thread-safe.
+    /// @return Index of first instance or InvalidInstance if the instances do not fit.
+    uint32_t add(const void *data, uint32_t count = 1);
+
+    /// @brief End frame. Call this after submitting all commands drawing instances of this frame to queue.
+    void endFrame(vk::Queue queue);
+
+    /// @brief Bind instance data of the current frame. Draw with the indices returned by reserve() or add() as firstInstance.
+    void bind(vk::CommandBuffer commandBuffer) const;
+
+    /// @brief Get number of instances added in current frame.
+    uint32_t instanceCount() const;
+    /// @brief Get number of instances that fit into a frame.
+    uint32_t capacity() const;
+    /// @brief Get byte size of an instance.
+    uint32_t stride() const;
+    uint32_t binding() const;
+    const std::vector<vk::VertexInputBindingDescription> & vertexBindings() const;
+    const std::vector<vk::VertexInputAttributeDescription> & attributeBindings() const;
+
+private:
+    /// @brief Create ring for m_capacity instances. Destroying the old ring waits for its frames to finish.
+    void createRing();
+
+    vk::PhysicalDevice m_physicalDevice = nullptr;
+    vk::Device m_logicalDevice = nullptr;
+    MemoryPool::Ptr m_pool;
+    std::unique_ptr<FrameRingAllocator> m_ring;
+    FrameRingAllocator::Allocation m_frameAllocation; // Partition of the current frame.
+    uint32_t m_frameCount = 0;
+    uint32_t m_capacity = 0;
+    uint32_t m_stride = 0;
+    std::atomic<uint32_t> m_requestedCount; // Number of instances reserved in current frame, including ones that did not fit.
+    std::vector<vk::VertexInputBindingDescription> m_vertexBindings;
+    std::vector<vk::VertexInputAttributeDescription> m_attributeBindings;
+};
+
+/// @brief Merges draws of the same mesh with the same pipeline into a single instanced draw.
+/// Call add() for every object, then build() to copy the instance data of each batch to consecutive instances
+/// of an InstanceBuffer and record() to draw the batches sorted by pipeline.
+/// @note Not thread-safe. Use one batcher per thread, e.g. per secondary command buffer. They can share an InstanceBuffer.
+class DrawBatcher
+{
+public:
+    /// @brief An instanced draw of a mesh.
+    struct Batch
+    {
+        vk::Pipeline pipeline = nullptr;
+        GeometryArena::Mesh mesh;
+        uint32_t firstInstance = InstanceBuffer::InvalidInstance; // Set by build(). InvalidInstance if the batch did not fit.
+        uint32_t instanceCount = 0;
+        std::vector<uint8_t> instanceData;
+    };
+
+    /// @brief Create batcher for instances of instanceStride bytes.
+    DrawBatcher(uint32_t instanceStride);
+
+    /// @brief Add a draw of mesh with pipeline and the data of one instance.
+    void add(vk::Pipeline pipeline, const GeometryArena::Mesh &mesh, const void *instanceData);
+
+    /// @brief Copy instance data of all batches to instances.
+    /// Batches that do not fit into instances are skipped by record().
+    /// @throw Throws if the instance stride of instances differs.
+    void build(InstanceBuffer &instances);
+
+    /// @brief Record one drawIndexed per batch. Binds pipelines as needed.
+    /// Bind the geometry and instance buffers and descriptor sets before.
+    void record(vk::CommandBuffer commandBuffer) const;
+
+    /// @brief Remove all draws. Keeps memory allocated for the next frame.
+    void clear();
+
+    /// @brief Get batches. Empty batches have an instanceCount of 0.
+    const std::vector<Batch> & batches() const;
+    /// @brief Get number of draws added since clear().
+    uint32_t drawCount() const;
+
+private:
+    struct Key
+    {
+        vk::Pipeline pipeline;
+        uint32_t firstIndex;
+        int32_t vertexOffset;
+        uint32_t indexCount;
+
+        bool operator<(const Key &other) const;
+    };
+
+    uint32_t m_instanceStride = 0;
+    uint32_t m_drawCount = 0;
+    std::map<Key, uint32_t> m_batchIndices; // Index of batch in m_batches. Ordered by pipeline, so record() switches pipelines as little as possible.
+    std::vector<Batch> m_batches;
+    uint32_t m_lastBatch = UINT32_MAX;       // Batch of the last draw added. Consecutive draws often go to the same batch.
+};
+
+}
@@ -0,0 +1,306 @@
+#include "vkmeshlet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace vsvr
+{
+
+std::vector<uint32_t> Meshlets::indices() const
+{
+    std::vector<uint32_t> result(triangles.size());
+    for (const auto & m : meshlets)
+    {
+        for (uint32_t i = m.triangleOffset * 3; i < (m.triangleOffset + m.triangleCount) * 3; i++)
+        {
+            result[i] = vertices[m.vertexOffset + triangles[i]];
+        }
+    }
+    return result;
+}
+
+// positions may not be aligned to floats, so copy them
+static void loadPosition(const uint8_t *positions, uint32_t stride, uint32_t vertex, float p[3])
+{
+    std::memcpy(p, positions + static_cast<size_t>(vertex) * stride, 3 * sizeof(float));
+}
+
+static float distanceSquared(const float a[3], const float b[3])
+{
+    const float dx = a[0] - b[0];
+    const float dy = a[1] - b[1];
+    const float dz = a[2] - b[2];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+static MeshletBounds computeBounds(const Meshlets &meshlets, const Meshlet &meshlet, const uint8_t *positions, uint32_t stride)
+{
+    MeshletBounds bounds;
+    // bounding sphere with Ritter's algorithm: start with the sphere around two distant points and grow it to include all points
+    std::vector<float> points(meshlet.vertexCount * 3);
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+    {
+        loadPosition(positions, stride, meshlets.vertices[meshlet.vertexOffset + i], &points[i * 3]);
+    }
+    auto farthest = [&](const float *from) {
+        uint32_t result = 0;
+        float maxDistance = -1.0f;
+        for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+        {
+            const float d = distanceSquared(from, &points[i * 3]);
+            if (d > maxDistance)
+            {
+                maxDistance = d;
+                result = i;
+            }
+        }
+        return result;
+    };
+    const float *a = &points[farthest(&points[0]) * 3];
+    const float *b = &points[farthest(a) * 3];
+    float *center = bounds.center;
+    for (uint32_t c = 0; c < 3; c++)
+    {
+        center[c] = (a[c] + b[c]) * 0.5f;
+    }
+    float radius = std::sqrt(distanceSquared(a, b)) * 0.5f;
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+    {
+        const float *p = &points[i * 3];
+        const float d = std::sqrt(distanceSquared(center, p));
+        if (d > radius)
+        {
+            // move center towards point, so the new sphere touches it and still contains the old one
+            const float newRadius = (radius + d) * 0.5f;
+            const float shift = (newRadius - radius) / d;
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                center[c] += (p[c] - center[c]) * shift;
+            }
+            radius = newRadius;
+        }
+    }
+    bounds.radius = radius;
+    // normal cone: average the triangle normals, then find the normal with the largest angle to the average
+    std::vector<float> normals;
+    normals.reserve(meshlet.triangleCount * 3);
+    float axis[3] = {};
+    for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+    {
+        const uint32_t first = (meshlet.triangleOffset + t) * 3;
+        const float *p0 = &points[meshlets.triangles[first] * 3];
+        const float *p1 = &points[meshlets.triangles[first + 1] * 3];
+        const float *p2 = &points[meshlets.triangles[first + 2] * 3];
+        const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+        const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        // degenerate triangles are never rasterized, so they do not limit the cone
+        if (length > 0.0f)
+        {
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                normals.push_back(n[c] / length);
+                axis[c] += n[c] / length;
+            }
+        }
+    }
+    const float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (normals.empty() || axisLength <= 0.0f)
+    {
+        return bounds;
+    }
+    float minDot = 1.0f;
+    for (uint32_t c = 0; c < 3; c++)
+    {
+        bounds.coneAxis[c] = axis[c] / axisLength;
+    }
+    for (size_t i = 0; i < normals.size(); i += 3)
+    {
+        minDot = std::min(minDot, normals[i] * bounds.coneAxis[0] + normals[i + 1] * bounds.coneAxis[1] + normals[i + 2] * bounds.coneAxis[2]);
+    }
+    // if the cone is wider than a hemisphere, some triangle always faces the camera
+    bounds.coneCutoff = minDot <= 0.0f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+    return bounds;
+}
+
+Meshlets buildMeshlets(const std::vector<uint32_t> &indices, const RawData &positions, uint32_t positionStride, uint32_t vertexCount, uint32_t maxVertices, uint32_t maxTriangles)
+{
+    if (maxVertices < 3 || maxVertices > 256 || maxTriangles == 0)
+    {
+        throw std::runtime_error("Meshlets need 3 to 256 vertices and at least one triangle!");
+    }
+    if (indices.size() % 3 != 0)
+    {
+        throw std::runtime_error("Number of indices must be a multiple of 3!");
+    }
+    if (positions.copySize() < static_cast<vk::DeviceSize>(vertexCount) * positionStride)
+    {
+        throw std::runtime_error("Position data is smaller than vertex count!");
+    }
+    Meshlets result;
+    result.meshVertexCount = vertexCount;
+    result.triangles.reserve(indices.size());
+    // meshlet vertex index of mesh vertices in the current meshlet
+    std::vector<uint32_t> localIndex(vertexCount, UINT32_MAX);
+    Meshlet current;
+    auto finishMeshlet = [&]() {
+        for (uint32_t i = 0; i < current.vertexCount; i++)
+        {
+            localIndex[result.vertices[current.vertexOffset + i]] = UINT32_MAX;
+        }
+        result.meshlets.push_back(current);
+        current.vertexOffset += current.vertexCount;
+        current.triangleOffset += current.triangleCount;
+        current.vertexCount = 0;
+        current.triangleCount = 0;
+    };
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        const uint32_t triangle[3] = {indices[t], indices[t + 1], indices[t + 2]};
+        uint32_t newVertexCount = 0;
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            if (triangle[i] >= vertexCount)
+            {
+                throw std::runtime_error("Index out of range of vertices!");
+            }
+            if (localIndex[triangle[i]] == UINT32_MAX && (i == 0 || triangle[i] != triangle[0]) && (i < 2 || triangle[i] != triangle[1]))
+            {
+                newVertexCount++;
+            }
+        }
+        if (current.vertexCount + newVertexCount > maxVertices || current.triangleCount + 1 > maxTriangles)
+        {
+            finishMeshlet();
+        }
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            if (localIndex[triangle[i]] == UINT32_MAX)
+            {
+                localIndex[triangle[i]] = current.vertexCount++;
+                result.vertices.push_back(triangle[i]);
+            }
+            result.triangles.push_back(static_cast<uint8_t>(localIndex[triangle[i]]));
+        }
+        current.triangleCount++;
+    }
+    if (current.triangleCount > 0)
+    {
+        finishMeshlet();
+    }
+    auto positionData = static_cast<const uint8_t *>(positions.begin());
+    for (const auto & m : result.meshlets)
+    {
+        result.bounds.push_back(computeBounds(result, m, positionData, positionStride));
+    }
+    return result;
+}
+
+bool cullMeshlet(const MeshletBounds &bounds, const float frustumPlanes[6][4], const float cameraPosition[3])
+{
+    const float *c = bounds.center;
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        const float *plane = frustumPlanes[i];
+        if (plane[0] * c[0] + plane[1] * c[1] + plane[2] * c[2] + plane[3] < -bounds.radius)
+        {
+            return true;
+        }
+    }
+    const float view[3] = {c[0] - cameraPosition[0], c[1] - cameraPosition[1], c[2] - cameraPosition[2]};
+    const float distance = std::sqrt(view[0] * view[0] + view[1] * view[1] + view[2] * view[2]);
+    return view[0] * bounds.coneAxis[0] + view[1] * bounds.coneAxis[1] + view[2] * bounds.coneAxis[2] >= bounds.coneCutoff * distance + bounds.radius;
+}
+
+SHAREDRESOURCE_FUNCTIONS_CPP(MeshletBuffer)
+
+MeshletBuffer::MeshletBuffer(MemoryPool::Ptr pool, const Meshlets &meshlets, const Buffer::Settings &settings)
+    : m_pool(pool)
+    , m_meshletCount(static_cast<uint32_t>(meshlets.meshlets.size()))
+{
+    if (meshlets.meshlets.empty())
+    {
+        throw std::runtime_error("No meshlets to upload!");
+    }
+    Buffer::Settings storageSettings = settings;
+    storageSettings.usage |= vk::BufferUsageFlagBits::eStorageBuffer;
+    m_meshletBuffer = m_pool->createBuffer(meshlets.meshlets.size() * sizeof(Meshlet), storageSettings);
+    m_pool->updateBuffer(m_meshletBuffer, RawData(meshlets.meshlets));
+    m_boundsBuffer = m_pool->createBuffer(meshlets.bounds.size() * sizeof(MeshletBounds), storageSettings);
+    m_pool->updateBuffer(m_boundsBuffer, RawData(meshlets.bounds));
+    m_vertexBuffer = m_pool->createBuffer(meshlets.vertices.size() * sizeof(uint32_t), storageSettings);
+    m_pool->updateBuffer(m_vertexBuffer, RawData(meshlets.vertices));
+    // shaders read triangles as uints, so pad to a multiple of 4 bytes
+    std::vector<uint8_t> triangles(meshlets.triangles);
+    triangles.resize((triangles.size() + 3) & ~static_cast<size_t>(3), 0);
+    m_triangleBuffer = m_pool->createBuffer(triangles.size(), storageSettings);
+    m_pool->updateBuffer(m_triangleBuffer, RawData(triangles));
+    Buffer::Settings indexSettings = settings;
+    indexSettings.usage |= vk::BufferUsageFlagBits::eIndexBuffer;
+    m_indexBuffer = std::make_shared<IndexBuffer>(m_pool, vk::IndexType::eUint32, meshlets.triangles.size() * sizeof(uint32_t), indexSettings);
+    m_indexBuffer->update(meshlets.indices(), meshlets.meshVertexCount, false);
+}
+
+MeshletBuffer::~MeshletBuffer()
+{
+    if (m_pool)
+    {
+        for (auto & buffer : {m_meshletBuffer, m_boundsBuffer, m_vertexBuffer, m_triangleBuffer})
+        {
+            if (buffer)
+            {
+                m_pool->destroyBuffer(buffer);
+            }
+        }
+    }
+}
+
+MeshletBuffer &MeshletBuffer::operator=(MeshletBuffer &&other)
+{
+    if (&other != this)
+    {
+        m_pool = std::move(other.m_pool); other.m_pool = nullptr;
+        m_meshletBuffer = std::move(other.m_meshletBuffer); other.m_meshletBuffer = nullptr;
+        m_boundsBuffer = std::move(other.m_boundsBuffer); other.m_boundsBuffer = nullptr;
+        m_vertexBuffer = std::move(other.m_vertexBuffer); other.m_vertexBuffer = nullptr;
+        m_triangleBuffer = std::move(other.m_triangleBuffer); other.m_triangleBuffer = nullptr;
+        m_indexBuffer = std::move(other.m_indexBuffer); other.m_indexBuffer = nullptr;
+        m_meshletCount = std::move(other.m_meshletCount); other.m_meshletCount = 0;
+    }
+    return *this;
+}
+
+Buffer::Ptr MeshletBuffer::meshletBuffer() const
+{
+    return m_meshletBuffer;
+}
+
+Buffer::Ptr MeshletBuffer::boundsBuffer() const
+{
+    return m_boundsBuffer;
+}
+
+Buffer::Ptr MeshletBuffer::vertexBuffer() const
+{
+    return m_vertexBuffer;
+}
+
+Buffer::Ptr MeshletBuffer::triangleBuffer() const
+{
+    return m_triangleBuffer;
+}
+
+IndexBuffer::Ptr MeshletBuffer::indexBuffer() const
+{
+    return m_indexBuffer;
+}
+
+uint32_t MeshletBuffer::meshletCount() const
+{
+    return m_meshletCount;
+}
+
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "vkincludes.h"
+#include "vkbuffer.h"
+#include "vkbuffers.h"
+#include <cstdint>
+#include <vector>
+
+namespace vsvr
+{
+
+/// @brief A cluster of triangles of a mesh with a limited number of vertices. Matches a std430 struct of 4 uints.
+struct Meshlet
+{
+    uint32_t vertexOffset = 0;   // Offset of first vertex in Meshlets::vertices.
+    uint32_t triangleOffset = 0; // Offset of first triangle in Meshlets::triangles / 3. Also offset of first index in Meshlets::indices() / 3.
+    uint32_t vertexCount = 0;    // Number of vertices.
+    uint32_t triangleCount = 0;  // Number of triangles.
+};
+
+/// @brief Culling data of a meshlet. Matches a std430 struct of vec3 center, float radius, vec3 coneAxis, float coneCutoff.
+struct MeshletBounds
+{
+    float center[3] = {};   // Center of bounding sphere.
+    float radius = 0.0f;    // Radius of bounding sphere.
+    float coneAxis[3] = {}; // Average direction of triangle normals.
+    float coneCutoff = 1.0f; // Sine of the half angle of the normal cone. 1 if the meshlet can not be backface culled.
+};
+
+/// @brief A mesh split into meshlets.
+struct Meshlets
+{
+    std::vector<Meshlet> meshlets;
+    std::vector<MeshletBounds> bounds;  // Culling data per meshlet.
+    std::vector<uint32_t> vertices;     // Mesh vertex index of each meshlet vertex.
+    std::vector<uint8_t> triangles;     // 3 meshlet vertex indices per triangle.
+    uint32_t meshVertexCount = 0;       // Number of vertices of mesh.
+
+    /// @brief Get mesh indices of all triangles in meshlet order, e.g. to draw meshlets with drawIndexed().
+    std::vector<uint32_t> indices() const;
+};
+
+/// @brief Split a triangle list into meshlets of at most maxVertices vertices and maxTriangles triangles and compute their bounds.
+/// Triangles are added to meshlets in the order of indices, so optimize them with optimizeVertexCache() first to get compact meshlets.
+/// The defaults fit the output limits of mesh shaders on most GPUs.
+/// @param positions Vertex data starting with 3 floats per vertex, e.g. eR32G32B32Sfloat positions.
+/// @param positionStride Byte distance between vertices in positions.
+/// @throw Throws if maxVertices is not in [3, 256], maxTriangles is 0, the number of indices is not a multiple of 3 or an index is >= vertexCount.
+Meshlets buildMeshlets(const std::vector<uint32_t> &indices, const RawData &positions, uint32_t positionStride, uint32_t vertexCount, uint32_t maxVertices = 64, uint32_t maxTriangles = 124);
+
+/// @brief Returns true if a meshlet is outside of the view frustum or all its triangles face away from the camera.
+/// The same tests can be done in a compute or task shader:
+/// Outside: dot(plane.xyz, center) + plane.w < -radius for any plane.
+/// Back facing: dot(center - cameraPosition, coneAxis) >= coneCutoff * length(center - cameraPosition) + radius.
+/// @param frustumPlanes Planes as (normal, distance) with normals pointing into the frustum.
+/// @note Assumes front faces are wound counter-clockwise in the coordinate system of the positions.
+bool cullMeshlet(const MeshletBounds &bounds, const float frustumPlanes[6][4], const float cameraPosition[3]);
+
+/// @brief Meshlets of a mesh on the device.
+/// The meshlets, bounds, vertices and triangles are in storage buffers for culling on the GPU or mesh shaders.
+/// The mesh indices in meshlet order are in an index buffer, so visible meshlets can be drawn with the classic
+/// pipeline using drawIndexed(meshlet.triangleCount * 3, 1, meshlet.triangleOffset * 3, 0, 0) and the mesh vertex buffers.
+class MeshletBuffer
+{
+public:
+    SHAREDRESOURCE_FUNCTIONS_H(MeshletBuffer)
+
+    /// @brief Upload meshlets to the device.
+    /// @param settings Settings for all buffers. eStorageBuffer or eIndexBuffer usage is added as needed.
+    /// @throw Throws if meshlets is empty.
+    MeshletBuffer(MemoryPool::Ptr pool, const Meshlets &meshlets, const Buffer::Settings &settings);
+
+    /// @brief Destroy buffers on device. Note that the buffers will immediately be destroyed.
+    ~MeshletBuffer();
+
+    /// @brief Get storage buffer of Meshlet structs.
+    Buffer::Ptr meshletBuffer() const;
+    /// @brief Get storage buffer of MeshletBounds structs.
+    Buffer::Ptr boundsBuffer() const;
+    /// @brief Get storage buffer of uint mesh vertex indices of meshlet vertices.
+    Buffer::Ptr vertexBuffer() const;
+    /// @brief Get storage buffer of meshlet triangles. 3 bytes per triangle, packed into uints.
+    Buffer::Ptr triangleBuffer() const;
+    /// @brief Get index buffer with mesh indices in meshlet order.
+    IndexBuffer::Ptr indexBuffer() const;
+    /// @brief Get number of meshlets.
+    uint32_t meshletCount() const;
+
+private:
+    MemoryPool::Ptr m_pool;
+    Buffer::Ptr m_meshletBuffer;
+    Buffer::Ptr m_boundsBuffer;
+    Buffer::Ptr m_vertexBuffer;
+    Buffer::Ptr m_triangleBuffer;
+    IndexBuffer::Ptr m_indexBuffer;
+    uint32_t m_meshletCount = 0;
+};
+
+}
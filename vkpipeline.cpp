@@ -152,4 +152,55 @@ void Pipeline::bind(vk::CommandBuffer commandBuffer, vk::PipelineBindPoint bindP
 {
 }
 
+//-------------------------------------------------------------------------------------------------
+
+DEVICERESOURCE_FUNCTIONS_CPP(ComputePipeline)
+
+ComputePipeline &ComputePipeline::operator=(ComputePipeline &&other)
+{
+    if (&other != this)
+    {
+        DeviceResource::operator=(std::move(other));
+        m_pipeline = std::move(other.m_pipeline); other.m_pipeline = nullptr;
+    }
+    return *this;
+}
+
+void ComputePipeline::create(vk::Device logicalDevice, const PipelineLayout &layout, Shader::ConstPtr shader)
+{
+    if (isValid())
+    {
+        throw std::runtime_error("ComputePipeline already created!");
+    }
+    if (shader->stage() != vk::ShaderStageFlagBits::eCompute)
+    {
+        throw std::runtime_error("Compute pipeline needs a compute shader!");
+    }
+    vk::ComputePipelineCreateInfo pipelineInfo;
+    pipelineInfo.stage.stage = shader->stage();
+    pipelineInfo.stage.module = shader->module();
+    pipelineInfo.stage.pName = shader->entryPoint().data();
+    pipelineInfo.layout = layout.layout();
+    pipelineInfo.basePipelineHandle = nullptr;
+    pipelineInfo.basePipelineIndex = -1;
+    m_pipeline = logicalDevice.createComputePipeline(nullptr, pipelineInfo);
+    setCreated(logicalDevice);
+}
+
+void ComputePipeline::destroyResource()
+{
+    logicalDevice().destroyPipeline(m_pipeline);
+    m_pipeline = nullptr;
+}
+
+const vk::Pipeline ComputePipeline::pipeline() const
+{
+    return m_pipeline;
+}
+
+void ComputePipeline::bind(vk::CommandBuffer commandBuffer) const
+{
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_pipeline);
+}
+
 } // namespace vsvr
@@ -70,4 +70,22 @@ private:
     vk::Pipeline m_pipeline = nullptr;
 };
 
+class ComputePipeline: public DeviceResource
+{
+public:
+    DEVICERESOURCE_FUNCTIONS_H(ComputePipeline)
+
+    /// @brief Create compute pipeline from a compute shader.
+    void create(vk::Device logicalDevice, const PipelineLayout &layout, Shader::ConstPtr shader);
+
+    /// @brief Get pipeline handle.
+    const vk::Pipeline pipeline() const;
+
+    /// @brief Bind the pipeline to the compute bind point of a command buffer.
+    void bind(vk::CommandBuffer commandBuffer) const;
+
+private:
+    vk::Pipeline m_pipeline = nullptr;
+};
+
 }
@@ -0,0 +1,314 @@
+#include "vkquantize.h"
+
+#include "vkutils.h"
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define VSVR_SSE2
+    #include <emmintrin.h>
+#endif
+
+namespace vsvr
+{
+
+// scalar conversions. these are also used for the remainders of the vectorized loops
+
+static uint16_t toHalf(float f)
+{
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    const uint32_t sign = x & 0x80000000;
+    x ^= sign;
+    uint32_t h;
+    if (x >= 0x47800000)
+    {
+        // too big for half, infinity or NaN
+        h = x > 0x7f800000 ? 0x7e00 : 0x7c00;
+    }
+    else if (x < 0x38800000)
+    {
+        // denormal half. adding 0.5 makes the FPU shift and round the mantissa for us
+        float d;
+        std::memcpy(&d, &x, sizeof(d));
+        d += 0.5f;
+        std::memcpy(&h, &d, sizeof(h));
+        h -= 0x3f000000;
+    }
+    else
+    {
+        // rebias exponent and round mantissa to nearest even
+        const uint32_t mantissaOdd = (x >> 13) & 1;
+        x -= (127 - 15) << 23;
+        x += 0xfff + mantissaOdd;
+        h = x >> 13;
+    }
+    return static_cast<uint16_t>(h | (sign >> 16));
+}
+
+static float signNotZero(float v)
+{
+    return std::signbit(v) ? -1.0f : 1.0f;
+}
+
+static int32_t toSnorm(float v, float scale)
+{
+    return static_cast<int32_t>(std::nearbyint(std::fmin(std::fmax(v, -1.0f), 1.0f) * scale));
+}
+
+static uint32_t octahedral(const float *n)
+{
+    const float sum = std::fmax(std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]), 1e-30f);
+    float x = n[0] / sum;
+    float y = n[1] / sum;
+    if (n[2] < 0.0f)
+    {
+        // fold lower hemisphere over the diagonals
+        const float fx = (1.0f - std::fabs(y)) * signNotZero(x);
+        y = (1.0f - std::fabs(x)) * signNotZero(y);
+        x = fx;
+    }
+    return (static_cast<uint32_t>(toSnorm(x, 32767.0f)) & 0xffff) | (static_cast<uint32_t>(toSnorm(y, 32767.0f)) << 16);
+}
+
+static uint32_t packSnorm(const float *v, uint32_t componentCount)
+{
+    const uint32_t w = (componentCount == 4 && v[3] < 0.0f) ? 3 : 1;
+    return (static_cast<uint32_t>(toSnorm(v[0], 511.0f)) & 0x3ff) | ((static_cast<uint32_t>(toSnorm(v[1], 511.0f)) & 0x3ff) << 10) | ((static_cast<uint32_t>(toSnorm(v[2], 511.0f)) & 0x3ff) << 20) | (w << 30);
+}
+
+#ifdef VSVR_SSE2
+
+// same as toHalf(float) for 4 floats. returns halfs in the low 16 bits of each lane
+static __m128i toHalf(__m128 f)
+{
+    __m128i x = _mm_castps_si128(f);
+    const __m128i sign = _mm_and_si128(x, _mm_set1_epi32(static_cast<int>(0x80000000)));
+    x = _mm_xor_si128(x, sign);
+    const __m128i denormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(x), _mm_set1_ps(0.5f))), _mm_set1_epi32(0x3f000000));
+    const __m128i mantissaOdd = _mm_and_si128(_mm_srli_epi32(x, 13), _mm_set1_epi32(1));
+    const __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(x, _mm_set1_epi32(0xfff - ((127 - 15) << 23))), mantissaOdd), 13);
+    const __m128i isNan = _mm_cmpgt_epi32(x, _mm_set1_epi32(0x7f800000));
+    const __m128i infNan = _mm_or_si128(_mm_set1_epi32(0x7c00), _mm_and_si128(isNan, _mm_set1_epi32(0x0200)));
+    // select result. the sign is cleared, so signed compares work
+    const __m128i isBig = _mm_cmpgt_epi32(x, _mm_set1_epi32(0x477fffff));
+    const __m128i isDenormal = _mm_cmplt_epi32(x, _mm_set1_epi32(0x38800000));
+    __m128i h = _mm_or_si128(_mm_and_si128(isDenormal, denormal), _mm_andnot_si128(isDenormal, normal));
+    h = _mm_or_si128(_mm_and_si128(isBig, infNan), _mm_andnot_si128(isBig, h));
+    return _mm_or_si128(h, _mm_srli_epi32(sign, 16));
+}
+
+// pack 2 x 4 halfs to 8 x 16 bit. sign extending first makes the saturating pack keep all bits
+static __m128i packHalfs(__m128i a, __m128i b)
+{
+    return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+}
+
+// load 4 3-component vectors from 12 floats to 4 registers. w is undefined
+static void loadFloat3x4(const float *src, __m128 &v0, __m128 &v1, __m128 &v2, __m128 &v3)
+{
+    const __m128 a = _mm_loadu_ps(src);     // x0 y0 z0 x1
+    const __m128 b = _mm_loadu_ps(src + 4); // y1 z1 x2 y2
+    const __m128 c = _mm_loadu_ps(src + 8); // z2 x3 y3 z3
+    v0 = a;
+    const __m128 ab = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 3, 3));
+    v1 = _mm_shuffle_ps(ab, ab, _MM_SHUFFLE(3, 3, 2, 1));
+    v2 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(0, 0, 3, 2));
+    v3 = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 2, 1));
+}
+
+static __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static __m128i toSnorm(__m128 v, float scale)
+{
+    return _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f)), _mm_set1_ps(scale)));
+}
+
+#endif
+
+void floatToHalf(const float *src, uint16_t *dst, size_t count)
+{
+    size_t i = 0;
+#ifdef VSVR_SSE2
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i lo = toHalf(_mm_loadu_ps(src + i));
+        const __m128i hi = toHalf(_mm_loadu_ps(src + i + 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), packHalfs(lo, hi));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        dst[i] = toHalf(src[i]);
+    }
+}
+
+void float3ToHalf4(const float *src, uint16_t *dst, size_t count)
+{
+    size_t i = 0;
+#ifdef VSVR_SSE2
+    const __m128 xyzMask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    const __m128 oneW = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 v0, v1, v2, v3;
+        loadFloat3x4(src + i * 3, v0, v1, v2, v3);
+        v0 = _mm_or_ps(_mm_and_ps(v0, xyzMask), oneW);
+        v1 = _mm_or_ps(_mm_and_ps(v1, xyzMask), oneW);
+        v2 = _mm_or_ps(_mm_and_ps(v2, xyzMask), oneW);
+        v3 = _mm_or_ps(_mm_and_ps(v3, xyzMask), oneW);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), packHalfs(toHalf(v0), toHalf(v1)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4 + 8), packHalfs(toHalf(v2), toHalf(v3)));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        dst[i * 4] = toHalf(src[i * 3]);
+        dst[i * 4 + 1] = toHalf(src[i * 3 + 1]);
+        dst[i * 4 + 2] = toHalf(src[i * 3 + 2]);
+        dst[i * 4 + 3] = 0x3c00;
+    }
+}
+
+void encodeOctahedral(const float *src, uint32_t *dst, size_t count)
+{
+    size_t i = 0;
+#ifdef VSVR_SSE2
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 x, y, z, w;
+        loadFloat3x4(src + i * 3, x, y, z, w);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        // project to octahedron
+        const __m128 sum = _mm_max_ps(_mm_add_ps(_mm_add_ps(_mm_andnot_ps(signMask, x), _mm_andnot_ps(signMask, y)), _mm_andnot_ps(signMask, z)), _mm_set1_ps(1e-30f));
+        const __m128 px = _mm_div_ps(x, sum);
+        const __m128 py = _mm_div_ps(y, sum);
+        // fold lower hemisphere over the diagonals
+        const __m128 fx = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, py)), _mm_or_ps(_mm_and_ps(px, signMask), one));
+        const __m128 fy = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, px)), _mm_or_ps(_mm_and_ps(py, signMask), one));
+        const __m128 lower = _mm_cmplt_ps(z, _mm_setzero_ps());
+        const __m128i ex = toSnorm(select(lower, fx, px), 32767.0f);
+        const __m128i ey = toSnorm(select(lower, fy, py), 32767.0f);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_or_si128(_mm_and_si128(ex, _mm_set1_epi32(0xffff)), _mm_slli_epi32(ey, 16)));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        dst[i] = octahedral(src + i * 3);
+    }
+}
+
+void packSnorm1010102(const float *src, uint32_t componentCount, uint32_t *dst, size_t count)
+{
+    if (componentCount != 3 && componentCount != 4)
+    {
+        throw std::runtime_error("Only 3 or 4 components can be packed to 10-10-10-2!");
+    }
+    size_t i = 0;
+#ifdef VSVR_SSE2
+    const __m128i mask10 = _mm_set1_epi32(0x3ff);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 x, y, z, w;
+        if (componentCount == 4)
+        {
+            x = _mm_loadu_ps(src + i * 4);
+            y = _mm_loadu_ps(src + i * 4 + 4);
+            z = _mm_loadu_ps(src + i * 4 + 8);
+            w = _mm_loadu_ps(src + i * 4 + 12);
+        }
+        else
+        {
+            loadFloat3x4(src + i * 3, x, y, z, w);
+        }
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        // w is -1 (0b11) if negative and +1 (0b01) otherwise
+        const __m128i wNegative = componentCount == 4 ? _mm_castps_si128(_mm_cmplt_ps(w, _mm_setzero_ps())) : _mm_setzero_si128();
+        const __m128i w2 = _mm_or_si128(_mm_set1_epi32(1 << 30), _mm_and_si128(wNegative, _mm_set1_epi32(static_cast<int>(0x80000000))));
+        __m128i packed = _mm_and_si128(toSnorm(x, 511.0f), mask10);
+        packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_and_si128(toSnorm(y, 511.0f), mask10), 10));
+        packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_and_si128(toSnorm(z, 511.0f), mask10), 20));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_or_si128(packed, w2));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        dst[i] = packSnorm(src + i * componentCount, componentCount);
+    }
+}
+
+vk::Format quantizedFormat(vk::Format format, Quantization quantization)
+{
+    switch (quantization)
+    {
+        case Quantization::eNone:
+            return format;
+        case Quantization::eHalf:
+            switch (format)
+            {
+                case vk::Format::eR32Sfloat:
+                    return vk::Format::eR16Sfloat;
+                case vk::Format::eR32G32Sfloat:
+                    return vk::Format::eR16G16Sfloat;
+                case vk::Format::eR32G32B32Sfloat:
+                case vk::Format::eR32G32B32A32Sfloat:
+                    return vk::Format::eR16G16B16A16Sfloat;
+                default:
+                    break;
+            }
+            break;
+        case Quantization::eOctahedral:
+            if (format == vk::Format::eR32G32B32Sfloat)
+            {
+                return vk::Format::eR16G16Snorm;
+            }
+            break;
+        case Quantization::ePacked:
+            if (format == vk::Format::eR32G32B32Sfloat || format == vk::Format::eR32G32B32A32Sfloat)
+            {
+                return vk::Format::eA2B10G10R10SnormPack32;
+            }
+            break;
+    }
+    throw std::runtime_error("Quantization does not support attribute format!");
+}
+
+std::vector<uint8_t> quantize(const RawData &data, vk::Format format, Quantization quantization)
+{
+    const vk::Format dstFormat = quantizedFormat(format, quantization);
+    const uint32_t srcSize = formatSize(format);
+    const size_t count = data.copySize() / srcSize;
+    std::vector<uint8_t> result(count * formatSize(dstFormat));
+    auto src = static_cast<const float *>(data.begin());
+    switch (quantization)
+    {
+        case Quantization::eNone:
+            std::memcpy(result.data(), data.begin(), result.size());
+            break;
+        case Quantization::eHalf:
+            if (format == vk::Format::eR32G32B32Sfloat)
+            {
+                float3ToHalf4(src, reinterpret_cast<uint16_t *>(result.data()), count);
+            }
+            else
+            {
+                floatToHalf(src, reinterpret_cast<uint16_t *>(result.data()), count * (srcSize / sizeof(float)));
+            }
+            break;
+        case Quantization::eOctahedral:
+            encodeOctahedral(src, reinterpret_cast<uint32_t *>(result.data()), count);
+            break;
+        case Quantization::ePacked:
+            packSnorm1010102(src, srcSize / sizeof(float), reinterpret_cast<uint32_t *>(result.data()), count);
+            break;
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "vkincludes.h"
+#include "vkbuffer.h"
+#include <cstdint>
+#include <vector>
+
+namespace vsvr
+{
+
+/// @brief How vertex attribute data is compressed when uploading.
+/// Conversions are vectorized with SSE2 if available and scalar otherwise.
+enum class Quantization
+{
+    eNone = 0,       // Upload data as is.
+    eHalf = 1,       // 32-bit float components to 16-bit floats, e.g. for positions and UVs. 3 components are padded to 4 with w = 1, as 3-component 16-bit formats are rarely supported for vertices.
+    eOctahedral = 2, // Normalized 3-component float directions, e.g. normals, to octahedral encoded eR16G16Snorm. Decode them in the shader.
+    ePacked = 3,     // Normalized 3 or 4-component float directions, e.g. tangents, to eA2B10G10R10SnormPack32. w is stored as +-1, e.g. for the bitangent sign.
+};
+
+/// @brief Get format of attribute data in format after quantization. Returns format for eNone.
+/// @throw Throws if the quantization does not support format.
+vk::Format quantizedFormat(vk::Format format, Quantization quantization);
+
+/// @brief Quantize attribute data in format.
+/// @return Tightly packed data in quantizedFormat(format, quantization).
+/// @throw Throws if the quantization does not support format.
+std::vector<uint8_t> quantize(const RawData &data, vk::Format format, Quantization quantization);
+
+/// @brief Convert count floats to 16-bit floats, rounding to nearest even. Infinities and NaNs are kept.
+void floatToHalf(const float *src, uint16_t *dst, size_t count);
+
+/// @brief Convert count 3-component floats to 4-component 16-bit floats with w = 1.
+void float3ToHalf4(const float *src, uint16_t *dst, size_t count);
+
+/// @brief Octahedral encode count normalized 3-component directions to 16-bit snorm x and y in the low and high half of dst.
+/// Decode in GLSL with: vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y)); if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * sign(n.xy); n = normalize(n);
+/// (use +1 for sign(0)).
+void encodeOctahedral(const float *src, uint32_t *dst, size_t count);
+
+/// @brief Pack count normalized 3 or 4-component directions to 10-bit snorm x, y, z and 2-bit snorm w in A2B10G10R10 order.
+/// w is +1 if it is >= 0 or componentCount is 3 and -1 otherwise.
+void packSnorm1010102(const float *src, uint32_t componentCount, uint32_t *dst, size_t count);
+
+}
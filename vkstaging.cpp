@@ -0,0 +1,167 @@
+#include "vkstaging.h"
+
+#include <stdexcept>
+
+namespace vsvr
+{
+
+StagingRing::StagingRing(vk::Device logicalDevice, Buffer::Ptr buffer)
+    : m_logicalDevice(logicalDevice)
+    , m_buffer(buffer)
+{
+    if (!m_buffer->data())
+    {
+        throw std::runtime_error("Staging buffer must be host-visible!");
+    }
+}
+
+StagingRing::~StagingRing()
+{
+    waitIdle();
+    for (auto & fence : m_freeFences)
+    {
+        m_logicalDevice.destroyFence(fence);
+    }
+}
+
+bool StagingRing::findSpace(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize &offset)
+{
+    if (m_pending.empty() && !m_hasUncommitted)
+    {
+        // nothing in use. start at the beginning again
+        m_head = 0;
+        m_tail = 0;
+    }
+    const auto capacity = m_buffer->size();
+    const auto aligned = ((m_head + alignment - 1) / alignment) * alignment;
+    if (m_head >= m_tail)
+    {
+        // free space is [head, capacity) and [0, tail)
+        if (aligned + size <= capacity)
+        {
+            offset = aligned;
+            return true;
+        }
+        // wrap around. the head must never catch up with the tail, else we can not tell a full ring from an empty one
+        if (size < m_tail)
+        {
+            offset = 0;
+            return true;
+        }
+        return false;
+    }
+    // free space is [head, tail)
+    if (aligned + size < m_tail)
+    {
+        offset = aligned;
+        return true;
+    }
+    return false;
+}
+
+StagingRing::Region StagingRing::allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+{
+    if (size >= m_buffer->size())
+    {
+        throw std::runtime_error("Staging data too big!");
+    }
+    retire();
+    vk::DeviceSize offset = 0;
+    while (!findSpace(size, alignment, offset))
+    {
+        if (m_pending.empty())
+        {
+            throw std::runtime_error("Staging ring full!");
+        }
+        // wait for the oldest submission to free up space
+        m_logicalDevice.waitForFences(1, &m_pending.front().fence, VK_TRUE, UINT64_MAX);
+        retireOldest();
+    }
+    m_head = offset + size;
+    m_hasUncommitted = true;
+    return Region({m_buffer->buffer(), offset, size, static_cast<uint8_t *>(m_buffer->data()) + offset});
+}
+
+vk::Fence StagingRing::commit(std::function<void()> onRetired)
+{
+    vk::Fence fence = nullptr;
+    if (!m_freeFences.empty())
+    {
+        fence = m_freeFences.back();
+        m_freeFences.pop_back();
+    }
+    else
+    {
+        fence = m_logicalDevice.createFence(vk::FenceCreateInfo());
+    }
+    m_pending.push_back({fence, m_head, onRetired});
+    m_hasUncommitted = false;
+    return fence;
+}
+
+void StagingRing::rollback()
+{
+    if (m_pending.empty())
+    {
+        return;
+    }
+    // the fence was never submitted, so it is still unsignaled and can be reused
+    m_freeFences.push_back(m_pending.back().fence);
+    m_pending.pop_back();
+    // regions of the rolled back submission start where the previous submission ended
+    m_head = m_pending.empty() ? m_tail : m_pending.back().end;
+    m_hasUncommitted = false;
+}
+
+void StagingRing::retireOldest()
+{
+    auto submission = m_pending.front();
+    m_pending.pop_front();
+    m_tail = submission.end;
+    m_logicalDevice.resetFences(1, &submission.fence);
+    m_freeFences.push_back(submission.fence);
+    if (submission.onRetired)
+    {
+        submission.onRetired();
+    }
+}
+
+void StagingRing::retire()
+{
+    while (!m_pending.empty() && m_logicalDevice.getFenceStatus(m_pending.front().fence) == vk::Result::eSuccess)
+    {
+        retireOldest();
+    }
+}
+
+void StagingRing::waitIdle()
+{
+    while (!m_pending.empty())
+    {
+        m_logicalDevice.waitForFences(1, &m_pending.front().fence, VK_TRUE, UINT64_MAX);
+        retireOldest();
+    }
+}
+
+bool StagingRing::waitOldest()
+{
+    if (m_pending.empty())
+    {
+        return false;
+    }
+    m_logicalDevice.waitForFences(1, &m_pending.front().fence, VK_TRUE, UINT64_MAX);
+    retireOldest();
+    return true;
+}
+
+Buffer::Ptr StagingRing::buffer() const
+{
+    return m_buffer;
+}
+
+vk::DeviceSize StagingRing::size() const
+{
+    return m_buffer->size();
+}
+
+}
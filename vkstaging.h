@@ -0,0 +1,83 @@
+#pragma once
+
+#include "vkbuffer.h"
+#include "vkincludes.h"
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace vsvr
+{
+
+/// @brief Ring buffer in host-visible memory used to upload data to buffers that are not host-visible.
+/// Regions are handed out in order and are recycled when the fence of the submission they were committed with has signaled.
+class StagingRing
+{
+public:
+    /// @brief A region of the ring to write data to.
+    struct Region
+    {
+        vk::Buffer buffer = nullptr; // Buffer handle of ring. Use as source for copies.
+        vk::DeviceSize offset = 0;   // Offset of region in buffer.
+        vk::DeviceSize size = 0;     // Size of region.
+        void *data = nullptr;        // Pointer to mapped region memory.
+    };
+
+    /// @brief Create staging ring using buffer. The buffer must be host-visible and have eTransferSrc usage.
+    StagingRing(vk::Device logicalDevice, Buffer::Ptr buffer);
+
+    /// @brief Waits for all pending submissions and destroys the fences. Does not destroy the buffer.
+    ~StagingRing();
+
+    StagingRing(const StagingRing &other) = delete;
+    StagingRing &operator=(const StagingRing &other) = delete;
+
+    /// @brief Get a region of the ring. If the ring is full this will wait for the oldest submissions to finish.
+    /// @throw Throws if size is bigger than the ring or the ring is full of regions that have not been committed yet.
+    Region allocate(vk::DeviceSize size, vk::DeviceSize alignment = 16);
+
+    /// @brief Mark all regions allocated since the last commit as being used by a submission.
+    /// @param onRetired Optional function called when the submission has finished, e.g. to free its command buffer.
+    /// @return Fence to pass to vkQueueSubmit. The regions are recycled once it signals.
+    vk::Fence commit(std::function<void()> onRetired = nullptr);
+
+    /// @brief Undo the last commit if its submission failed. Its regions are free again and its onRetired function is not called.
+    void rollback();
+
+    /// @brief Recycle regions of all finished submissions. Does not block.
+    void retire();
+
+    /// @brief Wait for all pending submissions to finish and recycle their regions.
+    void waitIdle();
+
+    /// @brief Wait for the oldest pending submission to finish and recycle its regions.
+    /// @return False if there was no pending submission.
+    bool waitOldest();
+
+    /// @brief Get ring buffer.
+    Buffer::Ptr buffer() const;
+
+    /// @brief Get ring size.
+    vk::DeviceSize size() const;
+
+private:
+    struct Submission
+    {
+        vk::Fence fence = nullptr;        // Fence signaled when submission finished.
+        vk::DeviceSize end = 0;           // Ring offset behind the last region of submission.
+        std::function<void()> onRetired;  // Called when submission has finished.
+    };
+
+    bool findSpace(vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize &offset);
+    void retireOldest();
+
+    vk::Device m_logicalDevice = nullptr;
+    Buffer::Ptr m_buffer;
+    vk::DeviceSize m_head = 0;             // Offset where the next region starts.
+    vk::DeviceSize m_tail = 0;             // Offset where the oldest region still in use starts.
+    bool m_hasUncommitted = false;         // True if regions have been allocated since the last commit.
+    std::deque<Submission> m_pending;      // Submissions in flight, oldest first.
+    std::vector<vk::Fence> m_freeFences;   // Unsignaled fences for reuse.
+};
+
+}
@@ -0,0 +1,308 @@
+#include "vkuploader.h"
+
+#include "vkdevice.h"
+#include "vkutils.h"
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+namespace vsvr
+{
+
+AsyncUploader::AsyncUploader(vk::Device logicalDevice, MemoryPool::Ptr pool, vk::Queue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily, vk::DeviceSize stagingSize, std::mutex *queueMutex)
+    : m_logicalDevice(logicalDevice)
+    , m_pool(pool)
+    , m_queue(transferQueue)
+    , m_transferFamily(transferFamily)
+    , m_graphicsFamily(graphicsFamily)
+    , m_queueMutex(queueMutex)
+{
+    Buffer::Settings settings;
+    settings.usage = vk::BufferUsageFlagBits::eTransferSrc;
+    settings.properties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    m_stagingRing.reset(new StagingRing(m_logicalDevice, m_pool->createBuffer(stagingSize, settings)));
+    m_commandPool = createCommandPool(m_logicalDevice, m_transferFamily, vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
+    m_thread = std::thread(&AsyncUploader::run, this);
+}
+
+AsyncUploader::~AsyncUploader()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_jobCondition.notify_one();
+    m_thread.join();
+    auto ringBuffer = m_stagingRing->buffer();
+    m_stagingRing.reset();
+    m_logicalDevice.destroyCommandPool(m_commandPool);
+    m_pool->destroyBuffer(ringBuffer);
+}
+
+uint64_t AsyncUploader::upload(const Buffer::Ptr &buffer, vk::DeviceSize dstOffset, const RawData &data, Callback onComplete)
+{
+    if (dstOffset + data.copySize() > buffer->size())
+    {
+        throw std::runtime_error("Range exceeds buffer size!");
+    }
+    Job job;
+    job.buffer = buffer;
+    job.offset = dstOffset;
+    job.data.resize(data.copySize());
+    std::memcpy(job.data.data(), data.begin(), data.copySize());
+    job.onComplete = onComplete;
+    return addJob(job);
+}
+
+uint64_t AsyncUploader::upload(const Image::Ptr &image, const RawData &data, vk::ImageLayout finalLayout, Callback onComplete)
+{
+    // the copy reads extent * layers tightly packed texels from the staging ring
+    const auto extent = image->extent();
+    const auto imageSize = static_cast<vk::DeviceSize>(extent.width) * extent.height * extent.depth * image->settings().arrayLayers * formatSize(image->settings().format);
+    if (data.copySize() != imageSize)
+    {
+        throw std::runtime_error("Data size does not match image size!");
+    }
+    Job job;
+    job.image = image;
+    job.finalLayout = finalLayout;
+    job.data.resize(data.copySize());
+    std::memcpy(job.data.data(), data.begin(), data.copySize());
+    job.onComplete = onComplete;
+    return addJob(job);
+}
+
+uint64_t AsyncUploader::addJob(Job &job)
+{
+    // batches are limited to half the ring, so the worker can fill one half while the device reads the other
+    if (job.data.size() > m_stagingRing->size() / 2)
+    {
+        throw std::runtime_error("Data too big for staging ring!");
+    }
+    uint64_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        id = m_nextId++;
+        job.id = id;
+        m_jobs.push_back(std::move(job));
+    }
+    m_jobCondition.notify_one();
+    return id;
+}
+
+bool AsyncUploader::isComplete(uint64_t job) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_completedId >= job;
+}
+
+void AsyncUploader::wait(uint64_t job)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_completeCondition.wait(lock, [this, job](){ return m_completedId >= job; });
+}
+
+void AsyncUploader::waitIdle()
+{
+    uint64_t lastId = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        lastId = m_nextId - 1;
+    }
+    wait(lastId);
+}
+
+bool AsyncUploader::needsOwnershipTransfer() const
+{
+    return m_transferFamily != m_graphicsFamily;
+}
+
+void AsyncUploader::recordAcquireBarriers(vk::CommandBuffer commandBuffer, vk::PipelineStageFlags dstStages)
+{
+    std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+    std::vector<vk::ImageMemoryBarrier> imageBarriers;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        bufferBarriers.swap(m_acquireBuffers);
+        imageBarriers.swap(m_acquireImages);
+    }
+    if (bufferBarriers.empty() && imageBarriers.empty())
+    {
+        return;
+    }
+    // the release on the transfer queue has finished, so there is nothing to wait for on the source side
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, dstStages, {}, 0, nullptr, static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+void AsyncUploader::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        // while submissions are in flight wake up regularly to retire them, so jobs complete without new jobs coming in
+        auto hasWork = [this](){ return m_stop || !m_jobs.empty(); };
+        if (m_inFlight > 0)
+        {
+            m_jobCondition.wait_for(lock, std::chrono::milliseconds(1), hasWork);
+        }
+        else
+        {
+            m_jobCondition.wait(lock, hasWork);
+        }
+        // collect jobs until half the ring is full
+        std::vector<Job> batch;
+        vk::DeviceSize batchSize = 0;
+        while (!m_jobs.empty())
+        {
+            const auto alignedSize = ((m_jobs.front().data.size() + StagingAlignment - 1) / StagingAlignment) * StagingAlignment;
+            if (batchSize + alignedSize > m_stagingRing->size() / 2)
+            {
+                break;
+            }
+            batchSize += alignedSize;
+            batch.push_back(std::move(m_jobs.front()));
+            m_jobs.pop_front();
+        }
+        const bool stop = m_stop && m_jobs.empty();
+        // the retire callbacks lock the mutex
+        lock.unlock();
+        if (!batch.empty())
+        {
+            submitBatch(batch, batchSize);
+        }
+        if (stop)
+        {
+            m_stagingRing->waitIdle();
+            break;
+        }
+        m_stagingRing->retire();
+        lock.lock();
+    }
+}
+
+void AsyncUploader::submitBatch(std::vector<Job> &batch, vk::DeviceSize batchSize)
+{
+    auto region = m_stagingRing->allocate(batchSize, StagingAlignment);
+    auto commandBuffer = allocateCommandBuffers(m_logicalDevice, m_commandPool, 1).front();
+    commandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+    // images must be in transfer layout before copying to them
+    std::vector<vk::ImageMemoryBarrier> layoutBarriers;
+    for (const auto & job : batch)
+    {
+        if (job.image)
+        {
+            vk::ImageMemoryBarrier barrier;
+            barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+            barrier.oldLayout = vk::ImageLayout::eUndefined;
+            barrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = job.image->image();
+            barrier.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, job.image->settings().mipLevels, 0, job.image->settings().arrayLayers);
+            layoutBarriers.push_back(barrier);
+        }
+    }
+    if (!layoutBarriers.empty())
+    {
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, 0, nullptr, 0, nullptr, static_cast<uint32_t>(layoutBarriers.size()), layoutBarriers.data());
+    }
+    // copy data to the staging region and record copies. the barriers after the copies release ownership to the graphics family
+    // and the graphics queue acquires with the same barriers, except for the access masks
+    std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+    std::vector<vk::ImageMemoryBarrier> imageBarriers;
+    std::vector<vk::BufferMemoryBarrier> acquireBuffers;
+    std::vector<vk::ImageMemoryBarrier> acquireImages;
+    std::vector<Callback> callbacks;
+    vk::DeviceSize offset = 0;
+    for (const auto & job : batch)
+    {
+        std::memcpy(static_cast<uint8_t *>(region.data) + offset, job.data.data(), job.data.size());
+        const auto size = static_cast<vk::DeviceSize>(job.data.size());
+        if (job.buffer && size > 0)
+        {
+            const auto dstOffset = job.buffer->offset() + job.offset;
+            vk::BufferCopy copyRegion(region.offset + offset, dstOffset, size);
+            commandBuffer.copyBuffer(region.buffer, job.buffer->buffer(), 1, &copyRegion);
+            // buffers with concurrent sharing do not need an ownership transfer
+            const bool release = needsOwnershipTransfer() && job.buffer->settings().sharingMode == vk::SharingMode::eExclusive;
+            const auto srcFamily = release ? m_transferFamily : VK_QUEUE_FAMILY_IGNORED;
+            const auto dstFamily = release ? m_graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+            bufferBarriers.push_back(vk::BufferMemoryBarrier(vk::AccessFlagBits::eTransferWrite, release ? vk::AccessFlags() : vk::AccessFlags(vk::AccessFlagBits::eMemoryRead), srcFamily, dstFamily, job.buffer->buffer(), dstOffset, size));
+            if (release)
+            {
+                acquireBuffers.push_back(vk::BufferMemoryBarrier(vk::AccessFlags(), vk::AccessFlagBits::eMemoryRead, srcFamily, dstFamily, job.buffer->buffer(), dstOffset, size));
+            }
+        }
+        else if (job.image)
+        {
+            const auto &settings = job.image->settings();
+            vk::BufferImageCopy copyRegion;
+            copyRegion.bufferOffset = region.offset + offset;
+            copyRegion.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+            copyRegion.imageSubresource.mipLevel = 0;
+            copyRegion.imageSubresource.baseArrayLayer = 0;
+            copyRegion.imageSubresource.layerCount = settings.arrayLayers;
+            copyRegion.imageExtent = job.image->extent();
+            commandBuffer.copyBufferToImage(region.buffer, job.image->image(), vk::ImageLayout::eTransferDstOptimal, 1, &copyRegion);
+            const bool release = needsOwnershipTransfer() && settings.sharingMode == vk::SharingMode::eExclusive;
+            vk::ImageMemoryBarrier barrier;
+            barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+            barrier.dstAccessMask = release ? vk::AccessFlags() : vk::AccessFlags(vk::AccessFlagBits::eMemoryRead);
+            barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+            barrier.newLayout = job.finalLayout;
+            barrier.srcQueueFamilyIndex = release ? m_transferFamily : VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = release ? m_graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = job.image->image();
+            barrier.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, settings.mipLevels, 0, settings.arrayLayers);
+            imageBarriers.push_back(barrier);
+            if (release)
+            {
+                barrier.srcAccessMask = vk::AccessFlags();
+                barrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+                acquireImages.push_back(barrier);
+            }
+        }
+        if (job.onComplete)
+        {
+            callbacks.push_back(job.onComplete);
+        }
+        offset += ((size + StagingAlignment - 1) / StagingAlignment) * StagingAlignment;
+    }
+    if (!bufferBarriers.empty() || !imageBarriers.empty())
+    {
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, 0, nullptr, static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+    }
+    commandBuffer.end();
+    // when the submission has finished, free the command buffer, hand the acquire barriers to the graphics side and notify waiters
+    const auto lastId = batch.back().id;
+    auto fence = m_stagingRing->commit([this, commandBuffer, lastId, callbacks, acquireBuffers, acquireImages]()
+    {
+        m_logicalDevice.freeCommandBuffers(m_commandPool, 1, &commandBuffer);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_completedId = lastId;
+            m_acquireBuffers.insert(m_acquireBuffers.end(), acquireBuffers.cbegin(), acquireBuffers.cend());
+            m_acquireImages.insert(m_acquireImages.end(), acquireImages.cbegin(), acquireImages.cend());
+        }
+        m_completeCondition.notify_all();
+        for (const auto & callback : callbacks)
+        {
+            callback();
+        }
+        m_inFlight--;
+    });
+    vk::SubmitInfo submitInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    {
+        std::unique_lock<std::mutex> queueLock;
+        if (m_queueMutex)
+        {
+            queueLock = std::unique_lock<std::mutex>(*m_queueMutex);
+        }
+        m_queue.submit(1, &submitInfo, fence);
+    }
+    m_inFlight++;
+}
+
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "vkbuffer.h"
+#include "vkimage.h"
+#include "vkstaging.h"
+#include "vkincludes.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vsvr
+{
+
+/// @brief Uploads data to buffers and images on a transfer queue from a worker thread, so loading data does not stall rendering.
+/// Jobs can be added from any thread. They are batched, copied to a staging ring and submitted to the transfer queue.
+/// If the transfer queue is from another family than the graphics queue, the worker releases ownership of the
+/// resources to the graphics family. Call recordAcquireBarriers() on the graphics queue to acquire them before use.
+/// @note Do not defragment the pool or reallocate buffers while uploads to them are pending.
+class AsyncUploader
+{
+public:
+    /// @brief Called from the worker thread when a job has finished on the device.
+    using Callback = std::function<void()>;
+
+    /// @brief Create uploader and start the worker thread.
+    /// @param transferQueue Queue to submit uploads to. Use QueueFamilyIndices::transferFamily() / transferQueueIndex().
+    /// @param queueMutex If the transfer queue is also used by other threads, e.g. because it is the graphics queue,
+    /// pass a mutex all threads lock when submitting to it.
+    AsyncUploader(vk::Device logicalDevice, MemoryPool::Ptr pool, vk::Queue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily, vk::DeviceSize stagingSize = DefaultStagingSize, std::mutex *queueMutex = nullptr);
+
+    /// @brief Finishes all jobs, stops the worker thread and frees the staging ring.
+    ~AsyncUploader();
+
+    AsyncUploader(const AsyncUploader &other) = delete;
+    AsyncUploader &operator=(const AsyncUploader &other) = delete;
+
+    /// @brief Upload data to a range of buffer starting at dstOffset. The data is copied, so it can be freed after the call.
+    /// @return Job id to pass to isComplete() or wait().
+    /// @throw Throws if the range does not fit into the buffer or the data does not fit into half of the staging ring.
+    uint64_t upload(const Buffer::Ptr &buffer, vk::DeviceSize dstOffset, const RawData &data, Callback onComplete = nullptr);
+
+    /// @brief Upload tightly packed data to mip level 0 of all array layers of a color image. The data is copied, so it can be freed after the call.
+    /// The image is transitioned from eUndefined to finalLayout, so its previous content is lost.
+    /// @return Job id to pass to isComplete() or wait().
+    /// @throw Throws if the data size is not extent * arrayLayers * texel size, the format has no texel size
+    /// or the data does not fit into half of the staging ring.
+    uint64_t upload(const Image::Ptr &image, const RawData &data, vk::ImageLayout finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal, Callback onComplete = nullptr);
+
+    /// @brief Returns true if the job has finished on the device. Jobs finish in the order they were added.
+    bool isComplete(uint64_t job) const;
+
+    /// @brief Wait for a job to finish on the device.
+    void wait(uint64_t job);
+
+    /// @brief Wait for all jobs added so far to finish on the device.
+    void waitIdle();
+
+    /// @brief Record barriers acquiring ownership of the resources of all finished jobs for the graphics family.
+    /// Call this once per frame on a command buffer of the graphics queue before the resources are used.
+    /// Does nothing if the transfer and graphics families are the same.
+    void recordAcquireBarriers(vk::CommandBuffer commandBuffer, vk::PipelineStageFlags dstStages = vk::PipelineStageFlagBits::eAllCommands);
+
+    /// @brief Returns true if resources need to change queue family ownership, so recordAcquireBarriers() must be called.
+    bool needsOwnershipTransfer() const;
+
+private:
+    struct Job
+    {
+        uint64_t id = 0;
+        Buffer::Ptr buffer;                 // Destination buffer or nullptr.
+        vk::DeviceSize offset = 0;          // Offset in destination buffer.
+        Image::Ptr image;                   // Destination image or nullptr.
+        vk::ImageLayout finalLayout = vk::ImageLayout::eUndefined; // Layout of image after upload.
+        std::vector<uint8_t> data;          // Copy of data to upload.
+        Callback onComplete;
+    };
+
+    uint64_t addJob(Job &job);
+    void run();
+    void submitBatch(std::vector<Job> &batch, vk::DeviceSize batchSize);
+
+    static const vk::DeviceSize DefaultStagingSize = 32*1024*1024;
+    static const vk::DeviceSize StagingAlignment = 16;
+
+    vk::Device m_logicalDevice = nullptr;
+    MemoryPool::Ptr m_pool;
+    vk::Queue m_queue = nullptr;                    // Transfer queue.
+    uint32_t m_transferFamily = 0;
+    uint32_t m_graphicsFamily = 0;
+    std::mutex *m_queueMutex = nullptr;             // Optional mutex locked when submitting to the queue.
+    vk::CommandPool m_commandPool = nullptr;        // Command pool for the transfer family. Only used by the worker.
+    std::unique_ptr<StagingRing> m_stagingRing;     // Staging ring. Only used by the worker.
+    uint32_t m_inFlight = 0;                        // Number of submissions not retired yet. Only used by the worker.
+    std::thread m_thread;                           // Worker thread.
+    mutable std::mutex m_mutex;                     // Protects all members below.
+    std::condition_variable m_jobCondition;         // Signaled when jobs are added or the worker should stop.
+    std::condition_variable m_completeCondition;    // Signaled when jobs have finished.
+    std::deque<Job> m_jobs;                         // Jobs waiting to be submitted, oldest first.
+    bool m_stop = false;                            // True if the worker should stop when all jobs are done.
+    uint64_t m_nextId = 1;                          // Id of next job.
+    uint64_t m_completedId = 0;                     // Id of last job that has finished.
+    std::vector<vk::BufferMemoryBarrier> m_acquireBuffers; // Acquire barriers for finished buffer jobs.
+    std::vector<vk::ImageMemoryBarrier> m_acquireImages;   // Acquire barriers for finished image jobs.
+};
+
+}
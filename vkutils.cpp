@@ -5,9 +5,12 @@ namespace vsvr
 
 std::map<vk::PhysicalDevice, vk::PhysicalDeviceProperties> DeviceInfoCache::m_propertiesCache;
 std::map<vk::PhysicalDevice, vk::PhysicalDeviceMemoryProperties> DeviceInfoCache::m_memoryPropertiesCache;
+std::mutex DeviceInfoCache::m_mutex;
 
 const vk::PhysicalDeviceProperties & DeviceInfoCache::getProperties(vk::PhysicalDevice physicalDevice)
 {
+    // map entries never move, so references stay valid after unlocking
+    std::lock_guard<std::mutex> lock(m_mutex);
     auto pcIt = m_propertiesCache.find(physicalDevice);
     if (pcIt != m_propertiesCache.cend())
     {
@@ -19,6 +22,7 @@ const vk::PhysicalDeviceProperties & DeviceInfoCache::getProperties(vk::Physical
 
 const vk::PhysicalDeviceMemoryProperties & DeviceInfoCache::getMemoryProperties(vk::PhysicalDevice physicalDevice)
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
     auto pcIt = m_memoryPropertiesCache.find(physicalDevice);
     if (pcIt != m_memoryPropertiesCache.cend())
     {
@@ -28,4 +32,99 @@ const vk::PhysicalDeviceMemoryProperties & DeviceInfoCache::getMemoryProperties(
     return m_memoryPropertiesCache[physicalDevice];
 }
 
+uint32_t formatSize(vk::Format format)
+{
+    switch (format)
+    {
+        case vk::Format::eR8Unorm:
+        case vk::Format::eR8Snorm:
+        case vk::Format::eR8Uint:
+        case vk::Format::eR8Sint:
+        case vk::Format::eR8Srgb:
+            return 1;
+        case vk::Format::eR8G8Unorm:
+        case vk::Format::eR8G8Snorm:
+        case vk::Format::eR8G8Uint:
+        case vk::Format::eR8G8Sint:
+        case vk::Format::eR8G8Srgb:
+        case vk::Format::eR16Unorm:
+        case vk::Format::eR16Snorm:
+        case vk::Format::eR16Uint:
+        case vk::Format::eR16Sint:
+        case vk::Format::eR16Sfloat:
+            return 2;
+        case vk::Format::eR8G8B8Unorm:
+        case vk::Format::eR8G8B8Snorm:
+        case vk::Format::eR8G8B8Uint:
+        case vk::Format::eR8G8B8Sint:
+        case vk::Format::eR8G8B8Srgb:
+        case vk::Format::eB8G8R8Unorm:
+        case vk::Format::eB8G8R8Srgb:
+            return 3;
+        case vk::Format::eR8G8B8A8Unorm:
+        case vk::Format::eR8G8B8A8Snorm:
+        case vk::Format::eR8G8B8A8Uint:
+        case vk::Format::eR8G8B8A8Sint:
+        case vk::Format::eR8G8B8A8Srgb:
+        case vk::Format::eB8G8R8A8Unorm:
+        case vk::Format::eB8G8R8A8Srgb:
+        case vk::Format::eA2R10G10B10UnormPack32:
+        case vk::Format::eA2R10G10B10SnormPack32:
+        case vk::Format::eA2R10G10B10UintPack32:
+        case vk::Format::eA2B10G10R10UnormPack32:
+        case vk::Format::eA2B10G10R10SnormPack32:
+        case vk::Format::eA2B10G10R10UintPack32:
+        case vk::Format::eB10G11R11UfloatPack32:
+        case vk::Format::eE5B9G9R9UfloatPack32:
+        case vk::Format::eR16G16Unorm:
+        case vk::Format::eR16G16Snorm:
+        case vk::Format::eR16G16Uint:
+        case vk::Format::eR16G16Sint:
+        case vk::Format::eR16G16Sfloat:
+        case vk::Format::eR32Uint:
+        case vk::Format::eR32Sint:
+        case vk::Format::eR32Sfloat:
+            return 4;
+        case vk::Format::eR16G16B16Unorm:
+        case vk::Format::eR16G16B16Snorm:
+        case vk::Format::eR16G16B16Uint:
+        case vk::Format::eR16G16B16Sint:
+        case vk::Format::eR16G16B16Sfloat:
+            return 6;
+        case vk::Format::eR16G16B16A16Unorm:
+        case vk::Format::eR16G16B16A16Snorm:
+        case vk::Format::eR16G16B16A16Uint:
+        case vk::Format::eR16G16B16A16Sint:
+        case vk::Format::eR16G16B16A16Sfloat:
+        case vk::Format::eR32G32Uint:
+        case vk::Format::eR32G32Sint:
+        case vk::Format::eR32G32Sfloat:
+        case vk::Format::eR64Uint:
+        case vk::Format::eR64Sint:
+        case vk::Format::eR64Sfloat:
+            return 8;
+        case vk::Format::eR32G32B32Uint:
+        case vk::Format::eR32G32B32Sint:
+        case vk::Format::eR32G32B32Sfloat:
+            return 12;
+        case vk::Format::eR32G32B32A32Uint:
+        case vk::Format::eR32G32B32A32Sint:
+        case vk::Format::eR32G32B32A32Sfloat:
+        case vk::Format::eR64G64Uint:
+        case vk::Format::eR64G64Sint:
+        case vk::Format::eR64G64Sfloat:
+            return 16;
+        case vk::Format::eR64G64B64Uint:
+        case vk::Format::eR64G64B64Sint:
+        case vk::Format::eR64G64B64Sfloat:
+            return 24;
+        case vk::Format::eR64G64B64A64Uint:
+        case vk::Format::eR64G64B64A64Sint:
+        case vk::Format::eR64G64B64A64Sfloat:
+            return 32;
+        default:
+            throw std::runtime_error("Unsupported format. Only uncompressed color formats have a byte size!");
+    }
+}
+
 }
\ No newline at end of file
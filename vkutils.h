@@ -4,10 +4,12 @@
 #include <stdexcept>
 #include <type_traits>
 #include <map>
+#include <mutex>
 
 namespace vsvr
 {
 
+/// @brief Caches physical device properties. Safe to use from multiple threads.
 class DeviceInfoCache
 {
 public:
@@ -17,8 +19,13 @@ public:
 private:
     static std::map<vk::PhysicalDevice, vk::PhysicalDeviceProperties> m_propertiesCache;
     static std::map<vk::PhysicalDevice, vk::PhysicalDeviceMemoryProperties> m_memoryPropertiesCache;
+    static std::mutex m_mutex;
 };
 
+/// @brief Get byte size of a texel or vertex attribute of an uncompressed color format, e.g. 12 for eR32G32B32Sfloat.
+/// @throw Throws for compressed, depth / stencil and multi-planar formats.
+uint32_t formatSize(vk::Format format);
+
 /// @brief Check Vulkan return value of f and throw std::runtime_error with string s if != VK_SUCCESS.
 #define VK_CHECK_THROW(f, s){if ((f) != VK_SUCCESS) { throw std::runtime_error(s); }}
 
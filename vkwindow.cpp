@@ -7,7 +7,7 @@
 namespace vsvr
 {
 
-static constexpr uint32_t MAX_IN_FLIGHT_SUBMISSIONS = 2;
+constexpr uint32_t Window::MAX_IN_FLIGHT_SUBMISSIONS;
 
 void Window::framebufferSizeCallback(glfw::Window* window, uint32_t width, uint32_t height)
 {
@@ -137,10 +137,11 @@ void Window::initDevices()
 {
     m_physicalDevice = pickPhysicalDevice(m_instance, m_surface);
     dumpDeviceInfo(m_physicalDevice);
-    m_logicalDevice = createLogicalDevice(m_physicalDevice, m_surface);
+    m_logicalDevice = createLogicalDevice(m_physicalDevice, m_surface, &m_enabledFeatures);
     auto familyIndices = findQueueFamilies(m_physicalDevice, m_surface);
     m_graphicsQueue = m_logicalDevice.getQueue(familyIndices.graphicsFamily(), 0);
     m_presentQueue = m_logicalDevice.getQueue(familyIndices.presentFamily(), 0);
+    m_transferQueue = m_logicalDevice.getQueue(familyIndices.transferFamily(), familyIndices.transferQueueIndex());
 }
 
 void Window::cleanupDevices()
@@ -13,6 +13,10 @@ namespace vsvr
 class Window
 {
 public:
+    /// @brief Number of frames that can be in flight on the device at the same time.
+    /// Use this e.g. to size per-frame resources like a FrameRingAllocator.
+    static constexpr uint32_t MAX_IN_FLIGHT_SUBMISSIONS = 2;
+
     /// @brief Create new Window.
     Window(uint32_t width = 480, uint32_t height = 320, const std::string &name = "");
     /// @brief Destroy window and clean up.
@@ -45,8 +49,10 @@ protected:
     vk::SurfaceKHR m_surface = nullptr;
     vk::PhysicalDevice m_physicalDevice = nullptr;
     vk::Device m_logicalDevice = nullptr;
+    EnabledDeviceFeatures m_enabledFeatures; // Extensions and features m_logicalDevice was created with.
     vk::Queue m_graphicsQueue = nullptr;
     vk::Queue m_presentQueue = nullptr;
+    vk::Queue m_transferQueue = nullptr; // Queue for uploads. The graphics queue if the device has no other queue.
     SwapChain m_swapChain;
     vk::RenderPass m_renderPass = nullptr;
     vk::PipelineLayout m_pipelineLayout = nullptr;